@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <memory_resource>
+
+namespace test {
+
+struct AllocationStats {
+	// set when the library is built with TEST_LIB_ALLOCATION_TRACKING
+	bool available = false;
+	uint64_t allocations = 0;
+	uint64_t deallocations = 0;
+	uint64_t allocated_bytes = 0;
+	// usable size of the blocks allocated minus the ones freed, can go negative
+	// when memory allocated before tracking started is freed
+	int64_t live_bytes = 0;
+	int64_t peak_live_bytes = 0;
+	AllocationStats& operator+=(const AllocationStats& other);
+	std::string toString() const;
+};
+
+// Counts heap allocations of the calling thread into stats while it
+// exists, only the innermost scope of a thread counts. Allocations made
+// by other threads, including threads started inside the scope, are not
+// seen. Without TEST_LIB_ALLOCATION_TRACKING the stats stay unavailable.
+class AllocationScope {
+public:
+	explicit AllocationScope(AllocationStats& stats);
+	AllocationScope(const AllocationScope&) = delete;
+	AllocationScope& operator=(const AllocationScope&) = delete;
+	~AllocationScope();
+	static bool isEnabled();
+
+private:
+	AllocationStats* previous = nullptr;
+};
+
+// Stops counting on the calling thread, for memory the framework keeps
+// across a test, like its error entries
+class AllocationPause {
+public:
+	AllocationPause();
+	AllocationPause(const AllocationPause&) = delete;
+	AllocationPause& operator=(const AllocationPause&) = delete;
+	~AllocationPause();
+
+private:
+	AllocationStats* paused = nullptr;
+};
+
+// new_delete_resource() with counting paused
+std::pmr::memory_resource* untrackedResource();
+
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <filesystem>
+
+namespace test {
+
+class Test;
+
+// Timing samples of earlier runs, in nanoseconds, keyed by test path.
+// Stored as a text file with one "path<TAB>sample sample ..." line per test.
+class Baseline {
+public:
+	bool load(const std::filesystem::path& path);
+	bool save(const std::filesystem::path& path) const;
+	const std::vector<double>* find(const std::string& test_path) const;
+	void record(const std::string& test_path, const Test& test, size_t history_size);
+
+private:
+	std::map<std::string, std::vector<double>> entries;
+};
+
+struct RegressionCheck {
+	bool regressed = false;
+	double current_median = 0.0;
+	double baseline_median = 0.0;
+	double p_value = 1.0;
+	std::string toString() const;
+};
+
+// One-sided Mann-Whitney U test, probability of seeing values this much
+// larger than baseline if both samples come from the same distribution.
+double mannWhitneyPValue(const std::vector<double>& current, const std::vector<double>& baseline);
+double median(std::vector<double> values);
+// Mann-Whitney for several current samples, for a single one p is the share
+// of baseline samples at least as large
+RegressionCheck checkRegression(
+	const std::vector<double>& current, const std::vector<double>& baseline, double threshold, double alpha
+);
+std::vector<double> getTimingSamples(const Test& test);
+
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <concepts>
+
+namespace test {
+
+template<typename TSignature, size_t InlineSize = 24>
+class Callable;
+
+// Type-erased invocable like std::function, but with room for a few more
+// captures inline and a single pointer to a static table of operations.
+// Trivially copyable invocables are copied with memcpy and need no
+// destructor call, larger ones are moved to the heap.
+template<typename TResult, typename... TArgs, size_t InlineSize>
+class Callable<TResult(TArgs...), InlineSize> {
+public:
+	Callable() = default;
+
+	template<typename TFunc>
+	requires (!std::same_as<std::remove_cvref_t<TFunc>, Callable>) && std::invocable<std::decay_t<TFunc>&, TArgs...>
+	Callable(TFunc&& func) {
+		using T = std::decay_t<TFunc>;
+		if constexpr (isInline<T>()) {
+			new (storage) T(std::forward<TFunc>(func));
+		} else {
+			new (storage) T*(new T(std::forward<TFunc>(func)));
+		}
+		ops = &ops_for<T>;
+	}
+
+	Callable(const Callable& other) {
+		copyFrom(other);
+	}
+
+	Callable(Callable&& other) noexcept {
+		moveFrom(other);
+	}
+
+	Callable& operator=(const Callable& other) {
+		if (this != &other) {
+			reset();
+			copyFrom(other);
+		}
+		return *this;
+	}
+
+	Callable& operator=(Callable&& other) noexcept {
+		if (this != &other) {
+			reset();
+			moveFrom(other);
+		}
+		return *this;
+	}
+
+	~Callable() {
+		reset();
+	}
+
+	TResult operator()(TArgs... args) const {
+		return ops->invoke(const_cast<unsigned char*>(storage), std::forward<TArgs>(args)...);
+	}
+
+	explicit operator bool() const {
+		return ops != nullptr;
+	}
+
+private:
+	enum class Operation {
+		Copy,
+		Move,
+		Destroy,
+	};
+	struct Ops {
+		TResult (*invoke)(void* storage, TArgs&&... args);
+		// null for trivially copyable inline invocables
+		void (*manage)(Operation operation, void* dst, void* src);
+	};
+
+	template<typename T>
+	static constexpr bool isInline() {
+		return sizeof(T) <= InlineSize && alignof(T) <= alignof(void*) && std::is_nothrow_move_constructible_v<T>;
+	}
+
+	template<typename T>
+	static T& get(void* storage) {
+		if constexpr (isInline<T>()) {
+			return *std::launder(reinterpret_cast<T*>(storage));
+		} else {
+			return **std::launder(reinterpret_cast<T**>(storage));
+		}
+	}
+
+	template<typename T>
+	static TResult invokeImpl(void* storage, TArgs&&... args) {
+		return get<T>(storage)(std::forward<TArgs>(args)...);
+	}
+
+	template<typename T>
+	static void manageImpl(Operation operation, void* dst, void* src) {
+		switch (operation) {
+			case Operation::Copy:
+				if constexpr (isInline<T>()) {
+					new (dst) T(get<T>(src));
+				} else {
+					new (dst) T*(new T(get<T>(src)));
+				}
+				break;
+			case Operation::Move:
+				if constexpr (isInline<T>()) {
+					new (dst) T(std::move(get<T>(src)));
+					get<T>(src).~T();
+				} else {
+					new (dst) T*(&get<T>(src));
+				}
+				break;
+			case Operation::Destroy:
+				if constexpr (isInline<T>()) {
+					get<T>(dst).~T();
+				} else {
+					delete &get<T>(dst);
+				}
+				break;
+		}
+	}
+
+	template<typename T>
+	static constexpr Ops ops_for = {
+		&invokeImpl<T>,
+		isInline<T>() && std::is_trivially_copyable_v<T> ? nullptr : &manageImpl<T>,
+	};
+
+	alignas(void*) unsigned char storage[InlineSize];
+	const Ops* ops = nullptr;
+
+	void copyFrom(const Callable& other) {
+		ops = other.ops;
+		if (!ops) {
+			return;
+		}
+		if (ops->manage) {
+			ops->manage(Operation::Copy, storage, const_cast<unsigned char*>(other.storage));
+		} else {
+			memcpy(storage, other.storage, InlineSize);
+		}
+	}
+
+	void moveFrom(Callable& other) {
+		ops = other.ops;
+		if (!ops) {
+			return;
+		}
+		if (ops->manage) {
+			ops->manage(Operation::Move, storage, other.storage);
+		} else {
+			memcpy(storage, other.storage, InlineSize);
+		}
+		other.ops = nullptr;
+	}
+
+	void reset() {
+		if (ops && ops->manage) {
+			ops->manage(Operation::Destroy, storage, nullptr);
+		}
+		ops = nullptr;
+	}
+};
+
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "test_lib/callable.h"
+
+namespace test {
+
+struct TestError;
+
+// Run of elements equal in both sequences, old_start + length and
+// new_start + length are where the run ends
+struct DiffMatch {
+	size_t old_start = 0;
+	size_t new_start = 0;
+	size_t length = 0;
+};
+
+// Linear space Myers diff of two sequences given by their sizes and equal(old_index, new_index).
+// Returns the matching runs in order, followed by an empty run at (old_size, new_size). Parts
+// that need more than max_cost edits to line up are reported as replaced as a whole, which
+// bounds the time of very different inputs.
+template<typename TEqual>
+class MyersDiff {
+public:
+	MyersDiff(TEqual equal, size_t max_cost) : equal(std::move(equal)) {
+		this->max_cost = static_cast<ptrdiff_t>(max_cost);
+	}
+
+	std::vector<DiffMatch> run(size_t old_size, size_t new_size) {
+		matches.clear();
+		compare(0, old_size, 0, new_size);
+		matches.push_back({ old_size, new_size, 0 });
+		return std::move(matches);
+	}
+
+private:
+	TEqual equal;
+	ptrdiff_t max_cost;
+	std::vector<DiffMatch> matches;
+	std::vector<ptrdiff_t> forward;
+	std::vector<ptrdiff_t> backward;
+
+	struct Snake {
+		size_t old_start;
+		size_t new_start;
+		size_t old_end;
+		size_t new_end;
+	};
+
+	void addMatch(size_t old_start, size_t new_start, size_t length) {
+		if (length == 0) {
+			return;
+		}
+		if (!matches.empty()) {
+			DiffMatch& last = matches.back();
+			if (last.old_start + last.length == old_start && last.new_start + last.length == new_start) {
+				last.length += length;
+				return;
+			}
+		}
+		matches.push_back({ old_start, new_start, length });
+	}
+
+	void compare(size_t old_begin, size_t old_end, size_t new_begin, size_t new_end) {
+		size_t prefix = 0;
+		while (old_begin + prefix < old_end && new_begin + prefix < new_end && equal(old_begin + prefix, new_begin + prefix)) {
+			prefix++;
+		}
+		addMatch(old_begin, new_begin, prefix);
+		old_begin += prefix;
+		new_begin += prefix;
+		size_t suffix = 0;
+		while (old_end - suffix > old_begin && new_end - suffix > new_begin && equal(old_end - suffix - 1, new_end - suffix - 1)) {
+			suffix++;
+		}
+		old_end -= suffix;
+		new_end -= suffix;
+		// both sides differ at their first and last element, so the middle snake has edits on both sides
+		Snake snake;
+		if (old_begin < old_end && new_begin < new_end && findMiddleSnake(old_begin, old_end, new_begin, new_end, snake)) {
+			compare(old_begin, snake.old_start, new_begin, snake.new_start);
+			addMatch(snake.old_start, snake.new_start, snake.old_end - snake.old_start);
+			compare(snake.old_end, old_end, snake.new_end, new_end);
+		}
+		addMatch(old_end, new_end, suffix);
+	}
+
+	bool findMiddleSnake(size_t old_begin, size_t old_end, size_t new_begin, size_t new_end, Snake& snake) {
+		ptrdiff_t n = static_cast<ptrdiff_t>(old_end - old_begin);
+		ptrdiff_t m = static_cast<ptrdiff_t>(new_end - new_begin);
+		ptrdiff_t delta = n - m;
+		bool odd = (delta & 1) != 0;
+		ptrdiff_t max_d = std::min((n + m + 1) / 2, max_cost);
+		// furthest x on each diagonal k = x - y, the backward search runs on the reversed sequences
+		ptrdiff_t offset = max_d + 1;
+		forward.assign(2 * max_d + 3, 0);
+		backward.assign(2 * max_d + 3, 0);
+		for (ptrdiff_t d = 0; d <= max_d; d++) {
+			for (ptrdiff_t k = -d; k <= d; k += 2) {
+				ptrdiff_t x = k == -d || (k != d && forward[offset + k - 1] < forward[offset + k + 1])
+					? forward[offset + k + 1] : forward[offset + k - 1] + 1;
+				ptrdiff_t y = x - k;
+				ptrdiff_t start_x = x;
+				while (x < n && y < m && equal(old_begin + x, new_begin + y)) {
+					x++;
+					y++;
+				}
+				forward[offset + k] = x;
+				ptrdiff_t reverse_k = delta - k;
+				if (odd && reverse_k >= -(d - 1) && reverse_k <= d - 1 && x + backward[offset + reverse_k] >= n) {
+					snake = { old_begin + start_x, new_begin + start_x - k, old_begin + x, new_begin + y };
+					return true;
+				}
+			}
+			for (ptrdiff_t k = -d; k <= d; k += 2) {
+				ptrdiff_t x = k == -d || (k != d && backward[offset + k - 1] < backward[offset + k + 1])
+					? backward[offset + k + 1] : backward[offset + k - 1] + 1;
+				ptrdiff_t y = x - k;
+				ptrdiff_t start_x = x;
+				while (x < n && y < m && equal(old_end - x - 1, new_end - y - 1)) {
+					x++;
+					y++;
+				}
+				backward[offset + k] = x;
+				ptrdiff_t forward_k = delta - k;
+				if (!odd && forward_k >= -d && forward_k <= d && x + forward[offset + forward_k] >= n) {
+					snake = { old_end - x, new_end - y, old_end - start_x, new_end - (start_x - k) };
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+};
+
+template<typename TEqual>
+std::vector<DiffMatch> diffSequences(size_t old_size, size_t new_size, TEqual equal, size_t max_cost = 4096) {
+	MyersDiff<TEqual> diff(std::move(equal), max_cost);
+	return diff.run(old_size, new_size);
+}
+
+// Limits of the diff output of compareFail, see TestModule::diff_limits
+struct DiffLimits {
+	// strings up to this size without line breaks are shown whole
+	size_t max_inline_size = 80;
+	// ranges up to this size are shown whole
+	size_t max_inline_elements = 8;
+	size_t context_lines = 3;
+	size_t context_chars = 20;
+	size_t max_hunks = 8;
+	size_t max_hunk_lines = 40;
+	// longer printed lines and elements are cut
+	size_t max_line_length = 200;
+	size_t max_cost = 4096;
+};
+
+// Adds the differing hunks of expected (old) and actual (new) under error, with lines as elements
+// if either string has line breaks, otherwise characters. Only the printed parts are copied.
+void reportStringDiff(TestError* error, std::string_view expected, std::string_view actual, const DiffLimits& limits);
+// Elements are labeled with their index, "[expected/actual]" for equal elements at
+// different indices. describe(is_actual, index) is only called for printed elements
+void reportSequenceDiff(
+	TestError* error, const std::vector<DiffMatch>& matches, size_t expected_size, size_t actual_size,
+	Callable<std::string(bool is_actual, size_t index)> describe, const DiffLimits& limits
+);
+
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <cstdint>
+
+namespace test {
+
+class Test;
+class TestModule;
+class Watchdog;
+struct TestError;
+
+// Runs test bodies in pre-forked worker processes, so a crash inside a
+// test only fails that test. Workers are forked from the tree that is
+// about to run, so a test is addressed by its index in getAllTests().
+// Results come back over a pipe, a crashed worker is replaced by a new one.
+// With a watchdog, workers running a test over its timeout are killed.
+// The constructor forks a zygote process, which forks all workers. It stays
+// single-threaded, so workers can be replaced while the parent runs threads,
+// the pool has to be created before the parent starts any.
+class IsolationPool {
+public:
+	IsolationPool(TestModule& root, size_t worker_count);
+	~IsolationPool();
+	static bool isSupported();
+	void setWatchdog(Watchdog* watchdog);
+	void run(Test* test);
+	// describes the wait status of a process that didn't exit normally
+	static std::string crashMessage(int status);
+
+private:
+	struct Worker {
+		int pid = -1;
+		int request_fd = -1;
+		int response_fd = -1;
+	};
+	Watchdog* watchdog = nullptr;
+	std::vector<Test*> tests;
+	std::unordered_map<Test*, uint32_t> test_indices;
+	std::vector<Worker> workers;
+	std::vector<size_t> free_workers;
+	std::mutex mutex;
+	std::condition_variable free_cv;
+	int zygote_pid = -1;
+	int zygote_fd = -1;
+	// one request to the zygote at a time
+	std::mutex zygote_mutex;
+
+	size_t acquireWorker();
+	void releaseWorker(size_t index);
+	bool spawn(Worker& worker);
+	int stop(Worker& worker);
+	// sends a request with optional file descriptors and returns the reply of the zygote, -1 if it failed
+	int zygoteRequest(int command, int pid, const int* fds, size_t fd_count);
+	[[noreturn]] void zygoteMain(int fd);
+	[[noreturn]] void workerMain(int request_fd, int response_fd);
+};
+
+// Compact encoding of test results used to pass them between processes.
+class BinaryWriter {
+public:
+	std::string data;
+	void writeVarint(uint64_t value);
+	void writeDouble(double value);
+	void writeString(std::string_view str);
+	void writeError(const TestError& error);
+};
+
+class BinaryReader {
+public:
+	BinaryReader(const std::string& data);
+	bool readVarint(uint64_t& value);
+	bool readDouble(double& value);
+	bool readString(std::string& str);
+	bool readError(TestError& error);
+
+private:
+	const std::string& data;
+	size_t pos = 0;
+};
+
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <utility>
+#include <algorithm>
+
+namespace test {
+
+// Append-only storage that keeps elements in contiguous chunks of growing
+// size, so adding one never moves the others and the element type doesn't
+// have to be movable.
+template<typename T>
+class NodeStorage {
+public:
+	NodeStorage() = default;
+	NodeStorage(const NodeStorage&) = delete;
+	NodeStorage& operator=(const NodeStorage&) = delete;
+
+	~NodeStorage() {
+		std::allocator<T> allocator;
+		for (auto it = chunks.rbegin(); it != chunks.rend(); it++) {
+			std::destroy(it->data, it->data + it->size);
+			allocator.deallocate(it->data, it->capacity);
+		}
+	}
+
+	template<typename... TArgs>
+	T* emplace(TArgs&&... args) {
+		if (chunks.empty() || chunks.back().size == chunks.back().capacity) {
+			size_t capacity = chunks.empty() ? min_chunk_size : std::min(chunks.back().capacity * 2, max_chunk_size);
+			chunks.push_back({ std::allocator<T>().allocate(capacity), 0, capacity });
+		}
+		Chunk& chunk = chunks.back();
+		T* ptr = new (chunk.data + chunk.size) T(std::forward<TArgs>(args)...);
+		chunk.size++;
+		return ptr;
+	}
+
+private:
+	static constexpr size_t min_chunk_size = 4;
+	static constexpr size_t max_chunk_size = 1024;
+	struct Chunk {
+		T* data = nullptr;
+		size_t size = 0;
+		size_t capacity = 0;
+	};
+	std::vector<Chunk> chunks;
+};
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace test {
+
+struct PerfCounters {
+	enum Counter {
+		Cycles,
+		Instructions,
+		CacheMisses,
+		BranchMisses,
+		PageFaults,
+		CounterCount,
+	};
+	// bit mask of counters that could be read
+	uint32_t available = 0;
+	uint64_t cycles = 0;
+	uint64_t instructions = 0;
+	uint64_t cache_misses = 0;
+	uint64_t branch_misses = 0;
+	uint64_t page_faults = 0;
+	bool isValid() const;
+	bool has(Counter counter) const;
+	PerfCounters& operator+=(const PerfCounters& other);
+	std::string toString() const;
+	static const char* getName(Counter counter);
+};
+
+// Hardware counters of the calling thread, read through perf_event_open
+// on Linux. Counters the kernel refuses to open are left out of the
+// available mask, getError() tells which ones and why. The counters follow
+// the thread that opened them, so forCurrentThread() opens them again in a
+// forked child.
+class PerfCounterGroup {
+public:
+	PerfCounterGroup();
+	~PerfCounterGroup();
+	PerfCounterGroup(const PerfCounterGroup&) = delete;
+	PerfCounterGroup& operator=(const PerfCounterGroup&) = delete;
+	bool isAvailable() const;
+	const std::string& getError() const;
+	void start();
+	void stop(PerfCounters& counters);
+	static PerfCounterGroup& forCurrentThread();
+
+private:
+	int fds[PerfCounters::CounterCount];
+	std::string error;
+	// process that opened the counters
+	int pid = -1;
+
+	void openCounters();
+	void closeCounters();
+};
+
+}
@@ -0,0 +1,321 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <vector>
+#include <tuple>
+#include <utility>
+#include <concepts>
+#include <type_traits>
+
+namespace test {
+
+// Small and fast generator for property tests, seeded per case so every
+// case can be generated on its own thread and reproduced on its own
+class Random {
+public:
+	explicit Random(uint64_t seed) : state(seed) { }
+
+	// splitmix64
+	uint64_t next() {
+		uint64_t value = (state += 0x9e3779b97f4a7c15ull);
+		value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+		value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+		return value ^ (value >> 31);
+	}
+
+	// inclusive on both ends
+	template<std::integral T>
+	T between(T min, T max) {
+		uint64_t range = static_cast<uint64_t>(max) - static_cast<uint64_t>(min);
+		uint64_t offset = range == std::numeric_limits<uint64_t>::max() ? next() : next() % (range + 1);
+		return static_cast<T>(static_cast<uint64_t>(min) + offset);
+	}
+
+	// in [0, 1)
+	double unit() {
+		return static_cast<double>(next() >> 11) * 0x1.0p-53;
+	}
+
+	static uint64_t caseSeed(uint64_t seed, uint64_t index) {
+		Random random(seed ^ (index * 0xd1342543de82ef95ull));
+		return random.next();
+	}
+
+private:
+	uint64_t state;
+};
+
+// Generators of property test values. Each has a value_type, generate(random)
+// and shrink(value), which returns simpler candidates for a failing value,
+// simplest first.
+namespace gen {
+
+template<std::integral T = int>
+class Integers {
+public:
+	using value_type = T;
+
+	Integers(T min = std::numeric_limits<T>::min(), T max = std::numeric_limits<T>::max()) {
+		this->min = min;
+		this->max = max;
+	}
+
+	T generate(Random& random) const {
+		// the edges of the range and zero are where most bugs are
+		if (random.between(0, 7) == 0) {
+			T edges[] = { min, max, target() };
+			return edges[random.between(0, 2)];
+		}
+		return random.between(min, max);
+	}
+
+	std::vector<T> shrink(const T& value) const {
+		std::vector<T> candidates;
+		T goal = target();
+		bool above = value > goal;
+		uint64_t distance = above
+			? static_cast<uint64_t>(value) - static_cast<uint64_t>(goal)
+			: static_cast<uint64_t>(goal) - static_cast<uint64_t>(value);
+		for (uint64_t step = distance; step > 0; step /= 2) {
+			candidates.push_back(static_cast<T>(above ? static_cast<uint64_t>(value) - step : static_cast<uint64_t>(value) + step));
+		}
+		return candidates;
+	}
+
+private:
+	T min;
+	T max;
+
+	T target() const {
+		return std::clamp(T(0), min, max);
+	}
+};
+
+template<std::floating_point T = double>
+class Floats {
+public:
+	using value_type = T;
+
+	Floats(T min = T(-1e6), T max = T(1e6)) {
+		this->min = min;
+		this->max = max;
+	}
+
+	T generate(Random& random) const {
+		if (random.between(0, 7) == 0) {
+			T edges[] = { min, max, target(), std::clamp(std::numeric_limits<T>::min(), min, max) };
+			return edges[random.between(0, 3)];
+		}
+		T unit = static_cast<T>(random.unit());
+		// written so that the full range of the type doesn't overflow
+		return std::clamp(min + unit * max - unit * min, min, max);
+	}
+
+	std::vector<T> shrink(const T& value) const {
+		std::vector<T> candidates;
+		T goal = target();
+		if (std::isnan(value) || value == goal) {
+			return candidates;
+		}
+		candidates.push_back(goal);
+		T truncated = std::trunc(value);
+		if (truncated != value && truncated >= min && truncated <= max) {
+			candidates.push_back(truncated);
+		}
+		T half = goal + (value - goal) / 2;
+		if (half != value && half != goal) {
+			candidates.push_back(half);
+		}
+		if (std::abs(value - goal) > T(1)) {
+			candidates.push_back(value > goal ? value - T(1) : value + T(1));
+		}
+		return candidates;
+	}
+
+private:
+	T min;
+	T max;
+
+	T target() const {
+		return std::clamp(T(0), min, max);
+	}
+};
+
+class Strings {
+public:
+	using value_type = std::string;
+
+	Strings(size_t max_length = 32, std::string alphabet = printableAlphabet()) {
+		this->max_length = max_length;
+		this->alphabet = std::move(alphabet);
+	}
+
+	std::string generate(Random& random) const {
+		std::string result(random.between<size_t>(0, max_length), ' ');
+		for (char& c : result) {
+			c = alphabet[random.between<size_t>(0, alphabet.size() - 1)];
+		}
+		return result;
+	}
+
+	std::vector<std::string> shrink(const std::string& value) const {
+		std::vector<std::string> candidates;
+		if (value.empty()) {
+			return candidates;
+		}
+		candidates.push_back("");
+		if (value.size() > 1) {
+			candidates.push_back(value.substr(0, value.size() / 2));
+			candidates.push_back(value.substr(value.size() / 2));
+		}
+		for (size_t i = 0; i < value.size(); i++) {
+			candidates.push_back(value.substr(0, i) + value.substr(i + 1));
+		}
+		for (size_t i = 0; i < value.size(); i++) {
+			if (value[i] != alphabet[0]) {
+				candidates.push_back(value);
+				candidates.back()[i] = alphabet[0];
+			}
+		}
+		return candidates;
+	}
+
+	static std::string printableAlphabet() {
+		std::string result;
+		for (char c = ' '; c <= '~'; c++) {
+			result += c;
+		}
+		return result;
+	}
+
+private:
+	size_t max_length;
+	std::string alphabet;
+};
+
+template<typename TGen>
+class Vectors {
+public:
+	using T = typename TGen::value_type;
+	using value_type = std::vector<T>;
+
+	Vectors(TGen element_generator, size_t max_size = 32) : element_generator(std::move(element_generator)) {
+		this->max_size = max_size;
+	}
+
+	value_type generate(Random& random) const {
+		value_type result;
+		size_t size = random.between<size_t>(0, max_size);
+		result.reserve(size);
+		for (size_t i = 0; i < size; i++) {
+			result.push_back(element_generator.generate(random));
+		}
+		return result;
+	}
+
+	std::vector<value_type> shrink(const value_type& value) const {
+		std::vector<value_type> candidates;
+		if (value.empty()) {
+			return candidates;
+		}
+		candidates.push_back({ });
+		size_t half = value.size() / 2;
+		if (half > 0) {
+			candidates.emplace_back(value.begin(), value.begin() + half);
+			candidates.emplace_back(value.begin() + half, value.end());
+		}
+		for (size_t i = 0; i < value.size(); i++) {
+			candidates.push_back(value);
+			candidates.back().erase(candidates.back().begin() + i);
+		}
+		for (size_t i = 0; i < value.size(); i++) {
+			for (T& element : element_generator.shrink(value[i])) {
+				candidates.push_back(value);
+				candidates.back()[i] = std::move(element);
+			}
+		}
+		return candidates;
+	}
+
+private:
+	TGen element_generator;
+	size_t max_size;
+};
+
+// Types with x and y members, like the ones of T_VEC2_COMPARE
+template<typename TVec, typename TGen = Floats<decltype(TVec::x)>>
+class Vec2 {
+public:
+	using value_type = TVec;
+
+	Vec2(TGen component_generator = TGen()) : component_generator(std::move(component_generator)) { }
+
+	TVec generate(Random& random) const {
+		TVec result { };
+		result.x = component_generator.generate(random);
+		result.y = component_generator.generate(random);
+		return result;
+	}
+
+	std::vector<TVec> shrink(const TVec& value) const {
+		std::vector<TVec> candidates;
+		for (auto& x : component_generator.shrink(value.x)) {
+			candidates.push_back(value);
+			candidates.back().x = x;
+		}
+		for (auto& y : component_generator.shrink(value.y)) {
+			candidates.push_back(value);
+			candidates.back().y = y;
+		}
+		return candidates;
+	}
+
+private:
+	TGen component_generator;
+};
+
+// Values of several generators at once, shrunk one element at a time
+template<typename... TGens>
+class Tuple {
+public:
+	using value_type = std::tuple<typename TGens::value_type...>;
+
+	Tuple(TGens... generators) : generators(std::move(generators)...) { }
+
+	value_type generate(Random& random) const {
+		// braced initialization keeps the generation order fixed
+		return std::apply([&](const TGens&... generator) {
+			return value_type { generator.generate(random)... };
+		}, generators);
+	}
+
+	std::vector<value_type> shrink(const value_type& value) const {
+		std::vector<value_type> candidates;
+		shrinkElements(value, candidates, std::index_sequence_for<TGens...>());
+		return candidates;
+	}
+
+private:
+	std::tuple<TGens...> generators;
+
+	template<size_t... Indices>
+	void shrinkElements(const value_type& value, std::vector<value_type>& candidates, std::index_sequence<Indices...>) const {
+		(shrinkElement<Indices>(value, candidates), ...);
+	}
+
+	template<size_t Index>
+	void shrinkElement(const value_type& value, std::vector<value_type>& candidates) const {
+		for (auto& element : std::get<Index>(generators).shrink(std::get<Index>(value))) {
+			candidates.push_back(value);
+			std::get<Index>(candidates.back()) = std::move(element);
+		}
+	}
+};
+
+}
+
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <filesystem>
+#include <vector>
+#include <cstdio>
+
+namespace test {
+
+class TestNode;
+class Test;
+class TestModule;
+struct TestError;
+
+// Receives results while TestModule::run() walks the module tree, from the
+// thread that called run(). In sequential mode every test is reported right
+// after it finishes, in parallel mode once the parallel phase is over.
+class Reporter {
+public:
+	virtual ~Reporter() = default;
+	virtual void onModuleStart(const TestModule&) { }
+	virtual void onModuleEnd(const TestModule&) { }
+	virtual void onTestStart(const Test&) { }
+	// error entries of a finished test in tree order, depth 0 is the topmost level
+	virtual void onTestError(const Test&, const TestError&, size_t) { }
+	virtual void onTestEnd(const Test&) { }
+};
+
+// "passed", "cached", "failed", "timeout", "cancelled" or "regressed"
+const char* getStatusString(const TestNode& node);
+
+// Output file that keeps writes in memory until flush() or until the
+// buffer fills up
+class ReportFile {
+public:
+	ReportFile() = default;
+	ReportFile(const ReportFile&) = delete;
+	ReportFile& operator=(const ReportFile&) = delete;
+	~ReportFile();
+	bool open(const std::filesystem::path& path);
+	bool isOpen() const;
+	void write(std::string_view str);
+	// bytes written so far, including the ones still buffered
+	size_t getSize() const;
+	// replaces already written bytes at offset, str must not reach past the end
+	void overwrite(size_t offset, std::string_view str);
+	void flush();
+	void close();
+
+private:
+	static constexpr size_t buffer_size = 64 * 1024;
+	FILE* file = nullptr;
+	std::string buffer;
+	size_t flushed_size = 0;
+};
+
+// JUnit XML with a single testsuite, module paths go into the classname
+// of the test cases. The file is flushed before every test runs, so a
+// crash leaves all results up to the crashing test. The counts of the
+// testsuite are written into space left in its start tag at the end.
+class JUnitReporter : public Reporter {
+public:
+	JUnitReporter(const std::filesystem::path& path);
+	void onModuleStart(const TestModule& module) override;
+	void onModuleEnd(const TestModule& module) override;
+	void onTestStart(const Test& test) override;
+	void onTestError(const Test& test, const TestError& error, size_t depth) override;
+	void onTestEnd(const Test& test) override;
+
+private:
+	std::filesystem::path path;
+	ReportFile file;
+	std::string failure_text;
+	// room for the tests, failures and skipped attributes with 20 digit counts
+	static constexpr size_t counts_size = 96;
+	size_t counts_offset = 0;
+	size_t test_count = 0;
+	size_t failure_count = 0;
+	size_t skipped_count = 0;
+};
+
+// One JSON object per line for every event, flushed like JUnitReporter
+class JsonLinesReporter : public Reporter {
+public:
+	JsonLinesReporter(const std::filesystem::path& path);
+	void onModuleStart(const TestModule& module) override;
+	void onModuleEnd(const TestModule& module) override;
+	void onTestStart(const Test& test) override;
+	void onTestError(const Test& test, const TestError& error, size_t depth) override;
+	void onTestEnd(const Test& test) override;
+
+private:
+	std::filesystem::path path;
+	ReportFile file;
+};
+
+// Reads the files written by JsonLinesReporter in separate shard runs and
+// logs a summary like TestModule::printSummary() over all of them. A test
+// that was started but never ended counts as failed, a test in several files
+// keeps its worst status. Returns true if all tests passed and every file
+// could be read.
+bool mergeJsonLinesReports(const std::vector<std::filesystem::path>& files, size_t slowest_count = 5);
+
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <map>
+#include <cstdint>
+#include <filesystem>
+
+namespace test {
+
+class TestModule;
+
+// Outcome of the last run of every test together with the fingerprint it
+// ran with. Stored as a text file with one "path<TAB>fingerprint<TAB>status"
+// line per test.
+class ResultCache {
+public:
+	struct Entry {
+		uint64_t fingerprint = 0;
+		bool passed = false;
+	};
+	bool load(const std::filesystem::path& path);
+	bool save(const std::filesystem::path& path) const;
+	const Entry* find(const std::string& test_path) const;
+	void record(const std::string& test_path, uint64_t fingerprint, bool passed);
+
+private:
+	std::map<std::string, Entry> entries;
+};
+
+// 64-bit FNV-1a
+uint64_t hashBytes(std::string_view data, uint64_t hash = 0xcbf29ce484222325ull);
+// hash of the file contents, 0 if it can't be read
+uint64_t hashFile(const std::filesystem::path& path);
+// hash of the running executable, 0 where it can't be located
+uint64_t getBinaryFingerprint();
+// Sets Test::fingerprint of every test from its path, the version strings
+// and input files of the test and its modules, the binary if requested, and
+// the fingerprints of its prerequisites, so a change invalidates dependents.
+void computeFingerprints(TestModule& root, bool use_binary);
+
+}
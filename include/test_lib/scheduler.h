@@ -0,0 +1,51 @@
+#pragma once
+
+#include "test_lib/thread_pool.h"
+#include <unordered_map>
+
+namespace test {
+
+class TestNode;
+class Test;
+class TestModule;
+
+// Runs all tests of a module tree on a thread pool. Tree structure and
+// required_nodes are turned into a DAG, every node is started as soon as
+// all its prerequisites are finished. Only execution happens here, results
+// are logged afterwards by TestModule::run() in tree order.
+class Scheduler {
+public:
+	Scheduler(TestModule& root, size_t thread_count);
+	void run();
+
+private:
+	struct Task {
+		enum class Kind {
+			Test,
+			ModuleGate,
+			ModuleDone,
+		};
+		Kind kind;
+		TestNode* node = nullptr;
+		Task* gate = nullptr;
+		std::vector<Task*> dependents;
+		std::atomic<size_t> pending_count = 0;
+		bool cancelled = false;
+		bool finished = false;
+		Task(Kind kind, TestNode* node, Task* gate);
+	};
+	TestModule& root;
+	ThreadPool pool;
+	std::deque<Task> tasks;
+	std::unordered_map<TestNode*, Task*> done_tasks;
+	std::unordered_map<TestModule*, Task*> gate_tasks;
+
+	void addModule(TestModule* module, Task* parent_gate);
+	void addEdges();
+	void addEdge(Task* prerequisite, Task* task);
+	void execute(Task* task, TaskGroup& group);
+	void runBeforeHooks(TestModule* module);
+	void runAfterHooks(TestModule* module);
+};
+
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <regex>
+
+namespace test {
+
+class TestNode;
+class Test;
+class TestModule;
+class Baseline;
+
+// Include and exclude filters for the tests of a tree. Globs match the
+// test path or any of its module prefixes, "*" stays within one path
+// segment, "**" crosses segments and "?" matches one character. Tags are
+// inherited from modules. Prerequisites of selected tests are always
+// selected too, so they can't cancel what was asked for.
+class TestSelection {
+public:
+	void include(std::string_view glob);
+	void exclude(std::string_view glob);
+	// ECMAScript syntax, matched anywhere in the path
+	void includeRegex(std::string_view regex);
+	void excludeRegex(std::string_view regex);
+	void includeTag(std::string_view tag);
+	void excludeTag(std::string_view tag);
+	bool isEmpty() const;
+	void clear();
+	// called when tests are added to the tree
+	void invalidateIndex();
+	// sets TestNode::selected on the whole tree, returns the number of selected tests,
+	// throws std::regex_error on a bad pattern
+	size_t apply(TestModule& root);
+	// Whether apply() could select the test at path, or with is_module a test inside the
+	// module at path, before the node exists. Tags, and regexes for modules, can't be
+	// checked without the nodes, so they count as a possible match.
+	bool mayMatch(std::string_view path, bool is_module);
+	// Narrows the selection made by apply() to one of shard_count shards.
+	// Tests connected through required_nodes always land in the same shard,
+	// these groups are spread by longest-processing-time first using median
+	// durations from timings when given, otherwise every test weighs the same.
+	// Returns the number of selected tests in this shard.
+	size_t applyShard(size_t shard_index, size_t shard_count, const Baseline* timings);
+
+private:
+	enum class Kind {
+		Glob,
+		Regex,
+		Tag,
+	};
+	struct Filter {
+		Kind kind;
+		bool exclude = false;
+		std::string pattern;
+		// of regex filters, compiled on first use
+		std::shared_ptr<std::regex> regex;
+	};
+	struct IndexEntry {
+		std::string path;
+		Test* test = nullptr;
+	};
+	std::vector<Filter> filters;
+	bool index_valid = false;
+	// sorted by path, so a glob only has to look at paths starting with its literal prefix
+	std::vector<IndexEntry> index;
+	std::vector<TestModule*> modules;
+	TestModule* root = nullptr;
+	std::unordered_map<std::string, std::vector<Test*>> tag_index;
+
+	void buildIndex(TestModule& root);
+	size_t selectModules(bool keep_empty);
+	void collectMatches(Filter& filter, std::vector<Test*>& result) const;
+	static const std::regex& getRegex(Filter& filter);
+};
+
+bool matchGlob(std::string_view pattern, std::string_view str);
+
+}
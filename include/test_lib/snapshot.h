@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+namespace test {
+
+class Test;
+struct SourceLocation;
+
+// Read-only view of a whole file, memory mapped where the platform allows it,
+// so comparing a large golden file doesn't copy it first
+class MappedFile {
+public:
+	MappedFile() = default;
+	explicit MappedFile(const std::filesystem::path& path);
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile();
+
+	bool isOpen() const { return is_open; }
+	const uint8_t* data() const { return ptr; }
+	size_t size() const { return length; }
+	void close();
+
+private:
+	bool is_open = false;
+	const uint8_t* ptr = nullptr;
+	size_t length = 0;
+	// fallback copy on platforms without mapping
+	std::string buffer;
+};
+
+// Writes to a temporary file next to path and renames it over path,
+// so an interrupted update never leaves a partial file behind
+bool writeFileAtomically(const std::filesystem::path& path, const void* data, size_t size);
+// Golden file of a T_SNAPSHOT, snapshot_dir of the root module / test path / name,
+// with every component escaped so it stays a single file name
+std::filesystem::path getSnapshotPath(const Test& test, std::string_view name);
+bool testSnapshotBytes(Test& test, const SourceLocation& location, std::string_view name, const void* data, size_t size);
+
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace test {
+
+class Test;
+struct SourceLocation;
+
+// Bulk comparison kernels for the span assertions. Each one returns the
+// index of the first element in [begin, size) that doesn't match, or size
+// if all of them do. On x86-64 they use AVX2 when the CPU has it and SSE2
+// otherwise, other platforms get plain loops.
+size_t findMismatch(const float* actual, const float* expected, size_t begin, size_t size);
+size_t findMismatch(const double* actual, const double* expected, size_t begin, size_t size);
+size_t findApproxMismatch(const float* actual, const float* expected, size_t begin, size_t size, float epsilon);
+size_t findApproxMismatch(const double* actual, const double* expected, size_t begin, size_t size, double epsilon);
+size_t findUlpMismatch(const float* actual, const float* expected, size_t begin, size_t size, uint64_t max_ulps);
+size_t findUlpMismatch(const double* actual, const double* expected, size_t begin, size_t size, uint64_t max_ulps);
+// Integers compare bitwise, so whole chunks go through the vectorized memcmp
+template<typename T>
+size_t findIntegralMismatch(const T* actual, const T* expected, size_t begin, size_t size) {
+	const size_t chunk_size = 256;
+	for (size_t chunk = begin; chunk < size; chunk += chunk_size) {
+		size_t chunk_end = std::min(chunk + chunk_size, size);
+		if (memcmp(actual + chunk, expected + chunk, (chunk_end - chunk) * sizeof(T)) == 0) {
+			continue;
+		}
+		for (size_t i = chunk; i < chunk_end; i++) {
+			if (actual[i] != expected[i]) {
+				return i;
+			}
+		}
+	}
+	return size;
+}
+// Number of representable values between left and right, UINT64_MAX if either is NaN
+uint64_t ulpDistance(float left, float right);
+uint64_t ulpDistance(double left, double right);
+
+struct SpanMismatch {
+	size_t index = 0;
+	std::string actual;
+	std::string expected;
+};
+
+struct SpanCompareReport {
+	size_t actual_size = 0;
+	size_t expected_size = 0;
+	size_t mismatch_count = 0;
+	double max_error = 0.0;
+	size_t max_error_index = 0;
+	const char* error_unit = "";
+	// only the first TestModule::max_span_mismatches are kept
+	std::vector<SpanMismatch> mismatches;
+	void addError(size_t index, double error);
+};
+
+std::string formatSpanValue(float value);
+std::string formatSpanValue(double value);
+void spanCompareFail(Test& test, const SourceLocation& location, const char* name, const SpanCompareReport& report);
+
+}
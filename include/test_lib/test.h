@@ -5,53 +5,111 @@
 #include <string>
 #include <memory>
 #include <filesystem>
-#include <stack>
+#include <chrono>
+#include <string_view>
+#include <memory_resource>
+#include <source_location>
+#include <cstdint>
+#include <span>
+#include <ranges>
+#include <cmath>
+#include <optional>
+#include <sstream>
+#include <tuple>
+#include <exception>
+#include <istream>
+#include <iterator>
+#include <mutex>
+#include <atomic>
+#include "test_lib/perf_counters.h"
+#include "test_lib/allocation_tracking.h"
+#include "test_lib/span_compare.h"
+#include "test_lib/diff.h"
+#include "test_lib/snapshot.h"
+#include "test_lib/reporter.h"
+#include "test_lib/selection.h"
+#include "test_lib/callable.h"
+#include "test_lib/property.h"
+#include "test_lib/node_storage.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 namespace test {
 
 class Test;
-using TestFuncType = std::function<void(Test& test)>;
+class Benchmark;
+class ParameterizedTest;
+class PropertyTest;
+class FuzzTest;
+class StressTest;
+struct TestError;
+class BinaryWriter;
+class BinaryReader;
+using TestFuncType = Callable<void(Test& test)>;
+using BenchmarkFuncType = Callable<void(Benchmark& test)>;
+using FuzzFuncType = Callable<void(Test& test, const uint8_t* data, size_t size)>;
+using StressFuncType = Callable<void(Test& test, size_t thread_index)>;
 
 // prefixes in macros needed to allow calling from free functions
 
 #define T_MESSAGE(message) \
-	test::testMessage(test, __FILE__, __LINE__, message)
+	test::testMessage(test, test::SourceLocation::current(), message)
 
 #define T_CHECK(value, ...) \
-	test::testCheck(test, __FILE__, __LINE__, value, #value, __VA_ARGS__)
+	test::testCheck(test, test::SourceLocation::current(), value, #value __VA_OPT__(,) __VA_ARGS__)
 
 #define T_COMPARE(actual, expected, ...) \
-	test::testCompare(test, __FILE__, __LINE__, #actual, actual, expected, __VA_ARGS__)
+	test::testCompare(test, test::SourceLocation::current(), #actual, actual, expected __VA_OPT__(,) __VA_ARGS__)
 
 #define T_APPROX_COMPARE(actual, expected, ...) \
-	test::testApproxCompare(test, __FILE__, __LINE__, #actual, actual, expected, __VA_ARGS__)
+	test::testApproxCompare(test, test::SourceLocation::current(), #actual, actual, expected __VA_OPT__(,) __VA_ARGS__)
 
 #define T_VEC2_COMPARE(actual, expected, ...) \
-	test::testVec2Compare(test, __FILE__, __LINE__, #actual, actual, expected, __VA_ARGS__)
+	test::testVec2Compare(test, test::SourceLocation::current(), #actual, actual, expected __VA_OPT__(,) __VA_ARGS__)
 
 #define T_VEC2_APPROX_COMPARE(actual, expected, ...) \
-	test::testVec2ApproxCompare(test, __FILE__, __LINE__, #actual, actual, expected, __VA_ARGS__)
+	test::testVec2ApproxCompare(test, test::SourceLocation::current(), #actual, actual, expected __VA_OPT__(,) __VA_ARGS__)
+
+#define T_SPAN_COMPARE(actual, expected) \
+	test::testSpanCompare(test, test::SourceLocation::current(), #actual, actual, expected)
+
+#define T_SPAN_APPROX_COMPARE(actual, expected, ...) \
+	test::testSpanApproxCompare(test, test::SourceLocation::current(), #actual, actual, expected __VA_OPT__(,) __VA_ARGS__)
+
+#define T_SPAN_ULP_COMPARE(actual, expected, ...) \
+	test::testSpanUlpCompare(test, test::SourceLocation::current(), #actual, actual, expected __VA_OPT__(,) __VA_ARGS__)
+
+#define T_SNAPSHOT(name, data) \
+	test::testSnapshot(test, test::SourceLocation::current(), name, data)
 
 #define T_COMPARE_RAW(actual, expected, ...) \
 	test.raw_mode = true; \
-	test::testCompare(test, __FILE__, __LINE__, #actual, actual, expected, __VA_ARGS__); \
+	T_COMPARE(actual, expected __VA_OPT__(,) __VA_ARGS__); \
 	test.raw_mode = false;
 
 #define T_APPROX_COMPARE_RAW(actual, expected, ...) \
 	test.raw_mode = true; \
-	test::testApproxCompare(test, __FILE__, __LINE__, #actual, actual, expected, __VA_ARGS__); \
+	T_APPROX_COMPARE(actual, expected __VA_OPT__(,) __VA_ARGS__); \
 	test.raw_mode = false;
 
 #define T_VEC2_COMPARE_RAW(actual, expected, ...) \
 	test.raw_mode = true; \
-	test::testVec2Compare(test, __FILE__, __LINE__, #actual, actual, expected, __VA_ARGS__); \
+	T_VEC2_COMPARE(actual, expected __VA_OPT__(,) __VA_ARGS__); \
 	test.raw_mode = false;
 
 #define T_VEC2_APPROX_COMPARE_RAW(actual, expected, ...) \
 	test.raw_mode = true; \
-	test::testVec2ApproxCompare(test, __FILE__, __LINE__, #actual, actual, expected, __VA_ARGS__); \
+	T_VEC2_APPROX_COMPARE(actual, expected __VA_OPT__(,) __VA_ARGS__); \
 	test.raw_mode = false;
 
+#define T_MAX_ALLOCATIONS(max_count) \
+	test::testMaxAllocations(test, test::SourceLocation::current(), max_count)
+
+#define T_NO_LEAKS() \
+	test::testNoLeaks(test, test::SourceLocation::current())
+
 #define T_ASSERT(expr) \
 	if (!expr) { \
 		return; \
@@ -62,8 +120,11 @@ using TestFuncType = std::function<void(Test& test)>;
 		return; \
 	} \
 
+#define T_BENCHMARK \
+	while (test.keepRunning())
+
 #define T_CONTAINER(message) \
-	test::ErrorContainer error_container(test, __FILE__, __LINE__, message);
+	test::ErrorContainer error_container(test, test::SourceLocation::current(), message);
 
 #define T_WRAP_CONTAINER(expr, ...) \
 	{ \
@@ -71,26 +132,100 @@ using TestFuncType = std::function<void(Test& test)>;
 		expr; \
 	}
 
+// Defines a test at namespace scope, the body follows the macro:
+// T_TEST("Module/Submodule/name") { T_CHECK(...); }
+// Registered tests only exist in roots with add_registered set.
+#define T_TEST(path) \
+	T_TEST_IMPL(path, __COUNTER__)
+
+// Registers a TestModule subclass, which is constructed with (name, parent, { })
+// only when the selection of the root can match something inside it
+#define T_MODULE(module_class, path) \
+	static test::RegisteredNode T_JOIN(t_registered_module_, __COUNTER__)(path, &test::addRegisteredModule<module_class>);
+
+#define T_TEST_IMPL(path, id) \
+	static void T_JOIN(t_registered_test_, id)(test::Test&); \
+	static test::RegisteredNode T_JOIN(t_registered_entry_, id)(path, &T_JOIN(t_registered_test_, id)); \
+	static void T_JOIN(t_registered_test_, id)([[maybe_unused]] test::Test& test)
+
+#define T_JOIN(left, right) T_JOIN_IMPL(left, right)
+#define T_JOIN_IMPL(left, right) left##right
+
 class TestModule;
+class FixtureBase;
+class IsolationPool;
+class ResultCache;
+class Baseline;
+class Watchdog;
+
+// Returns the part of a path after the last separator, evaluated at compile time
+consteval const char* fileBasename(const char* path) {
+	const char* result = path;
+	for (const char* c = path; *c; c++) {
+		if (*c == '/' || *c == '\\') {
+			result = c + 1;
+		}
+	}
+	return result;
+}
+
+struct SourceLocation {
+	const char* file = "";
+	uint32_t line = 0;
+	static consteval SourceLocation current(std::source_location location = std::source_location::current()) {
+		return SourceLocation { fileBasename(location.file_name()), location.line() };
+	}
+	std::string toString() const;
+};
 
 // Free function declarations for test macros
-void testMessage(Test& test, const std::string& file, size_t line, const std::string& message);
-bool testCheck(Test& test, const std::string& file, size_t line, bool value, const std::string& value_message);
-bool testCheck(Test& test, const std::string& file, size_t line, bool value, const std::string& value_message, const std::string message);
+// Passing checks only test the condition, all formatting is done in the
+// out-of-line failure functions.
+void testMessage(Test& test, const SourceLocation& location, std::string_view message);
+inline bool testCheck(Test& test, const SourceLocation& location, bool value, const char* value_message);
+inline bool testCheck(Test& test, const SourceLocation& location, bool value, const char* value_message, std::string_view message);
+void checkFail(Test& test, const SourceLocation& location, const char* value_message, std::string_view message);
+// Allocations of the test so far, always pass when allocation tracking is not built in
+bool testMaxAllocations(Test& test, const SourceLocation& location, uint64_t max_count);
+bool testNoLeaks(Test& test, const SourceLocation& location);
 template<typename T1, typename T2>
-bool testCompare(Test& test, const std::string& file, size_t line, const std::string& name, T1 actual, T2 expected);
+bool testCompare(Test& test, const SourceLocation& location, const char* name, const T1& actual, const T2& expected);
 template<typename T1, typename T2, typename TStr>
-bool testCompare(Test& test, const std::string& file, size_t line, const std::string& name, T1 actual, T2 expected, TStr to_str);
+bool testCompare(Test& test, const SourceLocation& location, const char* name, const T1& actual, const T2& expected, TStr to_str);
 template<typename T1, typename T2, typename TStr, typename TCmp>
-bool testCompare(Test& test, const std::string& file, size_t line, const std::string& name, T1 actual, T2 expected, TStr to_str, TCmp cmp);
+bool testCompare(Test& test, const SourceLocation& location, const char* name, const T1& actual, const T2& expected, TStr to_str, TCmp cmp);
 template<typename T>
-bool testApproxCompare(Test& test, const std::string& file, size_t line, const std::string& name, T actual, T expected, T epsilon = 0.0001f);
+bool testApproxCompare(Test& test, const SourceLocation& location, const char* name, T actual, T expected, T epsilon = 0.0001f);
 template<typename T>
-bool testVec2Compare(Test& test, const std::string& file, size_t line, const std::string& name, T actual, T expected);
+bool testVec2Compare(Test& test, const SourceLocation& location, const char* name, const T& actual, const T& expected);
 template<typename T>
-bool testVec2ApproxCompare(Test& test, const std::string& file, size_t line, const std::string& name, T actual, T expected, double epsilon = 0.0001);
+bool testVec2ApproxCompare(Test& test, const SourceLocation& location, const char* name, const T& actual, const T& expected, double epsilon = 0.0001);
+template<typename TActual, typename TExpected>
+bool testSpanCompare(Test& test, const SourceLocation& location, const char* name, const TActual& actual, const TExpected& expected);
+template<typename TActual, typename TExpected>
+bool testSpanApproxCompare(Test& test, const SourceLocation& location, const char* name, const TActual& actual, const TExpected& expected, double epsilon = 0.0001);
+template<typename TActual, typename TExpected>
+bool testSpanUlpCompare(Test& test, const SourceLocation& location, const char* name, const TActual& actual, const TExpected& expected, uint64_t max_ulps = 4);
+template<typename T>
+bool testSnapshot(Test& test, const SourceLocation& location, std::string_view name, const T& data);
 template<typename T, typename TEps>
 bool equals(T left, T right, TEps epsilon = 0.0001f);
+template<typename T1, typename T2, typename TStr>
+void compareFail(Test& test, const SourceLocation& location, const char* name, const T1& actual, const T2& expected, TStr to_str);
+// Copies the subentries of from and everything below them under to
+void copyErrors(const TestError& from, TestError* to);
+std::string formatDuration(std::chrono::nanoseconds duration);
+std::chrono::nanoseconds threadCpuTime();
+
+// Tag of the concrete node class, so traversals don't need RTTI
+enum class NodeKind : uint8_t {
+	Test,
+	Benchmark,
+	Parameterized,
+	Fuzz,
+	Stress,
+	Module,
+};
 
 class TestNode {
 public:
@@ -100,47 +235,461 @@ public:
 	bool is_run = false;
 	bool result = false;
 	bool cancelled = false;
+	// set by TestSelection, unselected nodes are skipped by run()
+	bool selected = true;
+	// tags of modules apply to everything inside, set them before the first run
+	std::vector<std::string> tags;
+	// part of the result cache fingerprint, for modules they apply to everything inside
+	std::string version;
+	std::vector<std::filesystem::path> input_files;
+	// fixtures the node uses, for modules everything inside uses them, see FixtureBase
+	std::vector<FixtureBase*> fixtures;
+	// Longest a test may run, zero means the timeout of the parent module is used, so
+	// the timeout of the root module is the default for everything. A test that runs
+	// over it in isolated mode is killed, in-process its stack is logged and the whole
+	// process exits, since the stuck thread can't be stopped.
+	std::chrono::nanoseconds timeout = std::chrono::nanoseconds::zero();
+	std::chrono::nanoseconds wall_time = std::chrono::nanoseconds::zero();
+	std::chrono::nanoseconds cpu_time = std::chrono::nanoseconds::zero();
+	PerfCounters perf_counters;
+	// heap allocations made on the thread running the test
+	AllocationStats allocation_stats;
+	virtual ~TestNode() = default;
+	NodeKind getKind() const { return kind; }
+	// null if the node is of another kind, tests include benchmarks and parameterized tests
+	Test* asTest();
+	const Test* asTest() const;
+	Benchmark* asBenchmark();
+	const Benchmark* asBenchmark() const;
+	ParameterizedTest* asParameterized();
+	const ParameterizedTest* asParameterized() const;
+	FuzzTest* asFuzz();
+	const FuzzTest* asFuzz() const;
+	StressTest* asStress();
+	const StressTest* asStress() const;
+	TestModule* asModule();
+	const TestModule* asModule() const;
 	bool isRoot() const;
+	std::string getPath(const TestNode* ancestor = nullptr) const;
+	std::chrono::nanoseconds getTimeout() const;
 	virtual bool run() = 0;
-private:
+
+protected:
+	NodeKind kind = NodeKind::Test;
 };
 
+class ErrorArena;
+
+// Error entries and their text live in the arena of the test that owns
+// them, subentries form an intrusive singly linked list.
 struct TestError {
 	enum class Type {
 		Root,
 		Container,
 		Normal,
 	};
+
+	class List {
+	public:
+		class Iterator {
+		public:
+			explicit Iterator(TestError* const* link) : link(link) { }
+			TestError* const& operator*() const { return *link; }
+			Iterator& operator++() { link = &(*link)->next; return *this; }
+			bool operator==(const Iterator& other) const { return *link == *other.link; }
+		private:
+			TestError* const* link;
+		};
+		Iterator begin() const { return Iterator(&first); }
+		Iterator end() const { return Iterator(&null_link); }
+		size_t size() const { return count; }
+		bool empty() const { return count == 0; }
+		TestError* front() const { return first; }
+		TestError* back() const { return last; }
+		void clear();
+		void push_back(TestError* error);
+
+	private:
+		static inline TestError* const null_link = nullptr;
+		TestError* first = nullptr;
+		TestError* last = nullptr;
+		size_t count = 0;
+	};
+
 	Type type;
-	std::string str;
-	bool raw;
-	std::vector<std::unique_ptr<TestError>> subentries;
-	explicit TestError(const std::string& str, Type type);
-	TestError* add(const std::string& message, Type type = Type::Normal);
+	std::string_view str;
+	bool raw = false;
+	ErrorArena* arena = nullptr;
+	TestError* next = nullptr;
+	List subentries;
+	TestError(ErrorArena* arena, std::string_view str, Type type);
+	TestError* add(std::string_view message, Type type = Type::Normal);
+	// container with nothing but other containers inside, not shown in output
+	bool isEmptyContainer() const;
 	void log() const;
 };
 
+// Monotonic storage for the error tree of one test. Everything is freed
+// at once by release(), which happens when the test is run again. After
+// max_entries entries new ones are only counted in dropped_count.
+class ErrorArena {
+public:
+	size_t max_entries = 0;
+	size_t entry_count = 0;
+	size_t dropped_count = 0;
+
+	ErrorArena();
+	ErrorArena(const ErrorArena&) = delete;
+	ErrorArena& operator=(const ErrorArena&) = delete;
+	TestError* create(std::string_view str, TestError::Type type);
+	std::string_view copyString(std::string_view str);
+	bool isOverflow(const TestError* error) const;
+	// kept inline, so a test that never reports anything doesn't allocate
+	TestError* getRoot();
+	void release();
+
+private:
+	std::pmr::monotonic_buffer_resource resource;
+	TestError root;
+	TestError overflow;
+};
+
 class Test : public TestNode {
 public:
-	std::unique_ptr<TestError> root_error;
+	TestError* root_error = nullptr;
 	bool raw_mode;
+	bool regressed = false;
+	bool timed_out = false;
+	// passed in an earlier run with the same fingerprint, not run this time
+	bool cached = false;
+	uint64_t fingerprint = 0;
+	// 0 means TestModule::max_error_entries of the root module
+	size_t max_error_entries = 0;
 
 	Test(std::string name, TestFuncType func);
 	Test(std::string name, std::vector<TestNode*> required, TestFuncType func);
 	bool run() override;
-	TestError* getCurrentError() const;
+	// Marks the test cancelled without running it, its fixtures are released as after a run
+	void cancel();
+	TestError* getCurrentError();
+	size_t getDroppedErrorCount() const;
+	void resetErrors();
+	// fixtures of the test and its modules, without duplicates
+	std::vector<FixtureBase*> getFixtures() const;
 	static std::string char_to_str(char c);
 	static std::string char_to_esc(std::string str, bool convert_quotes = true);
 
+protected:
+	virtual void writeResults(BinaryWriter& writer) const;
+	virtual bool readResults(BinaryReader& reader);
+
 private:
 	friend class ErrorContainer;
+	friend class IsolationPool;
+	friend class FixtureBase;
+	friend class ParameterizedTest;
+	// containers are added to the tree only when something is added into them
+	struct ErrorFrame {
+		TestError* error = nullptr;
+		SourceLocation location;
+		const char* message = "";
+		std::string message_str;
+	};
 	TestFuncType func;
-	std::stack<TestError*> error_stack;
+	ErrorArena error_arena;
+	std::vector<ErrorFrame> error_stack;
+	// instances of FixtureScope::Test fixtures, destroyed when the test ends
+	std::vector<std::pair<FixtureBase*, std::shared_ptr<void>>> fixture_instances;
+
+	void runInProcess();
+	void releaseFixtures();
+};
+
+class Benchmark : public Test {
+public:
+	using Duration = std::chrono::duration<double, std::nano>;
+	std::chrono::nanoseconds warmup_time = std::chrono::milliseconds(100);
+	std::chrono::nanoseconds sample_time = std::chrono::milliseconds(2);
+	std::chrono::nanoseconds max_time = std::chrono::seconds(5);
+	size_t sample_count = 50;
+	size_t bytes_per_iteration = 0;
+	size_t iterations_per_sample = 0;
+	std::vector<Duration> samples;
+	Duration min_time = Duration::zero();
+	Duration median_time = Duration::zero();
+	Duration p99_time = Duration::zero();
+
+	Benchmark(std::string name, std::vector<TestNode*> required, BenchmarkFuncType func);
+	bool keepRunning() {
+		if (remaining_iterations > 0) {
+			remaining_iterations--;
+			return true;
+		}
+		return nextBatch();
+	}
+	bool hasStats() const;
+	double getIterationsPerSecond() const;
+	double getBytesPerSecond() const;
+	std::string getStatsString() const;
+
+protected:
+	void writeResults(BinaryWriter& writer) const override;
+	bool readResults(BinaryReader& reader) override;
+
+private:
+	enum class Phase {
+		NotStarted,
+		Warmup,
+		Measure,
+		Done,
+	};
+	Phase phase = Phase::NotStarted;
+	size_t remaining_iterations = 0;
+	size_t batch_iterations = 0;
+	size_t warmup_iterations = 0;
+	std::chrono::steady_clock::time_point phase_start;
+	std::chrono::steady_clock::time_point batch_start;
+
+	void reset();
+	bool nextBatch();
+	void computeStats();
+};
+
+// One test running a case for every value of a range or generator. Values
+// are generated lazily in batches, which run on the scheduler's pool in
+// parallel mode. Passing cases leave nothing behind, failing ones are listed
+// with their value under a "N/M cases passed" summary.
+class ParameterizedTest : public Test {
+public:
+	class CaseRunner;
+	using BatchFuncType = std::function<void(CaseRunner& runner)>;
+	// returns the next batch of at most max_count cases, an empty function when there are none left
+	using BatchSourceType = std::function<BatchFuncType(size_t max_count)>;
+	size_t batch_size = 1024;
+	// failing cases after these are only counted
+	size_t max_listed_failures = 20;
+	size_t case_count = 0;
+	size_t passed_count = 0;
+
+	// open_source is called at the start of every run
+	ParameterizedTest(std::string name, std::vector<TestNode*> required, std::function<BatchSourceType()> open_source);
+	virtual std::string getCasesString() const;
+
+protected:
+	void writeResults(BinaryWriter& writer) const override;
+	bool readResults(BinaryReader& reader) override;
+
+private:
+	std::function<BatchSourceType()> open_source;
+	size_t failed_count = 0;
+	size_t listed_count = 0;
+	// failures claimed by CaseRunner::reserveListing() in this run, over all runners and waves
+	std::atomic<size_t> reserved_listings = 0;
+	TestError* summary_error = nullptr;
+
+	void runCases();
+	void mergeCases(CaseRunner& runner);
+};
+
+// Runs the cases of one batch at a time, the same Test is passed to all of
+// them and its errors are only copied out when a case fails
+class ParameterizedTest::CaseRunner {
+public:
+	explicit CaseRunner(ParameterizedTest& owner);
+	CaseRunner(const CaseRunner&) = delete;
+	CaseRunner& operator=(const CaseRunner&) = delete;
+
+	template<typename TFunc, typename TDescribe>
+	void runCase(size_t index, TFunc&& func, TDescribe&& describe) {
+		if (check(func)) {
+			passed_count++;
+		} else {
+			fail(index, describe);
+		}
+	}
+
+	// Runs func on the scratch test without counting it, its errors are kept until the next check
+	template<typename TFunc>
+	bool check(TFunc&& func) {
+		beginCase();
+		try {
+			func(scratch);
+		} catch (const std::exception& exc) {
+			addException(exc);
+		}
+		return scratch.result;
+	}
+
+	// Counts the last check as failed, describe is only called if the case is listed
+	template<typename TDescribe>
+	void fail(size_t index, TDescribe&& describe) {
+		if (listsNextFailure()) {
+			addFailure(index, describe());
+		}
+		failed_count++;
+	}
+
+	void pass() {
+		passed_count++;
+	}
+
+	// Counts the last check as failed without listing it
+	void countFailure() {
+		failed_count++;
+	}
+
+	// false once this runner has listed as many failures as the test shows
+	bool listsNextFailure() const {
+		return failed_count < max_listed_failures;
+	}
+
+	// Claims one of the failures the whole test lists, for work only listed failures
+	// need. False once they are taken by any runner, then it stays false for the run.
+	bool reserveListing();
+
+private:
+	friend class ParameterizedTest;
+	ParameterizedTest* owner = nullptr;
+	Test scratch;
+	ErrorArena failures;
+	size_t max_listed_failures = 0;
+	size_t passed_count = 0;
+	size_t failed_count = 0;
+
+	void beginCase();
+	void addException(const std::exception& exc);
+	void addFailure(size_t index, const std::string& value);
+	void reset();
+};
+
+// Parameterized test over random values of a generator from test::gen.
+// Every case is generated from its own seed, derived from the seed of the
+// test and the case index, so batches generate their values in parallel and
+// a failure reproduces with the same seed. A failing value is shrunk to a
+// minimal counterexample before it's reported, by default only the first one
+// found, which in parallel mode depends on scheduling.
+class PropertyTest : public ParameterizedTest {
+public:
+	using MakeBatchType = std::function<BatchFuncType(const PropertyTest& property, size_t first_index, size_t count)>;
+	size_t cases_per_run = 1000;
+	// 0 means TestModule::seed of the root module, or a seed derived from the path if that is 0 too
+	uint64_t seed = 0;
+	// accepted shrinking steps per failing case
+	size_t max_shrink_steps = 1000;
+
+	PropertyTest(std::string name, std::vector<TestNode*> required, MakeBatchType make_batch);
+	uint64_t getSeed() const;
+	std::string getCasesString() const override;
+
+private:
+	MakeBatchType make_batch;
+};
+
+// Test over the inputs stored in corpus_dir, every file is a case, so the
+// corpus works as a regression suite. It's fuzzed instead when the path of the
+// test is TestModule::fuzz_target, see fuzz().
+class FuzzTest : public ParameterizedTest {
+public:
+	std::filesystem::path corpus_dir;
+	size_t max_input_size = 4096;
+	// runs spent on making a failing input smaller
+	size_t max_minimize_runs = 2000;
+	// of the last fuzz() call
+	size_t fuzz_runs = 0;
+	size_t corpus_size = 0;
+	size_t new_inputs = 0;
+	size_t coverage_features = 0;
+
+	FuzzTest(std::string name, std::vector<TestNode*> required, std::filesystem::path corpus_dir, FuzzFuncType func);
+	// Runs mutations of the corpus inputs until max_runs or max_time, zero means no limit.
+	// Inputs that reach new SanitizerCoverage counters are added to the corpus. The first
+	// failing input is minimized, stored as crash-<hash> in the corpus and reported in the
+	// errors. Where fork() is available the loop runs in a child process, so crashes are
+	// caught as well.
+	bool fuzz(size_t max_runs, std::chrono::nanoseconds max_time);
+	std::string getFuzzStatsString() const;
+	// whether any code was built with -fsanitize-coverage=inline-8bit-counters or trace-pc
+	static bool hasCoverage();
+
+private:
+	struct FuzzState;
+	FuzzFuncType func;
+
+	std::vector<std::filesystem::path> listCorpus() const;
+	bool fuzzLoop(FuzzState& state, size_t max_runs, std::chrono::nanoseconds max_time, uint64_t seed);
+	// 0 if the input passes, 1 if it fails, 2 if it crashes with the reason in crash
+	int reproduce(const std::vector<uint8_t>& input, std::string& crash);
+	void minimize(std::vector<uint8_t>& input, int status);
+	std::filesystem::path saveInput(const std::string& prefix, const std::vector<uint8_t>& input) const;
+};
+
+// Test running its body on thread_count threads at once, many times, to
+// shake out races. Before every iteration the threads wait at a barrier, so
+// they start the body together. Runs until iterations or max_time, whichever
+// comes first, zero means no limit. Every thread reports into its own scratch
+// Test, failing iterations are copied to a per-thread buffer and merged into
+// the errors of the test in thread order when all threads are done.
+class StressTest : public Test {
+public:
+	// 0 means std::thread::hardware_concurrency(), at least 2
+	size_t thread_count = 0;
+	size_t iterations = 1000;
+	std::chrono::nanoseconds max_time = std::chrono::seconds(5);
+	// stop at the end of the first iteration where any thread failed
+	bool stop_on_failure = true;
+	// failing thread iterations after these are only counted
+	size_t max_listed_failures = 10;
+	// of the last run
+	size_t iteration_count = 0;
+	size_t failed_count = 0;
+	size_t used_thread_count = 0;
+
+	StressTest(std::string name, std::vector<TestNode*> required, StressFuncType func);
+	std::string getIterationsString() const;
+
+protected:
+	void writeResults(BinaryWriter& writer) const override;
+	bool readResults(BinaryReader& reader) override;
+
+private:
+	class Worker;
+	StressFuncType func;
+
+	void runThreads();
+};
+
+// Lines of a text file as an input range. The file is opened by begin(),
+// which throws if it can't be, and read while iterating.
+class FileLines {
+public:
+	class Iterator {
+	public:
+		using value_type = std::string;
+		using difference_type = std::ptrdiff_t;
+		Iterator() = default;
+		explicit Iterator(std::shared_ptr<std::istream> stream);
+		const std::string& operator*() const { return line; }
+		Iterator& operator++();
+		void operator++(int) { ++*this; }
+		bool operator==(std::default_sentinel_t) const { return !stream; }
+
+	private:
+		std::shared_ptr<std::istream> stream;
+		std::string line;
+	};
+
+	explicit FileLines(std::filesystem::path path);
+	Iterator begin() const;
+	std::default_sentinel_t end() const { return std::default_sentinel; }
+
+private:
+	std::filesystem::path path;
 };
 
 class ErrorContainer {
 public:
-	ErrorContainer(Test& test, const std::string& file, size_t line, const std::string& message = "");
+	ErrorContainer(Test& test, const SourceLocation& location, const char* message = "");
+	ErrorContainer(Test& test, const SourceLocation& location, std::string message);
 	~ErrorContainer();
 
 private:
@@ -149,15 +698,141 @@ private:
 	void close();
 };
 
+// Results of a run, shared by the whole tree and owned by the root module.
+// Modules append their tests in walk order, so every subtree owns one
+// contiguous range of each list.
+class ResultStore {
+public:
+	enum Status {
+		Passed,
+		Cancelled,
+		Failed,
+		Regressed,
+		StatusCount,
+	};
+	struct Range {
+		size_t begin = 0;
+		size_t end = 0;
+	};
+	std::vector<Test*> tests[StatusCount];
+	std::vector<TestModule*> empty_modules;
+	void clear();
+};
+
+enum class FixtureScope : uint8_t {
+	// every test gets its own instance, destroyed when the test ends
+	Test,
+	// one instance, destroyed after its last selected user or at the end of the owning module
+	Module,
+	// one instance, destroyed after its last selected user or at the end of the run
+	Run,
+};
+
+// State shared by tests, like a loaded dataset or a temporary database. The
+// instance is built by the first get() and destroyed by its destructor. Shared
+// instances are counted against the selected tests that list the fixture in
+// TestNode::fixtures, and are destroyed once all of them are done. A test that
+// uses it without listing it keeps it alive until the end of the scope. In
+// isolated mode every worker process builds its own instances.
+class FixtureBase {
+public:
+	std::string name;
+	FixtureScope scope;
+
+	FixtureBase(std::string name, FixtureScope scope);
+	virtual ~FixtureBase() = default;
+	bool isBuilt() const;
+	size_t getBuildCount() const;
+
+protected:
+	// blocks while another thread builds the instance
+	void* acquire(Test& test);
+
+private:
+	friend class Test;
+	friend class TestModule;
+	mutable std::mutex mutex;
+	std::shared_ptr<void> instance;
+	size_t remaining_users = 0;
+	size_t build_count = 0;
+	bool pinned = false;
+
+	virtual std::shared_ptr<void> build() = 0;
+	void finishUser();
+	void tearDown();
+};
+
+template<typename T>
+class Fixture : public FixtureBase {
+public:
+	Fixture(std::string name, FixtureScope scope, std::function<std::unique_ptr<T>()> factory)
+	: FixtureBase(std::move(name), scope) {
+		this->factory = std::move(factory);
+	}
+
+	T& get(Test& test) {
+		return *static_cast<T*>(acquire(test));
+	}
+
+private:
+	std::function<std::unique_ptr<T>()> factory;
+
+	std::shared_ptr<void> build() override {
+		return std::shared_ptr<T>(factory());
+	}
+};
+
 class TestModule : public TestNode {
 public:
 
-	std::vector<std::unique_ptr<TestNode>> children;
-	std::vector<std::string> passed_list;
-	std::vector<std::string> cancelled_list;
-	std::vector<std::string> failed_list;
-	std::vector<std::string> empty_module_list;
+	// in order of addition, owned by the module
+	std::vector<TestNode*> children;
 	size_t max_test_name = 0;
+	size_t slowest_count = 5;
+	bool parallel = false;
+	size_t thread_count = 0;
+	bool isolated = false;
+	bool hardware_counters = false;
+	size_t max_error_entries = 1000;
+	// mismatching elements listed by span comparisons
+	size_t max_span_mismatches = 10;
+	std::filesystem::path baseline_file;
+	bool update_baseline = false;
+	double regression_threshold = 0.1;
+	double regression_alpha = 0.05;
+	size_t baseline_history = 20;
+	// results of earlier runs, tests with unchanged fingerprints are not run again
+	std::filesystem::path cache_file;
+	// without it only version strings and input files invalidate cached results
+	bool cache_binary_fingerprint = true;
+	// tests that failed in the last cached run go first
+	bool failed_first = false;
+	// only tests of this shard are run, see TestSelection::applyShard
+	size_t shard_index = 0;
+	size_t shard_count = 1;
+	// durations for balancing shards, in the baseline file format, baseline_file is used if empty
+	std::filesystem::path shard_timing_file;
+	// seed of property tests that don't set their own, 0 derives one from the path of each test
+	uint64_t seed = 0;
+	// path of a FuzzTest that run() fuzzes instead of running the tree
+	std::string fuzz_target;
+	// limits of fuzzing, zero means no limit
+	size_t fuzz_runs = 0;
+	std::chrono::nanoseconds fuzz_time = std::chrono::seconds(60);
+	// tests of T_TEST and modules of T_MODULE are added by run(), only the ones the selection can match
+	bool add_registered = false;
+	// run() only logs the paths of the selected tests
+	bool list_only = false;
+	// mismatching long strings and ranges are reported as diffs within these limits
+	DiffLimits diff_limits;
+	// golden files of T_SNAPSHOT, relative to the working directory
+	std::filesystem::path snapshot_dir = "snapshots";
+	// T_SNAPSHOT rewrites differing and missing golden files instead of failing
+	bool update_snapshots = false;
+	// only reporters of the root module receive events
+	std::vector<std::unique_ptr<Reporter>> reporters;
+	// only the selection of the root module is used
+	TestSelection selection;
 	std::function<void(void)> OnBeforeRun = []() { };
 	std::function<void(void)> OnAfterRun = []() { };
 	std::function<void(void)> OnBeforeRunTest = []() { };
@@ -166,17 +841,57 @@ public:
 	TestModule(const std::string& name, TestModule* parent, const std::vector<TestNode*>& required_nodes = { });
 	Test* addTest(const std::string& name, TestFuncType func);
 	Test* addTest(const std::string& name, const std::vector<TestNode*>& required, TestFuncType func);
+	Benchmark* addBenchmark(const std::string& name, BenchmarkFuncType func);
+	Benchmark* addBenchmark(const std::string& name, const std::vector<TestNode*>& required, BenchmarkFuncType func);
+	FuzzTest* addFuzzTest(const std::string& name, const std::filesystem::path& corpus_dir, FuzzFuncType func);
+	FuzzTest* addFuzzTest(
+		const std::string& name, const std::vector<TestNode*>& required, const std::filesystem::path& corpus_dir, FuzzFuncType func
+	);
+	// func is called as func(test, thread_index) on every thread in every iteration
+	StressTest* addStressTest(const std::string& name, size_t thread_count, size_t iterations, StressFuncType func);
+	StressTest* addStressTest(
+		const std::string& name, const std::vector<TestNode*>& required, size_t thread_count, size_t iterations, StressFuncType func
+	);
+	// source is an input range or a generator returning std::optional, it's copied and iterated
+	// again on every run, lvalue containers are referenced. func is called as func(test, value).
+	template<typename TSource, typename TFunc>
+	ParameterizedTest* addParameterizedTest(const std::string& name, TSource&& source, TFunc func);
+	template<typename TSource, typename TFunc>
+	ParameterizedTest* addParameterizedTest(
+		const std::string& name, const std::vector<TestNode*>& required, TSource&& source, TFunc func
+	);
+	// generator is one of test::gen, func is called as func(test, value)
+	template<typename TGen, typename TFunc>
+	PropertyTest* addPropertyTest(const std::string& name, TGen generator, TFunc func);
+	template<typename TGen, typename TFunc>
+	PropertyTest* addPropertyTest(const std::string& name, const std::vector<TestNode*>& required, TGen generator, TFunc func);
 	TestModule* addModule(const std::string& name, const std::vector<TestNode*>& required = { });
 	template<typename T>
 	requires std::derived_from<T, TestModule>
 	T* addModule(const std::string& name, const std::vector<TestNode*>& required = { });
+	// the fixture is owned by the module, tests that use it are listed in TestNode::fixtures
+	template<typename T>
+	Fixture<T>* addFixture(const std::string& name, FixtureScope scope, std::function<std::unique_ptr<T>()> factory);
+	template<typename T, typename... TArgs>
+	requires std::derived_from<T, Reporter>
+	T* addReporter(TArgs&&... args);
 	TestModule* getRoot();
+	const TestModule* getRoot() const;
+	// results of the last run of this subtree
+	size_t getResultCount(ResultStore::Status status) const;
+	std::span<Test* const> getResults(ResultStore::Status status) const;
+	std::span<TestModule* const> getEmptyModules() const;
 	std::vector<TestNode*> getChildren() const;
 	std::vector<Test*> getChildTests() const;
 	std::vector<TestModule*> getChildModules() const;
 	std::vector<Test*> getAllTests() const;
 	bool run() override;
 	void printSummary();
+	// --filter, --exclude, --filter-regex, --exclude-regex, --tag, --exclude-tag, --jobs, --isolate,
+	// --cache, --failed-first, --shard-index, --shard-count, --shard-timings, --junit-report,
+	// --jsonl-report, --seed, --fuzz, --fuzz-runs, --fuzz-time in seconds, --timeout in seconds and
+	// --list, returns false on unknown or invalid arguments
+	bool parseArguments(int argc, const char* const argv[]);
 
 protected:
 
@@ -184,24 +899,69 @@ protected:
 	virtual void afterRunModule();
 
 private:
+	friend class Test;
+	friend class ParameterizedTest;
+	friend class Scheduler;
+	// plain tests are packed together, everything else is allocated separately
+	NodeStorage<Test> test_storage;
+	std::vector<std::unique_ptr<TestNode>> owned_nodes;
+	IsolationPool* isolation_pool = nullptr;
+	Watchdog* watchdog = nullptr;
+	Baseline* baseline = nullptr;
+	ResultCache* result_cache = nullptr;
+	ResultStore result_store;
+	ResultStore::Range result_ranges[ResultStore::StatusCount];
+	ResultStore::Range empty_module_range;
+	// modules with onModuleStart reported and onModuleEnd not yet, outermost first
+	std::vector<TestModule*> reported_modules;
+	const Test* reported_test = nullptr;
+	// by RegisteredNode::index
+	std::vector<bool> added_registered;
+	std::vector<std::unique_ptr<FixtureBase>> owned_fixtures;
+
+	bool runModule();
+	void addRegisteredNodes();
+	TestModule* getOrAddModule(std::string_view path);
+	void countFixtureUsers(const std::vector<Test*>& all_tests);
+	// Module scoped fixtures of this module, with run_end everything in the subtree
+	void tearDownFixtures(bool run_end);
+	bool runFuzzTarget(const std::vector<Test*>& all_tests);
+	void collectTests(std::vector<Test*>& result) const;
+	void resetResults();
+	void beginResults();
+	void endResults();
+	void printSlowest();
+	void printBenchmarks();
+	void printCounters();
+	void printAllocations();
+	bool checkBaseline(Test* test);
+	void updateBaseline();
+	void applyResultCache(const std::vector<Test*>& all_tests);
+	void updateResultCache(const std::vector<Test*>& all_tests);
+	void moveFailedFirst(const std::vector<Test*>& failed_tests);
+	void reportTestStart(Test* test);
+	void reportTestEnd(Test* test);
+	// report is a finished copy of test, which is still running and can't be stopped
+	[[noreturn]] void exitAfterTimeout(const Test& test, Test& report);
+
 	// Deleted - converted to free functions
-	friend void testMessage(Test& test, const std::string& file, size_t line, const std::string& message);
-	friend bool testCheck(Test& test, const std::string& file, size_t line, bool value, const std::string& value_message);
-	friend bool testCheck(Test& test, const std::string& file, size_t line, bool value, const std::string& value_message, const std::string message);
+	friend void testMessage(Test& test, const SourceLocation& location, std::string_view message);
+	friend bool testCheck(Test& test, const SourceLocation& location, bool value, const char* value_message);
+	friend bool testCheck(Test& test, const SourceLocation& location, bool value, const char* value_message, std::string_view message);
 	template<typename T1, typename T2, typename TStr>
-	friend bool testCompare(Test& test, const std::string& file, size_t line, const std::string& name, T1 actual, T2 expected, TStr to_str);
+	friend bool testCompare(Test& test, const SourceLocation& location, const char* name, const T1& actual, const T2& expected, TStr to_str);
 	template<typename T1, typename T2, typename TStr, typename TCmp>
-	friend bool testCompare(Test& test, const std::string& file, size_t line, const std::string& name, T1 actual, T2 expected, TStr to_str, TCmp cmp);
+	friend bool testCompare(Test& test, const SourceLocation& location, const char* name, const T1& actual, const T2& expected, TStr to_str, TCmp cmp);
 	template<typename T>
-	friend bool testApproxCompare(Test& test, const std::string& file, size_t line, const std::string& name, T actual, T expected, T epsilon);
+	friend bool testApproxCompare(Test& test, const SourceLocation& location, const char* name, T actual, T expected, T epsilon);
 	template<typename T>
-	friend bool testVec2Compare(Test& test, const std::string& file, size_t line, const std::string& name, T actual, T expected);
+	friend bool testVec2Compare(Test& test, const SourceLocation& location, const char* name, const T& actual, const T& expected);
 	template<typename T>
-	friend bool testVec2ApproxCompare(Test& test, const std::string& file, size_t line, const std::string& name, T actual, T expected, double epsilon);
+	friend bool testVec2ApproxCompare(Test& test, const SourceLocation& location, const char* name, const T& actual, const T& expected, double epsilon);
 	template<typename T, typename TEps>
 	friend bool equals(T left, T right, TEps epsilon);
 	template<typename T1, typename T2, typename TStr>
-	friend void compareFail(Test& test, const std::string& file, size_t line, const std::string& name, T1 actual, T2 expected, TStr to_str);
+	friend void compareFail(Test& test, const SourceLocation& location, const char* name, const T1& actual, const T2& expected, TStr to_str);
 
 };
 
@@ -210,87 +970,573 @@ requires std::derived_from<T, TestModule>
 T* TestModule::addModule(const std::string& name, const std::vector<TestNode*>& required) {
 	std::unique_ptr<T> uptr = std::make_unique<T>(name, this, required);
 	T* ptr = uptr.get();
-	children.push_back(std::move(uptr));
+	children.push_back(ptr);
+	owned_nodes.push_back(std::move(uptr));
+	getRoot()->selection.invalidateIndex();
+	return ptr;
+}
+
+template<typename T>
+Fixture<T>* TestModule::addFixture(const std::string& name, FixtureScope scope, std::function<std::unique_ptr<T>()> factory) {
+	std::unique_ptr<Fixture<T>> uptr = std::make_unique<Fixture<T>>(name, scope, std::move(factory));
+	Fixture<T>* ptr = uptr.get();
+	owned_fixtures.push_back(std::move(uptr));
 	return ptr;
 }
 
+// Entry of T_TEST or T_MODULE. The constructor only links it into a list
+// before main(), the nodes are created later by TestModule::run(). Entries
+// in a static library are dropped by the linker unless their object file
+// is referenced.
+struct RegisteredNode {
+	using AddModuleFuncType = TestModule* (*)(TestModule& parent, const std::string& name);
+	using TestFuncPtr = void (*)(Test& test);
+	// modules separated by '/', the last segment is the name of the node
+	const char* path;
+	AddModuleFuncType add_module = nullptr;
+	TestFuncPtr test_func = nullptr;
+	size_t index = 0;
+	RegisteredNode* next = nullptr;
+
+	RegisteredNode(const char* path, TestFuncPtr test_func);
+	RegisteredNode(const char* path, AddModuleFuncType add_module);
+	// in registration order, which is definition order within a file
+	static RegisteredNode* getFirst();
+	static size_t getCount();
+
+private:
+	void link();
+};
+
+template<typename T>
+requires std::derived_from<T, TestModule>
+TestModule* addRegisteredModule(TestModule& parent, const std::string& name) {
+	return parent.addModule<T>(name);
+}
+
+inline Test* TestNode::asTest() {
+	return kind != NodeKind::Module ? static_cast<Test*>(this) : nullptr;
+}
+
+inline const Test* TestNode::asTest() const {
+	return kind != NodeKind::Module ? static_cast<const Test*>(this) : nullptr;
+}
+
+inline Benchmark* TestNode::asBenchmark() {
+	return kind == NodeKind::Benchmark ? static_cast<Benchmark*>(this) : nullptr;
+}
+
+inline const Benchmark* TestNode::asBenchmark() const {
+	return kind == NodeKind::Benchmark ? static_cast<const Benchmark*>(this) : nullptr;
+}
+
+inline ParameterizedTest* TestNode::asParameterized() {
+	return kind == NodeKind::Parameterized || kind == NodeKind::Fuzz ? static_cast<ParameterizedTest*>(this) : nullptr;
+}
+
+inline const ParameterizedTest* TestNode::asParameterized() const {
+	return kind == NodeKind::Parameterized || kind == NodeKind::Fuzz ? static_cast<const ParameterizedTest*>(this) : nullptr;
+}
+
+inline FuzzTest* TestNode::asFuzz() {
+	return kind == NodeKind::Fuzz ? static_cast<FuzzTest*>(this) : nullptr;
+}
+
+inline const FuzzTest* TestNode::asFuzz() const {
+	return kind == NodeKind::Fuzz ? static_cast<const FuzzTest*>(this) : nullptr;
+}
+
+inline StressTest* TestNode::asStress() {
+	return kind == NodeKind::Stress ? static_cast<StressTest*>(this) : nullptr;
+}
+
+inline const StressTest* TestNode::asStress() const {
+	return kind == NodeKind::Stress ? static_cast<const StressTest*>(this) : nullptr;
+}
+
+inline TestModule* TestNode::asModule() {
+	return kind == NodeKind::Module ? static_cast<TestModule*>(this) : nullptr;
+}
+
+inline const TestModule* TestNode::asModule() const {
+	return kind == NodeKind::Module ? static_cast<const TestModule*>(this) : nullptr;
+}
+
+// Label of a parameter value in the list of failing cases, empty if it has no string form
+template<typename T>
+std::string parameterToString(const T& value) {
+	if constexpr (std::convertible_to<const T&, std::string_view>) {
+		return "\"" + std::string(std::string_view(value)) + "\"";
+	} else if constexpr (std::same_as<T, bool>) {
+		return value ? "true" : "false";
+	} else if constexpr (std::is_arithmetic_v<T>) {
+		return std::to_string(value);
+	} else if constexpr (requires(std::ostream& stream) { stream << value; }) {
+		std::ostringstream stream;
+		stream << value;
+		return stream.str();
+	} else if constexpr (requires { value.x; value.y; }) {
+		return "(" + parameterToString(value.x) + " " + parameterToString(value.y) + ")";
+	} else if constexpr (std::ranges::input_range<const T>) {
+		std::string result = "[";
+		for (const auto& element : value) {
+			result += (result.size() > 1 ? ", " : "") + parameterToString(element);
+		}
+		return result + "]";
+	} else if constexpr (requires { std::tuple_size<T>::value; }) {
+		std::string result = "(";
+		std::apply([&](const auto&... elements) {
+			size_t element_index = 0;
+			((result += (element_index++ > 0 ? ", " : "") + parameterToString(elements)), ...);
+		}, value);
+		return result + ")";
+	} else {
+		return "";
+	}
+}
+
+// Returns a function that starts a new pass over the values of source for
+// every call, each pass is a generator returning std::optional
+template<typename TSource>
+auto parameterValues(TSource&& source) {
+	if constexpr (std::ranges::input_range<TSource>) {
+		using TView = std::views::all_t<TSource>;
+		using T = std::ranges::range_value_t<TView>;
+		std::shared_ptr<TView> view = std::make_shared<TView>(std::views::all(std::forward<TSource>(source)));
+		return [view]() {
+			return [view, it = std::optional<std::ranges::iterator_t<TView>>()]() mutable -> std::optional<T> {
+				if (!it) {
+					it.emplace(std::ranges::begin(*view));
+				}
+				if (*it == std::ranges::end(*view)) {
+					return std::nullopt;
+				}
+				std::optional<T> value(std::in_place, **it);
+				++*it;
+				return value;
+			};
+		};
+	} else {
+		static_assert(std::invocable<std::decay_t<TSource>&>, "Parameters come from an input range or a generator returning std::optional");
+		return [generator = std::decay_t<TSource>(std::forward<TSource>(source))]() {
+			return generator;
+		};
+	}
+}
+
+template<typename TSource, typename TFunc>
+ParameterizedTest* TestModule::addParameterizedTest(const std::string& name, TSource&& source, TFunc func) {
+	return addParameterizedTest(name, { }, std::forward<TSource>(source), std::move(func));
+}
+
+template<typename TSource, typename TFunc>
+ParameterizedTest* TestModule::addParameterizedTest(
+	const std::string& name, const std::vector<TestNode*>& required, TSource&& source, TFunc func
+) {
+	auto open_values = parameterValues(std::forward<TSource>(source));
+	using TValues = std::invoke_result_t<decltype(open_values)&>;
+	using T = typename std::invoke_result_t<TValues&>::value_type;
+	static_assert(std::invocable<const TFunc&, Test&, const T&>, "Parameterized test functions are called as func(test, value)");
+	std::shared_ptr<const TFunc> shared_func = std::make_shared<const TFunc>(std::move(func));
+	auto open_source = [open_values, shared_func]() -> ParameterizedTest::BatchSourceType {
+		return [next_value = open_values(), shared_func, next_index = size_t(0)](size_t max_count) mutable {
+			std::vector<T> values;
+			while (values.size() < max_count) {
+				std::optional<T> value = next_value();
+				if (!value) {
+					break;
+				}
+				values.push_back(std::move(*value));
+			}
+			if (values.empty()) {
+				return ParameterizedTest::BatchFuncType();
+			}
+			size_t first_index = next_index;
+			next_index += values.size();
+			return ParameterizedTest::BatchFuncType([values = std::move(values), first_index, shared_func](ParameterizedTest::CaseRunner& runner) {
+				for (size_t i = 0; i < values.size(); i++) {
+					const T& value = values[i];
+					runner.runCase(
+						first_index + i,
+						[&](Test& test) { (*shared_func)(test, value); },
+						[&]() { return parameterToString(value); }
+					);
+				}
+			});
+		};
+	};
+	std::unique_ptr<ParameterizedTest> uptr = std::make_unique<ParameterizedTest>(name, required, std::move(open_source));
+	ParameterizedTest* ptr = uptr.get();
+	ptr->parent = this;
+	children.push_back(ptr);
+	owned_nodes.push_back(std::move(uptr));
+	getRoot()->selection.invalidateIndex();
+	return ptr;
+}
+
+template<typename TGen, typename TFunc>
+PropertyTest* TestModule::addPropertyTest(const std::string& name, TGen generator, TFunc func) {
+	return addPropertyTest(name, { }, std::move(generator), std::move(func));
+}
+
+template<typename TGen, typename TFunc>
+PropertyTest* TestModule::addPropertyTest(const std::string& name, const std::vector<TestNode*>& required, TGen generator, TFunc func) {
+	using T = typename TGen::value_type;
+	static_assert(std::invocable<const TFunc&, Test&, const T&>, "Property test functions are called as func(test, value)");
+	auto make_batch = [generator = std::move(generator), func = std::move(func)](
+		const PropertyTest& property, size_t first_index, size_t count
+	) {
+		uint64_t seed = property.getSeed();
+		size_t max_shrink_steps = property.max_shrink_steps;
+		// the batch refers to the generator and func of make_batch, which lives as long as the test
+		return ParameterizedTest::BatchFuncType([&generator, &func, seed, max_shrink_steps, first_index, count](ParameterizedTest::CaseRunner& runner) {
+			for (size_t index = first_index; index < first_index + count; index++) {
+				Random random(Random::caseSeed(seed, index));
+				T value = generator.generate(random);
+				auto check = [&](const T& candidate) {
+					return runner.check([&](Test& test) { func(test, candidate); });
+				};
+				if (check(value)) {
+					runner.pass();
+					continue;
+				}
+				// shrinking is the expensive part, only failures that are listed get it
+				if (!runner.reserveListing()) {
+					runner.countFailure();
+					continue;
+				}
+				std::string original = parameterToString(value);
+				size_t steps = 0;
+				bool shrunk = true;
+				while (shrunk && steps < max_shrink_steps) {
+					shrunk = false;
+					for (T& candidate : generator.shrink(value)) {
+						if (!check(candidate)) {
+							value = std::move(candidate);
+							steps++;
+							shrunk = true;
+							break;
+						}
+					}
+				}
+				// the errors of the last check belong to the counterexample, unless it passes on its own now
+				bool reproduced = steps == 0 || !check(value);
+				runner.fail(index, [&]() {
+					std::string result = "counterexample " + parameterToString(value);
+					if (steps > 0) {
+						result += ", shrunk from " + original + " in " + std::to_string(steps) + " steps";
+					}
+					if (!reproduced) {
+						result += ", passed when run again";
+					}
+					return result;
+				});
+			}
+		});
+	};
+	std::unique_ptr<PropertyTest> uptr = std::make_unique<PropertyTest>(name, required, std::move(make_batch));
+	PropertyTest* ptr = uptr.get();
+	ptr->parent = this;
+	children.push_back(ptr);
+	owned_nodes.push_back(std::move(uptr));
+	getRoot()->selection.invalidateIndex();
+	return ptr;
+}
+
+template<typename T, typename... TArgs>
+requires std::derived_from<T, Reporter>
+T* TestModule::addReporter(TArgs&&... args) {
+	std::unique_ptr<T> uptr = std::make_unique<T>(std::forward<TArgs>(args)...);
+	T* ptr = uptr.get();
+	reporters.push_back(std::move(uptr));
+	return ptr;
+}
+
+inline bool testCheck(Test& test, const SourceLocation& location, bool value, const char* value_message) {
+	if (!value) {
+		checkFail(test, location, value_message, "Failed condition");
+	}
+	return value;
+}
+
+inline bool testCheck(Test& test, const SourceLocation& location, bool value, const char* value_message, std::string_view message) {
+	if (!value) {
+		checkFail(test, location, value_message, message);
+	}
+	return value;
+}
+
 template<typename T1, typename T2>
-bool testCompare(Test& test, const std::string& file, size_t line, const std::string& name, T1 actual, T2 expected) {
+bool testCompare(Test& test, const SourceLocation& location, const char* name, const T1& actual, const T2& expected) {
 	if constexpr (std::convertible_to<T1, std::string> || std::same_as<T1, const char*>) {
-		auto func = [](const T1& val) { return val; };
-		return testCompare(test, file, line, name, actual, expected, func);
+		auto func = [](const T1& val) { return std::string(val); };
+		return testCompare(test, location, name, actual, expected, func);
+	} else if constexpr (std::ranges::input_range<const T1>) {
+		auto func = [](const T1& val) { return parameterToString(val); };
+		return testCompare(test, location, name, actual, expected, func);
 	} else {
 		auto func = [](const T1& val) { return std::to_string(val); };
-		return testCompare(test, file, line, name, actual, expected, func);
+		return testCompare(test, location, name, actual, expected, func);
 	}
 }
 
 template<typename T1, typename T2, typename TStr>
-bool testCompare(Test& test, const std::string& file, size_t line, const std::string& name, T1 actual, T2 expected, TStr to_str) {
+bool testCompare(Test& test, const SourceLocation& location, const char* name, const T1& actual, const T2& expected, TStr to_str) {
 	if (actual != expected) {
-		compareFail(test, file, line, name, actual, expected, to_str);
+		compareFail(test, location, name, actual, expected, to_str);
 		return false;
 	}
 	return true;
 }
 
 template<typename T1, typename T2, typename TStr, typename TCmp>
-bool testCompare(Test& test, const std::string& file, size_t line, const std::string& name, T1 actual, T2 expected, TStr to_str, TCmp cmp) {
+bool testCompare(Test& test, const SourceLocation& location, const char* name, const T1& actual, const T2& expected, TStr to_str, TCmp cmp) {
 	if (!cmp(actual, expected)) {
-		compareFail(test, file, line, name, actual, expected, to_str);
+		compareFail(test, location, name, actual, expected, to_str);
 		return false;
 	}
 	return true;
 }
 
 template<typename T>
-bool testApproxCompare(Test& test, const std::string& file, size_t line, const std::string& name, T actual, T expected, T epsilon) {
+bool testApproxCompare(Test& test, const SourceLocation& location, const char* name, T actual, T expected, T epsilon) {
 	if (!equals(actual, expected, epsilon)) {
 		auto func = [](const T& val) { return std::to_string(val); };
-		compareFail(test, file, line, name, actual, expected, func);
+		compareFail(test, location, name, actual, expected, func);
 		return false;
 	}
 	return true;
 }
 
 template<typename T>
-bool testVec2Compare(Test& test, const std::string& file, size_t line, const std::string& name, T actual, T expected) {
+bool testVec2Compare(Test& test, const SourceLocation& location, const char* name, const T& actual, const T& expected) {
 	if (actual.x != expected.x || actual.y != expected.y) {
 		auto to_str = [](const T& vec) {
 			return "(" + std::to_string(vec.x) + " " + std::to_string(vec.y) + ")";
 		};
-		compareFail(test, file, line, name, actual, expected, to_str);
+		compareFail(test, location, name, actual, expected, to_str);
 		return false;
 	}
 	return true;
 }
 
 template<typename T>
-bool testVec2ApproxCompare(Test& test, const std::string& file, size_t line, const std::string& name, T actual, T expected, double epsilon) {
+bool testVec2ApproxCompare(Test& test, const SourceLocation& location, const char* name, const T& actual, const T& expected, double epsilon) {
 	if (!equals(actual.x, expected.x, epsilon) || !equals(actual.y, expected.y, epsilon)) {
 		auto to_str = [](const T& vec) {
 			return "(" + std::to_string(vec.x) + " " + std::to_string(vec.y) + ")";
 		};
-		compareFail(test, file, line, name, actual, expected, to_str);
+		compareFail(test, location, name, actual, expected, to_str);
 		return false;
 	}
 	return true;
 }
 
+template<typename T>
+std::string spanValueToString(const T& value) {
+	if constexpr (std::same_as<T, float> || std::same_as<T, double>) {
+		return formatSpanValue(value);
+	} else if constexpr (std::floating_point<T>) {
+		return formatSpanValue(static_cast<double>(value));
+	} else {
+		return std::to_string(value);
+	}
+}
+
+// Shared part of the span comparisons, find_mismatch returns the next mismatching index
+template<typename T, typename TFind, typename TError>
+bool spanCompare(
+	Test& test, const SourceLocation& location, const char* name, std::span<const T> actual, std::span<const T> expected,
+	TFind find_mismatch, TError get_error, const char* error_unit
+) {
+	static_assert(std::is_arithmetic_v<T>, "Span comparisons support arithmetic element types");
+	size_t size = std::min(actual.size(), expected.size());
+	size_t index = find_mismatch(actual.data(), expected.data(), 0, size);
+	if (index == size && actual.size() == expected.size()) {
+		return true;
+	}
+	SpanCompareReport report;
+	report.actual_size = actual.size();
+	report.expected_size = expected.size();
+	report.error_unit = error_unit;
+	size_t max_mismatches = test.parent ? test.parent->getRoot()->max_span_mismatches : 10;
+	while (index < size) {
+		report.addError(index, get_error(actual[index], expected[index]));
+		if (report.mismatches.size() < max_mismatches) {
+			report.mismatches.push_back({ index, spanValueToString(actual[index]), spanValueToString(expected[index]) });
+		}
+		index = find_mismatch(actual.data(), expected.data(), index + 1, size);
+	}
+	spanCompareFail(test, location, name, report);
+	return false;
+}
+
+template<typename TActual, typename TExpected>
+bool testSpanCompare(Test& test, const SourceLocation& location, const char* name, const TActual& actual, const TExpected& expected) {
+	using T = std::ranges::range_value_t<TActual>;
+	static_assert(std::same_as<T, std::ranges::range_value_t<TExpected>>, "Span element types must match");
+	auto find_mismatch = [](const T* actual, const T* expected, size_t begin, size_t size) {
+		if constexpr (std::same_as<T, float> || std::same_as<T, double>) {
+			return findMismatch(actual, expected, begin, size);
+		} else if constexpr (std::integral<T>) {
+			return findIntegralMismatch(actual, expected, begin, size);
+		} else {
+			for (size_t i = begin; i < size; i++) {
+				if (!(actual[i] == expected[i])) {
+					return i;
+				}
+			}
+			return size;
+		}
+	};
+	auto get_error = [](const T& actual, const T& expected) {
+		return std::abs(static_cast<double>(actual) - static_cast<double>(expected));
+	};
+	return spanCompare<T>(
+		test, location, name, std::span<const T>(actual), std::span<const T>(expected), find_mismatch, get_error, ""
+	);
+}
+
+template<typename TActual, typename TExpected>
+bool testSpanApproxCompare(
+	Test& test, const SourceLocation& location, const char* name, const TActual& actual, const TExpected& expected, double epsilon
+) {
+	using T = std::ranges::range_value_t<TActual>;
+	static_assert(std::same_as<T, std::ranges::range_value_t<TExpected>>, "Span element types must match");
+	static_assert(std::floating_point<T>, "Approximate span comparison needs floating point elements");
+	auto find_mismatch = [epsilon](const T* actual, const T* expected, size_t begin, size_t size) {
+		if constexpr (std::same_as<T, float> || std::same_as<T, double>) {
+			return findApproxMismatch(actual, expected, begin, size, static_cast<T>(epsilon));
+		} else {
+			for (size_t i = begin; i < size; i++) {
+				if (!equals(actual[i], expected[i], static_cast<T>(epsilon))) {
+					return i;
+				}
+			}
+			return size;
+		}
+	};
+	auto get_error = [](const T& actual, const T& expected) {
+		return static_cast<double>(std::abs(actual - expected));
+	};
+	return spanCompare<T>(
+		test, location, name, std::span<const T>(actual), std::span<const T>(expected), find_mismatch, get_error, ""
+	);
+}
+
+template<typename TActual, typename TExpected>
+bool testSpanUlpCompare(
+	Test& test, const SourceLocation& location, const char* name, const TActual& actual, const TExpected& expected, uint64_t max_ulps
+) {
+	using T = std::ranges::range_value_t<TActual>;
+	static_assert(std::same_as<T, std::ranges::range_value_t<TExpected>>, "Span element types must match");
+	static_assert(std::same_as<T, float> || std::same_as<T, double>, "ULP span comparison needs float or double elements");
+	auto find_mismatch = [max_ulps](const T* actual, const T* expected, size_t begin, size_t size) {
+		return findUlpMismatch(actual, expected, begin, size, max_ulps);
+	};
+	auto get_error = [](const T& actual, const T& expected) {
+		return static_cast<double>(ulpDistance(actual, expected));
+	};
+	return spanCompare<T>(
+		test, location, name, std::span<const T>(actual), std::span<const T>(expected), find_mismatch, get_error, " ulp"
+	);
+}
+
+// Strings and contiguous ranges of trivially copyable elements are compared by their bytes
+template<typename T>
+bool testSnapshot(Test& test, const SourceLocation& location, std::string_view name, const T& data) {
+	if constexpr (std::convertible_to<const T&, std::string_view>) {
+		std::string_view str = data;
+		return testSnapshotBytes(test, location, name, str.data(), str.size());
+	} else {
+		static_assert(
+			std::ranges::contiguous_range<const T> && std::ranges::sized_range<const T>,
+			"Snapshots need a string or a contiguous range"
+		);
+		using TElement = std::ranges::range_value_t<const T>;
+		static_assert(std::is_trivially_copyable_v<TElement>, "Snapshot elements must be trivially copyable");
+		return testSnapshotBytes(test, location, name, std::ranges::data(data), std::ranges::size(data) * sizeof(TElement));
+	}
+}
+
+#ifdef _MSC_VER
+void useCharPointer(const volatile char* ptr);
+#endif
+
+// Keeps the compiler from optimizing away a value computed in a benchmark
+template<typename T>
+inline void doNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+	asm volatile("" : : "r,m"(value) : "memory");
+#else
+	useCharPointer(&reinterpret_cast<const volatile char&>(value));
+	_ReadWriteBarrier();
+#endif
+}
+
+template<typename T>
+inline void doNotOptimize(T& value) {
+#if defined(__clang__)
+	asm volatile("" : "+r,m"(value) : : "memory");
+#elif defined(__GNUC__)
+	asm volatile("" : "+m,r"(value) : : "memory");
+#else
+	useCharPointer(&reinterpret_cast<const volatile char&>(value));
+	_ReadWriteBarrier();
+#endif
+}
+
+// Forces all pending memory writes to be treated as observable
+inline void clobberMemory() {
+#if defined(__GNUC__) || defined(__clang__)
+	asm volatile("" : : : "memory");
+#else
+	_ReadWriteBarrier();
+#endif
+}
+
 template<typename T, typename TEps>
 bool equals(T left, T right, TEps epsilon) {
 	return abs(left - right) < epsilon;
 }
 
+template<typename T1, typename T2>
+concept DiffableRanges = std::ranges::random_access_range<T1> && std::ranges::sized_range<T1>
+	&& std::ranges::random_access_range<T2> && std::ranges::sized_range<T2>
+	&& std::equality_comparable_with<std::ranges::range_reference_t<T1>, std::ranges::range_reference_t<T2>>;
+
 template<typename T1, typename T2, typename TStr>
-void compareFail(Test& test, const std::string& file, size_t line, const std::string& name, T1 actual, T2 expected, TStr to_str) {
-	std::string filename = std::filesystem::path(file).filename().string();
-	std::string location_str = "[" + filename + ":" + std::to_string(line) + "]";
-	TestError* error = test.getCurrentError()->add(name + " " + location_str);
+void compareFail(Test& test, const SourceLocation& location, const char* name, const T1& actual, const T2& expected, TStr to_str) {
+	TestError* error = test.getCurrentError()->add(std::string(name) + " " + location.toString());
 	error->raw = test.raw_mode;
+	test.result = false;
+	DiffLimits limits = test.parent ? test.parent->getRoot()->diff_limits : DiffLimits();
+	// long values are diffed, so only the differing parts are copied into the error tree
+	if constexpr (std::convertible_to<const T1&, std::string_view> && std::convertible_to<const T2&, std::string_view>) {
+		std::string_view actual_str = actual;
+		std::string_view expected_str = expected;
+		if (std::max(actual_str.size(), expected_str.size()) > limits.max_inline_size
+			|| actual_str.find('\n') != std::string_view::npos || expected_str.find('\n') != std::string_view::npos) {
+			reportStringDiff(error, expected_str, actual_str, limits);
+			return;
+		}
+	} else if constexpr (DiffableRanges<const T1, const T2>) {
+		size_t actual_size = std::ranges::size(actual);
+		size_t expected_size = std::ranges::size(expected);
+		if (std::max(actual_size, expected_size) > limits.max_inline_elements) {
+			auto actual_begin = std::ranges::begin(actual);
+			auto expected_begin = std::ranges::begin(expected);
+			std::vector<DiffMatch> matches = diffSequences(expected_size, actual_size, [&](size_t expected_index, size_t actual_index) {
+				return expected_begin[expected_index] == actual_begin[actual_index];
+			}, limits.max_cost);
+			reportSequenceDiff(error, matches, expected_size, actual_size, [&](bool is_actual, size_t index) {
+				return is_actual ? parameterToString(actual_begin[index]) : parameterToString(expected_begin[index]);
+			}, limits);
+			return;
+		}
+	}
 	error->add("Expected value: " + to_str(expected));
 	error->add("Actual value:   " + to_str(actual));
-	test.result = false;
 }
 
 }
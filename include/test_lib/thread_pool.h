@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+
+namespace test {
+
+using TaskFuncType = std::function<void(void)>;
+
+class TaskGroup;
+
+// Work-stealing pool: every worker has its own deque, takes new work from
+// the back of it and steals from the front of the other deques when idle.
+class ThreadPool {
+public:
+	explicit ThreadPool(size_t thread_count = 0);
+	~ThreadPool();
+	size_t getThreadCount() const;
+	void submit(TaskFuncType task, TaskGroup* group = nullptr);
+	static ThreadPool* getCurrent();
+
+private:
+	friend class TaskGroup;
+	struct Task {
+		TaskFuncType func;
+		TaskGroup* group = nullptr;
+	};
+	struct Worker {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+		std::thread thread;
+	};
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::mutex wake_mutex;
+	std::condition_variable wake_cv;
+	std::atomic<size_t> queued_count = 0;
+	std::atomic<size_t> next_worker = 0;
+	bool stopping = false;
+
+	void workerLoop(size_t index);
+	// with a group only tasks of that group are taken
+	bool tryPop(size_t index, Task& task, const TaskGroup* group);
+	bool trySteal(size_t index, Task& task, const TaskGroup* group);
+	bool tryRunOne(size_t index, const TaskGroup* group = nullptr);
+	void execute(Task& task);
+};
+
+// Tracks a set of tasks submitted to a pool. wait() runs queued tasks of the
+// group on the calling thread until all of them have finished, so it can be
+// called from inside a pool task without starving the pool. Tasks of other
+// groups are left alone, they could be unrelated work that must not nest
+// inside the waiting task.
+class TaskGroup {
+public:
+	explicit TaskGroup(ThreadPool& pool);
+	~TaskGroup();
+	void run(TaskFuncType task);
+	void wait();
+
+private:
+	friend class ThreadPool;
+	ThreadPool& pool;
+	std::atomic<size_t> pending_count = 0;
+	std::mutex mutex;
+	std::condition_variable done_cv;
+
+	void taskFinished();
+};
+
+}
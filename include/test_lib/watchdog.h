@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#endif
+
+namespace test {
+
+using TimeoutFuncType = std::function<void(const std::vector<std::string>& stack)>;
+
+// Background thread that calls a function when a deadline passes before it
+// is cancelled. Stacks are captured by interrupting the watched thread with
+// SIGUSR2, where that isn't supported the stack passed to the function is
+// empty.
+class Watchdog {
+public:
+	Watchdog();
+	Watchdog(const Watchdog&) = delete;
+	Watchdog& operator=(const Watchdog&) = delete;
+	~Watchdog();
+	// with capture_stack the stack of the calling thread is passed to on_timeout,
+	// returns an id for cancel()
+	size_t watch(std::chrono::nanoseconds timeout, bool capture_stack, TimeoutFuncType on_timeout);
+	// returns false if the timeout already fired, waits until its function returns
+	bool cancel(size_t id);
+
+private:
+	struct Entry {
+		std::chrono::steady_clock::time_point deadline;
+		bool capture_stack = false;
+		TimeoutFuncType on_timeout;
+#if defined(__unix__) || defined(__APPLE__)
+		pthread_t thread;
+#endif
+	};
+	std::map<size_t, Entry> entries;
+	size_t next_id = 1;
+	size_t firing_id = 0;
+	bool stopping = false;
+	std::mutex mutex;
+	std::condition_variable wake_cv;
+	std::condition_variable fired_cv;
+	std::thread thread;
+
+	void threadMain();
+	std::vector<std::string> captureStack(Entry& entry);
+};
+
+}
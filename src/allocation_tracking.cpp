@@ -0,0 +1,242 @@
+#include "test_lib/allocation_tracking.h"
+#include <cstdlib>
+#include <cerrno>
+#include <new>
+#include <algorithm>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#define TEST_LIB_USABLE_SIZE(ptr) malloc_usable_size(ptr)
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#define TEST_LIB_USABLE_SIZE(ptr) malloc_size(ptr)
+#elif defined(_MSC_VER)
+#include <malloc.h>
+#define TEST_LIB_USABLE_SIZE(ptr) _msize(ptr)
+#elif defined(TEST_LIB_ALLOCATION_TRACKING)
+#error "Allocation tracking needs the usable size of a malloc block, which is not known on this platform"
+#endif
+
+#if defined(TEST_LIB_TRACK_MALLOC) && !defined(__GLIBC__)
+#error "TEST_LIB_TRACK_MALLOC is only supported with glibc"
+#endif
+
+namespace test {
+
+	// a plain pointer, so reading it from inside malloc never needs dynamic initialization
+	static thread_local AllocationStats* current_stats = nullptr;
+
+#ifdef TEST_LIB_ALLOCATION_TRACKING
+
+	static void recordAllocation(void* ptr, size_t size) {
+		AllocationStats* stats = current_stats;
+		if (!stats || !ptr) {
+			return;
+		}
+		stats->allocations++;
+		stats->allocated_bytes += size;
+		stats->live_bytes += TEST_LIB_USABLE_SIZE(ptr);
+		stats->peak_live_bytes = std::max(stats->peak_live_bytes, stats->live_bytes);
+	}
+
+	// usable_size is read before the block is freed
+	static void recordFreedBlock(size_t usable_size) {
+		AllocationStats* stats = current_stats;
+		if (!stats) {
+			return;
+		}
+		stats->deallocations++;
+		stats->live_bytes -= usable_size;
+	}
+
+	static void recordDeallocation(void* ptr) {
+		if (!current_stats || !ptr) {
+			return;
+		}
+		recordFreedBlock(TEST_LIB_USABLE_SIZE(ptr));
+	}
+
+#endif
+
+	AllocationStats& AllocationStats::operator+=(const AllocationStats& other) {
+		available |= other.available;
+		allocations += other.allocations;
+		deallocations += other.deallocations;
+		allocated_bytes += other.allocated_bytes;
+		live_bytes += other.live_bytes;
+		peak_live_bytes = std::max(peak_live_bytes, other.peak_live_bytes);
+		return *this;
+	}
+
+	std::string AllocationStats::toString() const {
+		if (!available) {
+			return "no allocation stats";
+		}
+		return std::to_string(allocations) + " allocations, " + std::to_string(deallocations) + " deallocations, "
+			+ std::to_string(allocated_bytes) + " bytes, peak live " + std::to_string(peak_live_bytes) + " bytes";
+	}
+
+	AllocationScope::AllocationScope(AllocationStats& stats) {
+		stats = AllocationStats();
+		stats.available = isEnabled();
+		previous = current_stats;
+		current_stats = &stats;
+	}
+
+	AllocationScope::~AllocationScope() {
+		current_stats = previous;
+	}
+
+	bool AllocationScope::isEnabled() {
+#ifdef TEST_LIB_ALLOCATION_TRACKING
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	AllocationPause::AllocationPause() {
+		paused = current_stats;
+		current_stats = nullptr;
+	}
+
+	AllocationPause::~AllocationPause() {
+		current_stats = paused;
+	}
+
+	class UntrackedResource : public std::pmr::memory_resource {
+	protected:
+		void* do_allocate(size_t bytes, size_t alignment) override {
+			AllocationPause pause;
+			return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+		}
+
+		void do_deallocate(void* ptr, size_t bytes, size_t alignment) override {
+			AllocationPause pause;
+			std::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+		}
+
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+			return this == &other;
+		}
+	};
+
+	std::pmr::memory_resource* untrackedResource() {
+		static UntrackedResource resource;
+		return &resource;
+	}
+
+}
+
+#if defined(TEST_LIB_ALLOCATION_TRACKING) && defined(TEST_LIB_TRACK_MALLOC)
+
+// operator new of the standard library allocates with malloc, so it's counted here too
+extern "C" {
+
+	void* __libc_malloc(size_t size);
+	void* __libc_calloc(size_t count, size_t size);
+	void* __libc_realloc(void* ptr, size_t size);
+	void* __libc_memalign(size_t alignment, size_t size);
+	void* __libc_valloc(size_t size);
+	void* __libc_pvalloc(size_t size);
+	void __libc_free(void* ptr);
+
+	void* malloc(size_t size) {
+		void* ptr = __libc_malloc(size);
+		test::recordAllocation(ptr, size);
+		return ptr;
+	}
+
+	void* calloc(size_t count, size_t size) {
+		void* ptr = __libc_calloc(count, size);
+		test::recordAllocation(ptr, count * size);
+		return ptr;
+	}
+
+	void* realloc(void* ptr, size_t size) {
+		// a failed realloc leaves the old block allocated, so it's only counted as freed after success
+		size_t old_size = ptr ? TEST_LIB_USABLE_SIZE(ptr) : 0;
+		void* new_ptr = __libc_realloc(ptr, size);
+		if (!new_ptr && size > 0) {
+			return nullptr;
+		}
+		if (ptr) {
+			test::recordFreedBlock(old_size);
+		}
+		test::recordAllocation(new_ptr, size);
+		return new_ptr;
+	}
+
+	void* reallocarray(void* ptr, size_t count, size_t size) {
+		size_t total;
+		if (__builtin_mul_overflow(count, size, &total)) {
+			errno = ENOMEM;
+			return nullptr;
+		}
+		return realloc(ptr, total);
+	}
+
+	void* memalign(size_t alignment, size_t size) {
+		void* ptr = __libc_memalign(alignment, size);
+		test::recordAllocation(ptr, size);
+		return ptr;
+	}
+
+	void* aligned_alloc(size_t alignment, size_t size) {
+		return memalign(alignment, size);
+	}
+
+	int posix_memalign(void** result, size_t alignment, size_t size) {
+		void* ptr = memalign(alignment, size);
+		if (!ptr) {
+			return ENOMEM;
+		}
+		*result = ptr;
+		return 0;
+	}
+
+	void* valloc(size_t size) {
+		void* ptr = __libc_valloc(size);
+		test::recordAllocation(ptr, size);
+		return ptr;
+	}
+
+	void* pvalloc(size_t size) {
+		void* ptr = __libc_pvalloc(size);
+		test::recordAllocation(ptr, size);
+		return ptr;
+	}
+
+	void free(void* ptr) {
+		test::recordDeallocation(ptr);
+		__libc_free(ptr);
+	}
+
+}
+
+#elif defined(TEST_LIB_ALLOCATION_TRACKING)
+
+// The array, nothrow and sized forms of the standard library forward to
+// these, so replacing them covers every new expression except the ones
+// for over-aligned types.
+
+void* operator new(std::size_t size) {
+	void* ptr = std::malloc(size > 0 ? size : 1);
+	if (!ptr) {
+		throw std::bad_alloc();
+	}
+	test::recordAllocation(ptr, size);
+	return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+	test::recordDeallocation(ptr);
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+	test::recordDeallocation(ptr);
+	std::free(ptr);
+}
+
+#endif
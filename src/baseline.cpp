@@ -0,0 +1,179 @@
+#include "test_lib/baseline.h"
+#include "test_lib/test.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace test {
+
+	bool Baseline::load(const std::filesystem::path& path) {
+		std::ifstream file(path);
+		if (!file) {
+			return false;
+		}
+		entries.clear();
+		std::string line;
+		while (std::getline(file, line)) {
+			size_t tab_pos = line.find('\t');
+			if (tab_pos == std::string::npos) {
+				continue;
+			}
+			std::vector<double>& samples = entries[line.substr(0, tab_pos)];
+			std::istringstream sample_stream(line.substr(tab_pos + 1));
+			double sample;
+			while (sample_stream >> sample) {
+				samples.push_back(sample);
+			}
+		}
+		return true;
+	}
+
+	bool Baseline::save(const std::filesystem::path& path) const {
+		std::filesystem::path temp_path = path;
+		temp_path += ".tmp";
+		{
+			std::ofstream file(temp_path, std::ios::trunc);
+			if (!file) {
+				return false;
+			}
+			file.precision(12);
+			for (auto& [test_path, samples] : entries) {
+				file << test_path << "\t";
+				for (size_t i = 0; i < samples.size(); i++) {
+					file << (i > 0 ? " " : "") << samples[i];
+				}
+				file << "\n";
+			}
+			if (!file) {
+				return false;
+			}
+		}
+		std::error_code error;
+		std::filesystem::rename(temp_path, path, error);
+		return !error;
+	}
+
+	const std::vector<double>* Baseline::find(const std::string& test_path) const {
+		auto it = entries.find(test_path);
+		if (it == entries.end()) {
+			return nullptr;
+		}
+		return &it->second;
+	}
+
+	void Baseline::record(const std::string& test_path, const Test& test, size_t history_size) {
+		std::vector<double> current = getTimingSamples(test);
+		std::vector<double>& samples = entries[test_path];
+		if (test.asBenchmark()) {
+			// a benchmark run is a full sample set by itself
+			samples = current;
+			return;
+		}
+		samples.insert(samples.end(), current.begin(), current.end());
+		if (samples.size() > history_size) {
+			samples.erase(samples.begin(), samples.end() - history_size);
+		}
+	}
+
+	std::string RegressionCheck::toString() const {
+		char buffer[128];
+		double change = baseline_median > 0.0 ? (current_median / baseline_median - 1.0) * 100.0 : 0.0;
+		snprintf(buffer, sizeof(buffer), "%+.1f%%, p=%.4f", change, p_value);
+		std::chrono::nanoseconds current(std::llround(current_median));
+		std::chrono::nanoseconds baseline(std::llround(baseline_median));
+		return "median " + formatDuration(current) + ", baseline " + formatDuration(baseline) + " (" + buffer + ")";
+	}
+
+	double mannWhitneyPValue(const std::vector<double>& current, const std::vector<double>& baseline) {
+		size_t n1 = current.size();
+		size_t n2 = baseline.size();
+		if (n1 == 0 || n2 == 0) {
+			return 1.0;
+		}
+		std::vector<std::pair<double, bool>> values;
+		values.reserve(n1 + n2);
+		for (double value : current) {
+			values.push_back({ value, true });
+		}
+		for (double value : baseline) {
+			values.push_back({ value, false });
+		}
+		std::sort(values.begin(), values.end(), [](const auto& left, const auto& right) {
+			return left.first < right.first;
+		});
+		double current_rank_sum = 0.0;
+		double tie_sum = 0.0;
+		for (size_t i = 0; i < values.size();) {
+			size_t j = i;
+			while (j < values.size() && values[j].first == values[i].first) {
+				j++;
+			}
+			double rank = (i + 1 + j) / 2.0;
+			for (size_t k = i; k < j; k++) {
+				if (values[k].second) {
+					current_rank_sum += rank;
+				}
+			}
+			double tie_count = static_cast<double>(j - i);
+			tie_sum += tie_count * tie_count * tie_count - tie_count;
+			i = j;
+		}
+		double n = static_cast<double>(n1 + n2);
+		double u = current_rank_sum - n1 * (n1 + 1) / 2.0;
+		double mean = n1 * n2 / 2.0;
+		double variance = n1 * n2 / 12.0 * ((n + 1) - tie_sum / (n * (n - 1)));
+		if (variance <= 0.0) {
+			return 1.0;
+		}
+		double z = (u - mean - 0.5) / std::sqrt(variance);
+		return 0.5 * std::erfc(z / std::sqrt(2.0));
+	}
+
+	double median(std::vector<double> values) {
+		if (values.empty()) {
+			return 0.0;
+		}
+		size_t middle = values.size() / 2;
+		std::nth_element(values.begin(), values.begin() + middle, values.end());
+		double result = values[middle];
+		if (values.size() % 2 == 0) {
+			result = (result + *std::max_element(values.begin(), values.begin() + middle)) / 2.0;
+		}
+		return result;
+	}
+
+	RegressionCheck checkRegression(
+		const std::vector<double>& current, const std::vector<double>& baseline, double threshold, double alpha
+	) {
+		RegressionCheck check;
+		check.current_median = median(current);
+		check.baseline_median = median(baseline);
+		if (current.size() == 1) {
+			// one run of a plain test can't reach a small p in a rank test against the
+			// history, p is the share of baseline runs at least as slow instead
+			double slower_count = static_cast<double>(std::count_if(baseline.begin(), baseline.end(), [&](double value) {
+				return value >= current.front();
+			}));
+			check.p_value = baseline.empty() ? 1.0 : slower_count / static_cast<double>(baseline.size());
+		} else {
+			check.p_value = mannWhitneyPValue(current, baseline);
+		}
+		check.regressed = check.p_value < alpha && check.current_median > check.baseline_median * (1.0 + threshold);
+		return check;
+	}
+
+	std::vector<double> getTimingSamples(const Test& test) {
+		std::vector<double> result;
+		if (const Benchmark* benchmark = test.asBenchmark()) {
+			for (Benchmark::Duration sample : benchmark->samples) {
+				result.push_back(sample.count());
+			}
+		} else {
+			result.push_back(static_cast<double>(test.wall_time.count()));
+		}
+		return result;
+	}
+
+}
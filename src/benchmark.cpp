@@ -0,0 +1,167 @@
+#include "test_lib/test.h"
+#include "test_lib/isolation.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace test {
+
+	Benchmark::Benchmark(std::string name, std::vector<TestNode*> required, BenchmarkFuncType func)
+	: Test(std::move(name), std::move(required), [func = std::move(func)](Test& test) {
+		Benchmark& benchmark = static_cast<Benchmark&>(test);
+		benchmark.reset();
+		func(benchmark);
+		benchmark.computeStats();
+	}) {
+		this->kind = NodeKind::Benchmark;
+	}
+
+	bool Benchmark::hasStats() const {
+		return !samples.empty();
+	}
+
+	double Benchmark::getIterationsPerSecond() const {
+		if (median_time <= Duration::zero()) {
+			return 0.0;
+		}
+		return 1.0e9 / median_time.count();
+	}
+
+	double Benchmark::getBytesPerSecond() const {
+		return getIterationsPerSecond() * bytes_per_iteration;
+	}
+
+	std::string Benchmark::getStatsString() const {
+		auto format_rate = [](double value, const char* unit) {
+			const char* prefixes[] = { "", "k", "M", "G", "T" };
+			size_t prefix = 0;
+			while (prefix < 4 && value >= 1000.0) {
+				value /= 1000.0;
+				prefix++;
+			}
+			char buffer[48];
+			snprintf(buffer, sizeof(buffer), "%.2f %s%s/s", value, prefixes[prefix], unit);
+			return std::string(buffer);
+		};
+		auto format_time = [](Duration duration) {
+			return formatDuration(std::chrono::nanoseconds(std::llround(duration.count())));
+		};
+		std::string result = "min " + format_time(min_time)
+			+ ", median " + format_time(median_time)
+			+ ", p99 " + format_time(p99_time)
+			+ ", " + format_rate(getIterationsPerSecond(), "it");
+		if (bytes_per_iteration > 0) {
+			result += ", " + format_rate(getBytesPerSecond(), "B");
+		}
+		result += " (" + std::to_string(samples.size()) + "x" + std::to_string(iterations_per_sample) + " iterations)";
+		return result;
+	}
+
+	void Benchmark::writeResults(BinaryWriter& writer) const {
+		Test::writeResults(writer);
+		writer.writeVarint(iterations_per_sample);
+		writer.writeVarint(samples.size());
+		for (Duration sample : samples) {
+			writer.writeDouble(sample.count());
+		}
+	}
+
+	bool Benchmark::readResults(BinaryReader& reader) {
+		if (!Test::readResults(reader)) {
+			return false;
+		}
+		uint64_t iterations;
+		uint64_t count;
+		if (!reader.readVarint(iterations) || !reader.readVarint(count)) {
+			return false;
+		}
+		iterations_per_sample = iterations;
+		samples.clear();
+		for (uint64_t i = 0; i < count; i++) {
+			double sample;
+			if (!reader.readDouble(sample)) {
+				return false;
+			}
+			samples.push_back(Duration(sample));
+		}
+		computeStats();
+		return true;
+	}
+
+	void Benchmark::reset() {
+		phase = Phase::NotStarted;
+		remaining_iterations = 0;
+		batch_iterations = 0;
+		warmup_iterations = 0;
+		iterations_per_sample = 0;
+		samples.clear();
+		samples.reserve(sample_count);
+	}
+
+	// Called when the current batch of iterations is used up. Warmup runs
+	// batches of doubling size until warmup_time has passed, the observed
+	// speed gives the number of iterations that fill one sample_time.
+	bool Benchmark::nextBatch() {
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		switch (phase) {
+			case Phase::NotStarted: {
+				phase = Phase::Warmup;
+				phase_start = now;
+				batch_iterations = 1;
+				break;
+			}
+			case Phase::Warmup: {
+				warmup_iterations += batch_iterations;
+				std::chrono::nanoseconds elapsed = now - phase_start;
+				if (elapsed < warmup_time) {
+					batch_iterations *= 2;
+					break;
+				}
+				double iteration_time = static_cast<double>(elapsed.count()) / warmup_iterations;
+				iterations_per_sample = std::max<size_t>(1, static_cast<size_t>(sample_time.count() / std::max(iteration_time, 1.0)));
+				batch_iterations = iterations_per_sample;
+				phase = Phase::Measure;
+				phase_start = now;
+				break;
+			}
+			case Phase::Measure: {
+				samples.push_back(Duration(now - batch_start) / static_cast<double>(batch_iterations));
+				if (samples.size() >= sample_count || now - phase_start >= max_time) {
+					phase = Phase::Done;
+					return false;
+				}
+				break;
+			}
+			case Phase::Done: {
+				return false;
+			}
+		}
+		// the current call counts as the first iteration of the batch
+		remaining_iterations = batch_iterations - 1;
+		batch_start = std::chrono::steady_clock::now();
+		return true;
+	}
+
+	void Benchmark::computeStats() {
+		if (samples.empty()) {
+			min_time = median_time = p99_time = Duration::zero();
+			return;
+		}
+		std::vector<Duration> sorted = samples;
+		std::sort(sorted.begin(), sorted.end());
+		min_time = sorted.front();
+		size_t middle = sorted.size() / 2;
+		if (sorted.size() % 2 == 0) {
+			median_time = (sorted[middle - 1] + sorted[middle]) / 2.0;
+		} else {
+			median_time = sorted[middle];
+		}
+		size_t p99_rank = static_cast<size_t>(std::ceil(sorted.size() * 0.99));
+		p99_time = sorted[std::max<size_t>(p99_rank, 1) - 1];
+	}
+
+#ifdef _MSC_VER
+	void useCharPointer(const volatile char* ptr) { }
+#endif
+
+}
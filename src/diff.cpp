@@ -0,0 +1,202 @@
+#include "test_lib/diff.h"
+#include "test_lib/test.h"
+
+namespace test {
+
+	struct DiffChange {
+		size_t old_begin = 0;
+		size_t old_end = 0;
+		size_t new_begin = 0;
+		size_t new_end = 0;
+	};
+
+	static std::vector<DiffChange> getChanges(const std::vector<DiffMatch>& matches) {
+		std::vector<DiffChange> changes;
+		size_t old_pos = 0;
+		size_t new_pos = 0;
+		for (const DiffMatch& match : matches) {
+			if (match.old_start > old_pos || match.new_start > new_pos) {
+				changes.push_back({ old_pos, match.old_start, new_pos, match.new_start });
+			}
+			old_pos = match.old_start + match.length;
+			new_pos = match.new_start + match.length;
+		}
+		return changes;
+	}
+
+	// index of the first change after the hunk starting at first, changes closer than two contexts share a hunk
+	static size_t getHunkEnd(const std::vector<DiffChange>& changes, size_t first, size_t context) {
+		size_t last = first;
+		while (last + 1 < changes.size() && changes[last + 1].old_begin - changes[last].old_end <= context * 2) {
+			last++;
+		}
+		return last + 1;
+	}
+
+	static std::string cutLine(std::string_view line, size_t max_length) {
+		if (line.size() <= max_length) {
+			return std::string(line);
+		}
+		return std::string(line.substr(0, max_length)) + "... (" + std::to_string(line.size()) + " characters)";
+	}
+
+	static void addSummary(TestError* error, size_t change_count, size_t expected_size, size_t actual_size, const char* unit) {
+		error->add(
+			"Differs in " + std::to_string(change_count) + (change_count == 1 ? " place" : " places") + ", expected has "
+			+ std::to_string(expected_size) + " " + unit + ", actual has " + std::to_string(actual_size)
+		);
+	}
+
+	// Unified diff hunks, numbers in the headers start at first_number. With show_indices
+	// lines start with their index, "[expected/actual]" for equal lines at different indices.
+	static void reportHunks(
+		TestError* error, const std::vector<DiffChange>& changes, size_t expected_size, size_t first_number,
+		bool show_indices, Callable<std::string(bool is_actual, size_t index)>& describe, const DiffLimits& limits
+	) {
+		size_t context = limits.context_lines;
+		size_t hunk_count = 0;
+		size_t first = 0;
+		while (first < changes.size()) {
+			size_t end = getHunkEnd(changes, first, context);
+			if (hunk_count == limits.max_hunks) {
+				size_t remaining = 0;
+				for (; first < changes.size(); first = getHunkEnd(changes, first, context)) {
+					remaining++;
+				}
+				error->add(std::to_string(remaining) + " more differing hunks not shown");
+				break;
+			}
+			hunk_count++;
+			size_t old_begin = changes[first].old_begin - std::min(changes[first].old_begin, context);
+			size_t old_end = std::min(changes[end - 1].old_end + context, expected_size);
+			// equal lines keep the offset between both sides
+			size_t new_begin = changes[first].new_begin - (changes[first].old_begin - old_begin);
+			size_t new_end = changes[end - 1].new_end + (old_end - changes[end - 1].old_end);
+			TestError* hunk = error->add(
+				"@@ -" + std::to_string(old_begin + first_number) + "," + std::to_string(old_end - old_begin)
+				+ " +" + std::to_string(new_begin + first_number) + "," + std::to_string(new_end - new_begin) + " @@"
+			);
+			size_t line_count = 0;
+			// equal lines pass both indices, changed lines npos for the other side
+			auto addLine = [&](char prefix, size_t old_index, size_t new_index) {
+				if (line_count < limits.max_hunk_lines) {
+					bool is_actual = old_index == std::string::npos;
+					std::string line = cutLine(describe(is_actual, is_actual ? new_index : old_index), limits.max_line_length);
+					if (show_indices) {
+						std::string label = std::to_string(is_actual ? new_index : old_index);
+						if (!is_actual && new_index != std::string::npos && new_index != old_index) {
+							label += "/" + std::to_string(new_index);
+						}
+						line = "[" + label + "] " + line;
+					}
+					hunk->add(prefix + line);
+				}
+				line_count++;
+			};
+			size_t old_pos = old_begin;
+			size_t new_pos = new_begin;
+			for (size_t i = first; i < end; i++) {
+				const DiffChange& change = changes[i];
+				for (; old_pos < change.old_begin; old_pos++, new_pos++) {
+					addLine(' ', old_pos, new_pos);
+				}
+				for (size_t index = change.old_begin; index < change.old_end; index++) {
+					addLine('-', index, std::string::npos);
+				}
+				for (size_t index = change.new_begin; index < change.new_end; index++) {
+					addLine('+', std::string::npos, index);
+				}
+				old_pos = change.old_end;
+				new_pos = change.new_end;
+			}
+			for (; old_pos < old_end; old_pos++, new_pos++) {
+				addLine(' ', old_pos, new_pos);
+			}
+			if (line_count > limits.max_hunk_lines) {
+				hunk->add(std::to_string(line_count - limits.max_hunk_lines) + " more lines in this hunk not shown");
+			}
+			first = end;
+		}
+	}
+
+	static void reportCharDiff(TestError* error, std::string_view expected, std::string_view actual, const DiffLimits& limits) {
+		std::vector<DiffMatch> matches = diffSequences(expected.size(), actual.size(), [&](size_t old_index, size_t new_index) {
+			return expected[old_index] == actual[new_index];
+		}, limits.max_cost);
+		std::vector<DiffChange> changes = getChanges(matches);
+		addSummary(error, changes.size(), expected.size(), actual.size(), "characters");
+		size_t context = limits.context_chars;
+		auto snippet = [&](std::string_view str, size_t begin, size_t end) {
+			std::string result = begin > 0 ? "..." : "";
+			result += cutLine(str.substr(begin, end - begin), limits.max_line_length);
+			if (end < str.size()) {
+				result += "...";
+			}
+			return result;
+		};
+		size_t hunk_count = 0;
+		for (size_t first = 0; first < changes.size(); first = getHunkEnd(changes, first, context)) {
+			if (hunk_count == limits.max_hunks) {
+				size_t remaining = 0;
+				for (; first < changes.size(); first = getHunkEnd(changes, first, context)) {
+					remaining++;
+				}
+				error->add(std::to_string(remaining) + " more differing hunks not shown");
+				break;
+			}
+			hunk_count++;
+			size_t end = getHunkEnd(changes, first, context);
+			size_t old_begin = changes[first].old_begin - std::min(changes[first].old_begin, context);
+			size_t old_end = std::min(changes[end - 1].old_end + context, expected.size());
+			size_t new_begin = changes[first].new_begin - (changes[first].old_begin - old_begin);
+			size_t new_end = changes[end - 1].new_end + (old_end - changes[end - 1].old_end);
+			TestError* hunk = error->add(
+				"At index " + std::to_string(changes[first].old_begin) + " of expected, " + std::to_string(changes[first].new_begin) + " of actual"
+			);
+			hunk->add("Expected: " + snippet(expected, old_begin, old_end));
+			hunk->add("Actual:   " + snippet(actual, new_begin, new_end));
+		}
+	}
+
+	static std::vector<std::string_view> splitLines(std::string_view str) {
+		std::vector<std::string_view> lines;
+		size_t start = 0;
+		while (true) {
+			size_t end = str.find('\n', start);
+			if (end == std::string_view::npos) {
+				lines.push_back(str.substr(start));
+				return lines;
+			}
+			lines.push_back(str.substr(start, end - start));
+			start = end + 1;
+		}
+	}
+
+	void reportStringDiff(TestError* error, std::string_view expected, std::string_view actual, const DiffLimits& limits) {
+		if (expected.find('\n') == std::string_view::npos && actual.find('\n') == std::string_view::npos) {
+			reportCharDiff(error, expected, actual, limits);
+			return;
+		}
+		std::vector<std::string_view> expected_lines = splitLines(expected);
+		std::vector<std::string_view> actual_lines = splitLines(actual);
+		std::vector<DiffMatch> matches = diffSequences(expected_lines.size(), actual_lines.size(), [&](size_t old_index, size_t new_index) {
+			return expected_lines[old_index] == actual_lines[new_index];
+		}, limits.max_cost);
+		std::vector<DiffChange> changes = getChanges(matches);
+		addSummary(error, changes.size(), expected_lines.size(), actual_lines.size(), "lines");
+		Callable<std::string(bool is_actual, size_t index)> describe = [&](bool is_actual, size_t index) {
+			return std::string(is_actual ? actual_lines[index] : expected_lines[index]);
+		};
+		reportHunks(error, changes, expected_lines.size(), 1, false, describe, limits);
+	}
+
+	void reportSequenceDiff(
+		TestError* error, const std::vector<DiffMatch>& matches, size_t expected_size, size_t actual_size,
+		Callable<std::string(bool is_actual, size_t index)> describe, const DiffLimits& limits
+	) {
+		std::vector<DiffChange> changes = getChanges(matches);
+		addSummary(error, changes.size(), expected_size, actual_size, "elements");
+		reportHunks(error, changes, expected_size, 0, true, describe, limits);
+	}
+
+}
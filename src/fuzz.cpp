@@ -0,0 +1,497 @@
+#include "test_lib/test.h"
+#include "test_lib/isolation.h"
+#include "test_lib/result_cache.h"
+#include "logger/logger.h"
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <iostream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define TEST_LIB_HAS_FORK
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#endif
+
+namespace test {
+
+	struct CounterRange {
+		uint8_t* begin = nullptr;
+		uint8_t* end = nullptr;
+	};
+
+	// filled before main() by the constructors of instrumented code
+	static std::vector<CounterRange>& counterRanges() {
+		static std::vector<CounterRange> ranges;
+		return ranges;
+	}
+
+	// trace-pc only reports the caller, so edges are approximated by hashed return addresses
+	static constexpr size_t trace_pc_size = 1 << 16;
+	static uint8_t trace_pc_counters[trace_pc_size];
+	static bool trace_pc_used = false;
+
+	// Features are counters that reached a new power of two bucket, like in AFL
+	class CoverageMap {
+	public:
+		size_t feature_count = 0;
+
+		CoverageMap() {
+			size_t size = trace_pc_size;
+			for (const CounterRange& range : counterRanges()) {
+				size += range.end - range.begin;
+			}
+			seen_buckets.resize(size);
+		}
+
+		// takes the counters of the last run and clears them, true if they had anything new
+		bool collect() {
+			bool found = false;
+			size_t offset = 0;
+			for (const CounterRange& range : counterRanges()) {
+				found |= collectRange(range.begin, range.end, offset);
+				offset += range.end - range.begin;
+			}
+			if (trace_pc_used) {
+				found |= collectRange(trace_pc_counters, trace_pc_counters + trace_pc_size, offset);
+			}
+			return found;
+		}
+
+	private:
+		std::vector<uint8_t> seen_buckets;
+
+		static uint8_t bucket(uint8_t count) {
+			uint8_t result = 1;
+			for (uint8_t limit : { 2, 3, 4, 8, 16, 32, 128 }) {
+				if (count < limit) {
+					break;
+				}
+				result <<= 1;
+			}
+			return result;
+		}
+
+		bool collectRange(uint8_t* begin, uint8_t* end, size_t offset) {
+			bool found = false;
+			uint8_t* counter = begin;
+			while (counter < end) {
+				// most counters are zero, so they are skipped a word at a time
+				uint64_t word;
+				if (end - counter >= 8 && (memcpy(&word, counter, 8), word == 0)) {
+					counter += 8;
+					continue;
+				}
+				if (*counter != 0) {
+					uint8_t bit = bucket(*counter);
+					uint8_t& seen = seen_buckets[offset + (counter - begin)];
+					if ((seen & bit) == 0) {
+						seen |= bit;
+						feature_count++;
+						found = true;
+					}
+					*counter = 0;
+				}
+				counter++;
+			}
+			return found;
+		}
+	};
+
+	static void mutate(std::vector<uint8_t>& input, const std::vector<std::vector<uint8_t>>& corpus, Random& random, size_t max_size) {
+		const uint8_t interesting[] = { 0x00, 0x01, 0x7F, 0x80, 0xFF, '0', '9', 'a', ' ', '\n' };
+		size_t count = random.between<size_t>(1, 4);
+		for (size_t i = 0; i < count; i++) {
+			size_t pos = input.empty() ? 0 : random.between<size_t>(0, input.size() - 1);
+			switch (random.between(0, 7)) {
+				case 0:
+					if (!input.empty()) {
+						input[pos] ^= static_cast<uint8_t>(1u << random.between(0, 7));
+					}
+					break;
+				case 1:
+					if (!input.empty()) {
+						input[pos] = static_cast<uint8_t>(random.next());
+					}
+					break;
+				case 2:
+					input.insert(input.begin() + random.between<size_t>(0, input.size()), static_cast<uint8_t>(random.next()));
+					break;
+				case 3:
+					if (!input.empty()) {
+						size_t length = random.between<size_t>(1, std::min<size_t>(input.size() - pos, 8));
+						input.erase(input.begin() + pos, input.begin() + pos + length);
+					}
+					break;
+				case 4:
+					if (!input.empty()) {
+						input[pos] = interesting[random.between<size_t>(0, std::size(interesting) - 1)];
+					}
+					break;
+				case 5:
+					if (!input.empty()) {
+						input[pos] = static_cast<uint8_t>(input[pos] + random.between(-8, 8));
+					}
+					break;
+				case 6:
+					if (!input.empty()) {
+						size_t length = random.between<size_t>(1, input.size() - pos);
+						std::vector<uint8_t> chunk(input.begin() + pos, input.begin() + pos + length);
+						input.insert(input.begin() + random.between<size_t>(0, input.size()), chunk.begin(), chunk.end());
+					}
+					break;
+				case 7: {
+					const std::vector<uint8_t>& other = corpus[random.between<size_t>(0, corpus.size() - 1)];
+					if (!other.empty()) {
+						size_t other_pos = random.between<size_t>(0, other.size() - 1);
+						size_t length = random.between<size_t>(1, other.size() - other_pos);
+						input.insert(
+							input.begin() + random.between<size_t>(0, input.size()), other.begin() + other_pos, other.begin() + other_pos + length
+						);
+					}
+					break;
+				}
+			}
+		}
+		if (input.size() > max_size) {
+			input.resize(max_size);
+		}
+	}
+
+	static bool readInput(const std::filesystem::path& path, std::vector<uint8_t>& input) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file) {
+			return false;
+		}
+		input.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		return true;
+	}
+
+	static std::string formatInput(const std::vector<uint8_t>& input) {
+		const size_t max_shown = 64;
+		std::string result = "\"";
+		for (size_t i = 0; i < std::min(input.size(), max_shown); i++) {
+			uint8_t c = input[i];
+			if (c == '"' || c == '\\') {
+				result += '\\';
+				result += static_cast<char>(c);
+			} else if (c >= 0x20 && c < 0x7F) {
+				result += static_cast<char>(c);
+			} else {
+				char buffer[8];
+				snprintf(buffer, sizeof(buffer), "\\x%02X", c);
+				result += buffer;
+			}
+		}
+		result += "\"";
+		if (input.size() > max_shown) {
+			result += " ... (" + std::to_string(input.size()) + " bytes)";
+		}
+		return result;
+	}
+
+	// shared with the fuzzing process, followed by max_input_size bytes of input
+	struct FuzzTest::FuzzState {
+		uint64_t runs = 0;
+		uint64_t corpus_size = 0;
+		uint64_t new_inputs = 0;
+		uint64_t features = 0;
+		uint64_t input_size = 0;
+
+		uint8_t* input() {
+			return reinterpret_cast<uint8_t*>(this + 1);
+		}
+	};
+
+	FuzzTest::FuzzTest(std::string name, std::vector<TestNode*> required, std::filesystem::path corpus_dir, FuzzFuncType func)
+	: ParameterizedTest(std::move(name), std::move(required), [this]() -> BatchSourceType {
+		return [this, files = listCorpus(), next_index = size_t(0)](size_t max_count) mutable {
+			if (next_index >= files.size()) {
+				return BatchFuncType();
+			}
+			size_t first_index = next_index;
+			next_index = std::min(files.size(), next_index + max_count);
+			std::vector<std::filesystem::path> batch_files(files.begin() + first_index, files.begin() + next_index);
+			return BatchFuncType([this, batch_files = std::move(batch_files), first_index](CaseRunner& runner) {
+				std::vector<uint8_t> input;
+				for (size_t i = 0; i < batch_files.size(); i++) {
+					const std::filesystem::path& path = batch_files[i];
+					bool readable = readInput(path, input);
+					runner.runCase(first_index + i, [&](Test& test) {
+						if (!readable) {
+							test.getCurrentError()->add("Could not read " + path.string());
+							test.result = false;
+							return;
+						}
+						this->func(test, input.data(), input.size());
+					}, [&]() {
+						return path.filename().string();
+					});
+				}
+			});
+		};
+	}) {
+		this->corpus_dir = std::move(corpus_dir);
+		this->func = std::move(func);
+		this->kind = NodeKind::Fuzz;
+	}
+
+	std::vector<std::filesystem::path> FuzzTest::listCorpus() const {
+		std::vector<std::filesystem::path> files;
+		std::error_code error;
+		for (auto it = std::filesystem::directory_iterator(corpus_dir, error); !error && it != std::filesystem::directory_iterator(); it.increment(error)) {
+			if (it->is_regular_file(error)) {
+				files.push_back(it->path());
+			}
+		}
+		std::sort(files.begin(), files.end());
+		return files;
+	}
+
+	std::string FuzzTest::getFuzzStatsString() const {
+		return std::to_string(fuzz_runs) + " runs, corpus of " + std::to_string(corpus_size) + " inputs ("
+			+ std::to_string(new_inputs) + " new), " + std::to_string(coverage_features) + " coverage features";
+	}
+
+	bool FuzzTest::hasCoverage() {
+		return trace_pc_used || !counterRanges().empty();
+	}
+
+	bool FuzzTest::fuzz(size_t max_runs, std::chrono::nanoseconds max_time) {
+		resetErrors();
+		result = true;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		if (!corpus_dir.empty()) {
+			std::error_code error;
+			std::filesystem::create_directories(corpus_dir, error);
+		}
+		TestModule* root = parent ? parent->getRoot() : nullptr;
+		uint64_t seed = root && root->seed != 0 ? root->seed : static_cast<uint64_t>(start.time_since_epoch().count());
+		size_t state_size = sizeof(FuzzState) + max_input_size;
+		std::vector<uint8_t> failing_input;
+		bool failed = false;
+		std::string crash;
+#ifdef TEST_LIB_HAS_FORK
+		void* memory = mmap(nullptr, state_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		if (memory == MAP_FAILED) {
+			root_error->add("Could not map memory for the fuzzing process");
+			result = false;
+			return false;
+		}
+		FuzzState* state = new (memory) FuzzState();
+		std::cout.flush();
+		fflush(stdout);
+		pid_t pid = fork();
+		if (pid == 0) {
+			Logger::disableStdWrite();
+			logger.manualDeactivate();
+			_exit(fuzzLoop(*state, max_runs, max_time, seed) ? 0 : 1);
+		}
+		int status = 0;
+		if (pid > 0) {
+			while (waitpid(pid, &status, 0) < 0 && errno == EINTR) { }
+		}
+		failed = pid > 0 && !(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+		if (pid < 0) {
+			root_error->add("Could not start the fuzzing process");
+			result = false;
+		}
+#else
+		std::vector<uint64_t> memory((state_size + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+		FuzzState* state = new (memory.data()) FuzzState();
+		failed = !fuzzLoop(*state, max_runs, max_time, seed);
+#endif
+		fuzz_runs = state->runs;
+		corpus_size = state->corpus_size;
+		new_inputs = state->new_inputs;
+		coverage_features = state->features;
+		if (failed) {
+			failing_input.assign(state->input(), state->input() + state->input_size);
+		}
+#ifdef TEST_LIB_HAS_FORK
+		munmap(memory, state_size);
+#endif
+		if (failed) {
+			size_t original_size = failing_input.size();
+			int reproduced = reproduce(failing_input, crash);
+			if (reproduced != 0) {
+				minimize(failing_input, reproduced);
+				reproduced = reproduce(failing_input, crash);
+			}
+			std::filesystem::path saved = saveInput("crash-", failing_input);
+			TestError* error = root_error->add(
+				"Failing input after " + std::to_string(fuzz_runs) + " runs, minimized from " + std::to_string(original_size)
+				+ " to " + std::to_string(failing_input.size()) + " bytes" + (saved.empty() ? "" : ", saved as " + saved.string())
+			);
+			error->add("Input: " + formatInput(failing_input))->raw = true;
+			if (reproduced == 0) {
+				error->add("Passes when run again, the failure depends on earlier runs");
+			} else if (reproduced == 2) {
+				error->add(crash);
+			} else {
+				try {
+					func(*this, failing_input.data(), failing_input.size());
+				} catch (const std::exception& exc) {
+					getCurrentError()->add("EXCEPTION: " + std::string(exc.what()));
+				}
+			}
+			result = false;
+		}
+		wall_time = std::chrono::steady_clock::now() - start;
+		is_run = true;
+		return result;
+	}
+
+	bool FuzzTest::fuzzLoop(FuzzState& state, size_t max_runs, std::chrono::nanoseconds max_time, uint64_t seed) {
+		CoverageMap coverage;
+		CaseRunner runner(*this);
+		auto execute = [&](const std::vector<uint8_t>& input) {
+			// kept where the parent can read it if the run crashes
+			state.input_size = input.size();
+			memcpy(state.input(), input.data(), input.size());
+			state.runs++;
+			return runner.check([&](Test& test) {
+				func(test, input.data(), input.size());
+			});
+		};
+		coverage.collect();
+		std::vector<std::vector<uint8_t>> corpus;
+		std::vector<uint8_t> input;
+		for (const std::filesystem::path& path : listCorpus()) {
+			if (!readInput(path, input)) {
+				continue;
+			}
+			input.resize(std::min(input.size(), max_input_size));
+			if (!execute(input)) {
+				return false;
+			}
+			coverage.collect();
+			corpus.push_back(input);
+		}
+		if (corpus.empty()) {
+			input.clear();
+			if (!execute(input)) {
+				return false;
+			}
+			coverage.collect();
+			corpus.push_back(input);
+		}
+		state.corpus_size = corpus.size();
+		state.features = coverage.feature_count;
+		Random random(seed);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		while (max_runs == 0 || state.runs < max_runs) {
+			// the clock is read every few hundred runs only
+			if (max_time > std::chrono::nanoseconds::zero() && state.runs % 256 == 0
+				&& std::chrono::steady_clock::now() - start >= max_time) {
+				break;
+			}
+			const std::vector<uint8_t>& base = corpus[random.between<size_t>(0, corpus.size() - 1)];
+			input.assign(base.begin(), base.end());
+			mutate(input, corpus, random, max_input_size);
+			if (!execute(input)) {
+				return false;
+			}
+			if (coverage.collect()) {
+				saveInput("", input);
+				corpus.push_back(input);
+				state.corpus_size = corpus.size();
+				state.new_inputs++;
+				state.features = coverage.feature_count;
+			}
+		}
+		return true;
+	}
+
+	int FuzzTest::reproduce(const std::vector<uint8_t>& input, std::string& crash) {
+		auto check = [&]() {
+			CaseRunner runner(*this);
+			return runner.check([&](Test& test) {
+				func(test, input.data(), input.size());
+			});
+		};
+#ifdef TEST_LIB_HAS_FORK
+		std::cout.flush();
+		fflush(stdout);
+		pid_t pid = fork();
+		if (pid == 0) {
+			Logger::disableStdWrite();
+			logger.manualDeactivate();
+			_exit(check() ? 0 : 1);
+		}
+		if (pid < 0) {
+			return check() ? 0 : 1;
+		}
+		int status = 0;
+		while (waitpid(pid, &status, 0) < 0 && errno == EINTR) { }
+		if (WIFEXITED(status) && WEXITSTATUS(status) <= 1) {
+			return WEXITSTATUS(status);
+		}
+		crash = IsolationPool::crashMessage(status);
+		return 2;
+#else
+		return check() ? 0 : 1;
+#endif
+	}
+
+	void FuzzTest::minimize(std::vector<uint8_t>& input, int status) {
+		size_t runs = 0;
+		std::string crash;
+		// removes chunks of halving size for as long as the input keeps failing the same way
+		for (size_t chunk = std::max<size_t>(input.size() / 2, 1); chunk > 0 && runs < max_minimize_runs; chunk /= 2) {
+			size_t pos = 0;
+			while (pos < input.size() && runs < max_minimize_runs) {
+				size_t length = std::min(chunk, input.size() - pos);
+				std::vector<uint8_t> candidate = input;
+				candidate.erase(candidate.begin() + pos, candidate.begin() + pos + length);
+				runs++;
+				if (reproduce(candidate, crash) == status) {
+					input = std::move(candidate);
+				} else {
+					pos += length;
+				}
+			}
+		}
+	}
+
+	std::filesystem::path FuzzTest::saveInput(const std::string& prefix, const std::vector<uint8_t>& input) const {
+		if (corpus_dir.empty()) {
+			return { };
+		}
+		char name[24];
+		uint64_t hash = hashBytes(std::string_view(reinterpret_cast<const char*>(input.data()), input.size()));
+		snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+		std::filesystem::path path = corpus_dir / (prefix + name);
+		std::ofstream file(path, std::ios::binary);
+		file.write(reinterpret_cast<const char*>(input.data()), input.size());
+		return file ? path : std::filesystem::path();
+	}
+
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+
+// Coverage callbacks of -fsanitize-coverage, the library itself is not instrumented.
+// Weak, so a sanitizer or fuzzer runtime linked into the same binary keeps its own.
+extern "C" {
+
+	__attribute__((weak)) void __sanitizer_cov_8bit_counters_init(uint8_t* start, uint8_t* stop) {
+		if (start < stop) {
+			test::counterRanges().push_back({ start, stop });
+		}
+	}
+
+	__attribute__((weak)) void __sanitizer_cov_pcs_init(const uintptr_t*, const uintptr_t*) { }
+
+	__attribute__((weak)) void __sanitizer_cov_trace_pc() {
+		uintptr_t pc = reinterpret_cast<uintptr_t>(__builtin_return_address(0));
+		test::trace_pc_used = true;
+		test::trace_pc_counters[(pc ^ (pc >> 16)) & (test::trace_pc_size - 1)]++;
+	}
+
+}
+
+#endif
@@ -0,0 +1,466 @@
+#include "test_lib/isolation.h"
+#include "test_lib/test.h"
+#include "test_lib/watchdog.h"
+#include "logger/logger.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <cerrno>
+#include <algorithm>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define TEST_LIB_HAS_FORK
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#endif
+
+namespace test {
+
+#ifdef TEST_LIB_HAS_FORK
+
+	static bool writeAll(int fd, const char* data, size_t size) {
+		while (size > 0) {
+			ssize_t written = write(fd, data, size);
+			if (written < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return false;
+			}
+			data += written;
+			size -= written;
+		}
+		return true;
+	}
+
+	static bool readAll(int fd, char* data, size_t size) {
+		while (size > 0) {
+			ssize_t count = read(fd, data, size);
+			if (count < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return false;
+			}
+			if (count == 0) {
+				return false;
+			}
+			data += count;
+			size -= count;
+		}
+		return true;
+	}
+
+	static bool writeMessage(int fd, const std::string& message) {
+		uint32_t size = static_cast<uint32_t>(message.size());
+		return writeAll(fd, reinterpret_cast<const char*>(&size), sizeof(size))
+			&& writeAll(fd, message.data(), message.size());
+	}
+
+	static bool readMessage(int fd, std::string& message) {
+		uint32_t size;
+		if (!readAll(fd, reinterpret_cast<char*>(&size), sizeof(size))) {
+			return false;
+		}
+		message.resize(size);
+		return readAll(fd, message.data(), size);
+	}
+
+	enum ZygoteCommand : int32_t {
+		spawn_command = 1,
+		wait_command = 2,
+	};
+
+	struct ZygoteMessage {
+		int32_t command = 0;
+		int32_t pid = 0;
+	};
+
+	// The file descriptors travel as SCM_RIGHTS ancillary data of the message
+	static bool sendMessage(int socket, const ZygoteMessage& message, const int* fds, size_t fd_count) {
+		struct iovec data = { const_cast<ZygoteMessage*>(&message), sizeof(message) };
+		struct msghdr header = { };
+		header.msg_iov = &data;
+		header.msg_iovlen = 1;
+		alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * 2)];
+		if (fd_count > 0) {
+			header.msg_control = control;
+			header.msg_controllen = CMSG_SPACE(sizeof(int) * fd_count);
+			struct cmsghdr* control_header = CMSG_FIRSTHDR(&header);
+			control_header->cmsg_level = SOL_SOCKET;
+			control_header->cmsg_type = SCM_RIGHTS;
+			control_header->cmsg_len = CMSG_LEN(sizeof(int) * fd_count);
+			memcpy(CMSG_DATA(control_header), fds, sizeof(int) * fd_count);
+		}
+		while (true) {
+			ssize_t sent = sendmsg(socket, &header, 0);
+			if (sent < 0 && errno == EINTR) {
+				continue;
+			}
+			if (sent < 0) {
+				return false;
+			}
+			// the descriptors went with the first byte, the rest is plain data
+			const char* rest = reinterpret_cast<const char*>(&message) + sent;
+			return writeAll(socket, rest, sizeof(message) - sent);
+		}
+	}
+
+	static bool receiveMessage(int socket, ZygoteMessage& message, int* fds, size_t& fd_count) {
+		struct iovec data = { &message, sizeof(message) };
+		struct msghdr header = { };
+		header.msg_iov = &data;
+		header.msg_iovlen = 1;
+		alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * 2)];
+		header.msg_control = control;
+		header.msg_controllen = sizeof(control);
+		ssize_t received;
+		while ((received = recvmsg(socket, &header, 0)) < 0 && errno == EINTR) { }
+		if (received <= 0) {
+			return false;
+		}
+		fd_count = 0;
+		for (struct cmsghdr* control_header = CMSG_FIRSTHDR(&header); control_header; control_header = CMSG_NXTHDR(&header, control_header)) {
+			if (control_header->cmsg_level == SOL_SOCKET && control_header->cmsg_type == SCM_RIGHTS) {
+				size_t count = std::min<size_t>((control_header->cmsg_len - CMSG_LEN(0)) / sizeof(int), 2);
+				memcpy(fds, CMSG_DATA(control_header), sizeof(int) * count);
+				fd_count = count;
+			}
+		}
+		char* rest = reinterpret_cast<char*>(&message) + received;
+		return readAll(socket, rest, sizeof(message) - received);
+	}
+
+	IsolationPool::IsolationPool(TestModule& root, size_t worker_count) {
+		tests = root.getAllTests();
+		for (size_t i = 0; i < tests.size(); i++) {
+			test_indices[tests[i]] = static_cast<uint32_t>(i);
+		}
+		signal(SIGPIPE, SIG_IGN);
+		if (worker_count == 0) {
+			worker_count = std::max(1u, std::thread::hardware_concurrency());
+		}
+		int sockets[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0) {
+			std::cout.flush();
+			fflush(stdout);
+			pid_t pid = fork();
+			if (pid == 0) {
+				close(sockets[0]);
+				zygoteMain(sockets[1]);
+			}
+			close(sockets[1]);
+			if (pid > 0) {
+				zygote_pid = pid;
+				zygote_fd = sockets[0];
+			} else {
+				close(sockets[0]);
+			}
+		}
+		workers.resize(worker_count);
+		for (size_t i = 0; i < workers.size(); i++) {
+			spawn(workers[i]);
+			free_workers.push_back(i);
+		}
+	}
+
+	IsolationPool::~IsolationPool() {
+		for (Worker& worker : workers) {
+			stop(worker);
+		}
+		if (zygote_pid > 0) {
+			// the zygote exits when its socket closes
+			close(zygote_fd);
+			while (waitpid(zygote_pid, nullptr, 0) < 0 && errno == EINTR) { }
+		}
+	}
+
+	bool IsolationPool::isSupported() {
+		return true;
+	}
+
+	void IsolationPool::setWatchdog(Watchdog* watchdog) {
+		this->watchdog = watchdog;
+	}
+
+	void IsolationPool::run(Test* test) {
+		size_t index = acquireWorker();
+		Worker& worker = workers[index];
+		BinaryWriter request;
+		request.writeVarint(test_indices.at(test));
+		std::string response;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		size_t watch_id = 0;
+		if (watchdog && worker.pid > 0 && test->getTimeout() > std::chrono::nanoseconds::zero()) {
+			// the killed worker closes its pipe, which ends the read below
+			int pid = worker.pid;
+			watch_id = watchdog->watch(test->getTimeout(), false, [pid](const std::vector<std::string>&) {
+				kill(pid, SIGKILL);
+			});
+		}
+		bool received = worker.pid > 0
+			&& writeMessage(worker.request_fd, request.data)
+			&& readMessage(worker.response_fd, response);
+		test->timed_out = watch_id != 0 && !watchdog->cancel(watch_id);
+		test->resetErrors();
+		BinaryReader reader(response);
+		if (test->timed_out) {
+			stop(worker);
+			test->root_error->add(
+				"TIMEOUT after " + formatDuration(std::chrono::steady_clock::now() - start)
+				+ " (limit " + formatDuration(test->getTimeout()) + "), worker killed"
+			);
+			test->result = false;
+			test->wall_time = std::chrono::steady_clock::now() - start;
+			test->cpu_time = std::chrono::nanoseconds::zero();
+			spawn(worker);
+		} else if (!received || !test->readResults(reader)) {
+			test->resetErrors();
+			test->root_error->add(crashMessage(stop(worker)));
+			test->result = false;
+			test->wall_time = std::chrono::steady_clock::now() - start;
+			test->cpu_time = std::chrono::nanoseconds::zero();
+			spawn(worker);
+		}
+		test->is_run = true;
+		releaseWorker(index);
+	}
+
+	size_t IsolationPool::acquireWorker() {
+		std::unique_lock<std::mutex> lock(mutex);
+		free_cv.wait(lock, [&]() { return !free_workers.empty(); });
+		size_t index = free_workers.back();
+		free_workers.pop_back();
+		return index;
+	}
+
+	void IsolationPool::releaseWorker(size_t index) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			free_workers.push_back(index);
+		}
+		free_cv.notify_one();
+	}
+
+	bool IsolationPool::spawn(Worker& worker) {
+		int request_pipe[2];
+		int response_pipe[2];
+		if (pipe(request_pipe) != 0) {
+			return false;
+		}
+		if (pipe(response_pipe) != 0) {
+			close(request_pipe[0]);
+			close(request_pipe[1]);
+			return false;
+		}
+		// the zygote gets the worker's ends of the pipes, this process keeps the others
+		int worker_fds[2] = { request_pipe[0], response_pipe[1] };
+		int pid = zygoteRequest(spawn_command, 0, worker_fds, 2);
+		close(request_pipe[0]);
+		close(response_pipe[1]);
+		if (pid <= 0) {
+			close(request_pipe[1]);
+			close(response_pipe[0]);
+			return false;
+		}
+		worker.pid = pid;
+		worker.request_fd = request_pipe[1];
+		worker.response_fd = response_pipe[0];
+		return true;
+	}
+
+	int IsolationPool::stop(Worker& worker) {
+		if (worker.pid <= 0) {
+			return -1;
+		}
+		close(worker.request_fd);
+		close(worker.response_fd);
+		// workers are children of the zygote, which reaps them
+		int status = zygoteRequest(wait_command, worker.pid, nullptr, 0);
+		worker.pid = -1;
+		worker.request_fd = -1;
+		worker.response_fd = -1;
+		return status;
+	}
+
+	std::string IsolationPool::crashMessage(int status) {
+		if (status == -1) {
+			return "CRASHED: could not start worker process";
+		} else if (WIFSIGNALED(status)) {
+			int sig = WTERMSIG(status);
+			return "CRASHED: signal " + std::to_string(sig) + " (" + strsignal(sig) + ")";
+		} else if (WIFEXITED(status)) {
+			return "CRASHED: exit code " + std::to_string(WEXITSTATUS(status));
+		}
+		return "CRASHED";
+	}
+
+	int IsolationPool::zygoteRequest(int command, int pid, const int* fds, size_t fd_count) {
+		std::lock_guard<std::mutex> lock(zygote_mutex);
+		ZygoteMessage message;
+		message.command = command;
+		message.pid = pid;
+		int32_t reply = -1;
+		if (zygote_fd < 0 || !sendMessage(zygote_fd, message, fds, fd_count)
+			|| !readAll(zygote_fd, reinterpret_cast<char*>(&reply), sizeof(reply))) {
+			return -1;
+		}
+		return reply;
+	}
+
+	void IsolationPool::zygoteMain(int fd) {
+		Logger::disableStdWrite();
+		logger.manualDeactivate();
+		ZygoteMessage message;
+		int fds[2];
+		size_t fd_count = 0;
+		while (receiveMessage(fd, message, fds, fd_count)) {
+			int32_t reply = -1;
+			if (message.command == spawn_command && fd_count == 2) {
+				pid_t pid = fork();
+				if (pid == 0) {
+					close(fd);
+					workerMain(fds[0], fds[1]);
+				}
+				reply = pid;
+			} else if (message.command == wait_command) {
+				int status = -1;
+				while (waitpid(message.pid, &status, 0) < 0 && errno == EINTR) { }
+				reply = status;
+			}
+			for (size_t i = 0; i < fd_count; i++) {
+				close(fds[i]);
+			}
+			if (!writeAll(fd, reinterpret_cast<const char*>(&reply), sizeof(reply))) {
+				break;
+			}
+		}
+		// workers left over exit when the parent closes their pipes
+		while (wait(nullptr) > 0 || errno == EINTR) { }
+		_exit(0);
+	}
+
+	void IsolationPool::workerMain(int request_fd, int response_fd) {
+		Logger::disableStdWrite();
+		logger.manualDeactivate();
+		std::string request;
+		while (readMessage(request_fd, request)) {
+			BinaryReader reader(request);
+			uint64_t index;
+			if (!reader.readVarint(index) || index >= tests.size()) {
+				break;
+			}
+			Test* test = tests[index];
+			test->runInProcess();
+			BinaryWriter response;
+			test->writeResults(response);
+			if (!writeMessage(response_fd, response.data)) {
+				break;
+			}
+		}
+		_exit(0);
+	}
+
+#else
+
+	IsolationPool::IsolationPool(TestModule& root, size_t worker_count) { }
+
+	IsolationPool::~IsolationPool() { }
+
+	bool IsolationPool::isSupported() {
+		return false;
+	}
+
+	void IsolationPool::setWatchdog(Watchdog* watchdog) { }
+
+	void IsolationPool::run(Test* test) {
+		test->runInProcess();
+	}
+
+#endif
+
+	void BinaryWriter::writeVarint(uint64_t value) {
+		while (value >= 0x80) {
+			data += static_cast<char>((value & 0x7F) | 0x80);
+			value >>= 7;
+		}
+		data += static_cast<char>(value);
+	}
+
+	void BinaryWriter::writeDouble(double value) {
+		data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+	}
+
+	void BinaryWriter::writeString(std::string_view str) {
+		writeVarint(str.size());
+		data += str;
+	}
+
+	void BinaryWriter::writeError(const TestError& error) {
+		writeVarint(static_cast<uint64_t>(error.type) << 1 | (error.raw ? 1 : 0));
+		writeString(error.str);
+		writeVarint(error.subentries.size());
+		for (auto& subentry : error.subentries) {
+			writeError(*subentry);
+		}
+	}
+
+	BinaryReader::BinaryReader(const std::string& data) : data(data) { }
+
+	bool BinaryReader::readVarint(uint64_t& value) {
+		value = 0;
+		for (size_t shift = 0; shift < 64; shift += 7) {
+			if (pos >= data.size()) {
+				return false;
+			}
+			uint8_t byte = static_cast<uint8_t>(data[pos++]);
+			value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool BinaryReader::readDouble(double& value) {
+		if (data.size() - pos < sizeof(value)) {
+			return false;
+		}
+		memcpy(&value, data.data() + pos, sizeof(value));
+		pos += sizeof(value);
+		return true;
+	}
+
+	bool BinaryReader::readString(std::string& str) {
+		uint64_t size;
+		if (!readVarint(size) || size > data.size() - pos) {
+			return false;
+		}
+		str.assign(data, pos, size);
+		pos += size;
+		return true;
+	}
+
+	bool BinaryReader::readError(TestError& error) {
+		uint64_t header;
+		std::string str;
+		uint64_t count;
+		if (!readVarint(header) || !readString(str) || !readVarint(count)) {
+			return false;
+		}
+		error.type = static_cast<TestError::Type>(header >> 1);
+		error.raw = (header & 1) != 0;
+		error.str = error.arena->copyString(str);
+		for (uint64_t i = 0; i < count; i++) {
+			TestError* subentry = error.add("");
+			if (!readError(*subentry)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+}
@@ -0,0 +1,241 @@
+#include "test_lib/test.h"
+#include "test_lib/isolation.h"
+#include "test_lib/thread_pool.h"
+#include "test_lib/result_cache.h"
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+
+namespace test {
+
+	void copyErrors(const TestError& from, TestError* to) {
+		for (const TestError* subentry : from.subentries) {
+			TestError* copy = to->add(subentry->str, subentry->type);
+			copy->raw = subentry->raw;
+			copyErrors(*subentry, copy);
+		}
+	}
+
+	ParameterizedTest::ParameterizedTest(std::string name, std::vector<TestNode*> required, std::function<BatchSourceType()> open_source)
+	: Test(std::move(name), std::move(required), [](Test& test) {
+		static_cast<ParameterizedTest&>(test).runCases();
+	}) {
+		this->open_source = std::move(open_source);
+		this->kind = NodeKind::Parameterized;
+	}
+
+	std::string ParameterizedTest::getCasesString() const {
+		return std::to_string(passed_count) + "/" + std::to_string(case_count) + " cases passed";
+	}
+
+	void ParameterizedTest::runCases() {
+		case_count = 0;
+		passed_count = 0;
+		failed_count = 0;
+		listed_count = 0;
+		reserved_listings = 0;
+		summary_error = nullptr;
+		BatchSourceType source = open_source();
+		// a worker process of the isolation pool has a copy of the scheduler's pool, but not its threads
+		TestModule* root = parent ? parent->getRoot() : nullptr;
+		ThreadPool* pool = root && !root->isolation_pool ? ThreadPool::getCurrent() : nullptr;
+		// batches are generated a wave at a time, so only a few of them are in memory at once
+		size_t wave_size = pool ? pool->getThreadCount() * 2 : 1;
+		std::vector<std::unique_ptr<CaseRunner>> runners;
+		bool done = false;
+		while (!done) {
+			std::optional<TaskGroup> group;
+			if (pool) {
+				group.emplace(*pool);
+			}
+			size_t count = 0;
+			for (; count < wave_size; count++) {
+				BatchFuncType batch = source(batch_size);
+				if (!batch) {
+					done = true;
+					break;
+				}
+				if (runners.size() == count) {
+					runners.push_back(std::make_unique<CaseRunner>(*this));
+				}
+				CaseRunner* runner = runners[count].get();
+				if (group) {
+					group->run([runner, batch = std::move(batch)]() {
+						batch(*runner);
+					});
+				} else {
+					batch(*runner);
+				}
+			}
+			if (group) {
+				group->wait();
+			}
+			// merged in generation order, so the listed cases don't depend on scheduling
+			for (size_t i = 0; i < count; i++) {
+				mergeCases(*runners[i]);
+			}
+		}
+		case_count = passed_count + failed_count;
+		if (failed_count == 0) {
+			return;
+		}
+		result = false;
+		if (!summary_error) {
+			summary_error = root_error->add("");
+		}
+		if (listed_count < failed_count) {
+			summary_error->add(std::to_string(failed_count - listed_count) + " more failing cases not listed");
+		}
+		summary_error->str = summary_error->arena->copyString(getCasesString());
+	}
+
+	void ParameterizedTest::mergeCases(CaseRunner& runner) {
+		passed_count += runner.passed_count;
+		failed_count += runner.failed_count;
+		for (const TestError* failure : runner.failures.getRoot()->subentries) {
+			if (listed_count >= max_listed_failures) {
+				break;
+			}
+			if (!summary_error) {
+				summary_error = root_error->add("");
+			}
+			TestError* copy = summary_error->add(failure->str, failure->type);
+			copy->raw = failure->raw;
+			copyErrors(*failure, copy);
+			listed_count++;
+		}
+		root_error->arena->dropped_count += runner.failures.dropped_count;
+		runner.reset();
+	}
+
+	void ParameterizedTest::writeResults(BinaryWriter& writer) const {
+		Test::writeResults(writer);
+		writer.writeVarint(case_count);
+		writer.writeVarint(passed_count);
+	}
+
+	bool ParameterizedTest::readResults(BinaryReader& reader) {
+		if (!Test::readResults(reader)) {
+			return false;
+		}
+		uint64_t cases;
+		uint64_t passed;
+		if (!reader.readVarint(cases) || !reader.readVarint(passed)) {
+			return false;
+		}
+		case_count = cases;
+		passed_count = passed;
+		return true;
+	}
+
+	ParameterizedTest::CaseRunner::CaseRunner(ParameterizedTest& owner) : scratch(owner.name, TestFuncType()) {
+		this->owner = &owner;
+		scratch.parent = owner.parent;
+		// the owner test is the declared user, it finishes after all of its cases
+		scratch.fixtures = owner.fixtures;
+		scratch.max_error_entries = owner.max_error_entries;
+		scratch.resetErrors();
+		max_listed_failures = owner.max_listed_failures;
+		failures.max_entries = owner.max_error_entries;
+		if (failures.max_entries == 0 && owner.parent) {
+			failures.max_entries = owner.parent->getRoot()->max_error_entries;
+		}
+	}
+
+	bool ParameterizedTest::CaseRunner::reserveListing() {
+		// once a reservation fails all later ones fail too, so a reserved failure is also listed by fail()
+		return owner->reserved_listings.fetch_add(1, std::memory_order_relaxed) < owner->max_listed_failures;
+	}
+
+	void ParameterizedTest::CaseRunner::beginCase() {
+		// passing cases usually report nothing, so resetting can be skipped for them
+		if (!scratch.root_error->subentries.empty() || scratch.getDroppedErrorCount() > 0) {
+			scratch.resetErrors();
+		}
+		scratch.result = true;
+		scratch.raw_mode = false;
+		// every case gets its own instances of test scoped fixtures
+		if (!scratch.fixture_instances.empty()) {
+			scratch.fixture_instances.clear();
+		}
+	}
+
+	void ParameterizedTest::CaseRunner::addException(const std::exception& exc) {
+		scratch.getCurrentError()->add("EXCEPTION: " + std::string(exc.what()));
+		scratch.result = false;
+	}
+
+	void ParameterizedTest::CaseRunner::addFailure(size_t index, const std::string& value) {
+		std::string label = "Case #" + std::to_string(index);
+		if (!value.empty()) {
+			label += ": " + value;
+		}
+		TestError* error = failures.getRoot()->add(label);
+		copyErrors(*scratch.root_error, error);
+		failures.dropped_count += scratch.getDroppedErrorCount();
+	}
+
+	void ParameterizedTest::CaseRunner::reset() {
+		failures.release();
+		passed_count = 0;
+		failed_count = 0;
+	}
+
+	PropertyTest::PropertyTest(std::string name, std::vector<TestNode*> required, MakeBatchType make_batch)
+	: ParameterizedTest(std::move(name), std::move(required), [this]() -> BatchSourceType {
+		return [this, next_index = size_t(0)](size_t max_count) mutable {
+			if (next_index >= cases_per_run) {
+				return BatchFuncType();
+			}
+			size_t count = std::min(max_count, cases_per_run - next_index);
+			BatchFuncType batch = this->make_batch(*this, next_index, count);
+			next_index += count;
+			return batch;
+		};
+	}) {
+		this->make_batch = std::move(make_batch);
+		this->max_listed_failures = 1;
+	}
+
+	uint64_t PropertyTest::getSeed() const {
+		if (seed != 0) {
+			return seed;
+		}
+		if (parent && parent->getRoot()->seed != 0) {
+			return parent->getRoot()->seed;
+		}
+		return hashBytes(getPath());
+	}
+
+	std::string PropertyTest::getCasesString() const {
+		return ParameterizedTest::getCasesString() + ", seed " + std::to_string(getSeed());
+	}
+
+	FileLines::Iterator::Iterator(std::shared_ptr<std::istream> stream) {
+		this->stream = std::move(stream);
+		++*this;
+	}
+
+	FileLines::Iterator& FileLines::Iterator::operator++() {
+		if (!std::getline(*stream, line)) {
+			stream.reset();
+			line.clear();
+		} else if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		return *this;
+	}
+
+	FileLines::FileLines(std::filesystem::path path) {
+		this->path = std::move(path);
+	}
+
+	FileLines::Iterator FileLines::begin() const {
+		std::shared_ptr<std::ifstream> stream = std::make_shared<std::ifstream>(path);
+		if (!stream->is_open()) {
+			throw std::runtime_error("Could not open " + path.string());
+		}
+		return Iterator(stream);
+	}
+
+}
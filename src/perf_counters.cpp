@@ -0,0 +1,210 @@
+#include "test_lib/perf_counters.h"
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace test {
+
+	bool PerfCounters::isValid() const {
+		return available != 0;
+	}
+
+	bool PerfCounters::has(Counter counter) const {
+		return (available & (1u << counter)) != 0;
+	}
+
+	PerfCounters& PerfCounters::operator+=(const PerfCounters& other) {
+		available |= other.available;
+		cycles += other.cycles;
+		instructions += other.instructions;
+		cache_misses += other.cache_misses;
+		branch_misses += other.branch_misses;
+		page_faults += other.page_faults;
+		return *this;
+	}
+
+	std::string PerfCounters::toString() const {
+		if (!isValid()) {
+			return "no counters";
+		}
+		std::string result;
+		uint64_t values[CounterCount] = { cycles, instructions, cache_misses, branch_misses, page_faults };
+		for (size_t i = 0; i < CounterCount; i++) {
+			if (has(static_cast<Counter>(i))) {
+				result += (result.empty() ? "" : ", ") + std::string(getName(static_cast<Counter>(i))) + " " + std::to_string(values[i]);
+			}
+		}
+		if (has(Cycles) && has(Instructions) && cycles > 0) {
+			char ipc[32];
+			snprintf(ipc, sizeof(ipc), ", IPC %.2f", static_cast<double>(instructions) / cycles);
+			result += ipc;
+		}
+		return result;
+	}
+
+	const char* PerfCounters::getName(Counter counter) {
+		switch (counter) {
+			case Cycles: return "cycles";
+			case Instructions: return "instructions";
+			case CacheMisses: return "cache misses";
+			case BranchMisses: return "branch misses";
+			case PageFaults: return "page faults";
+			default: return "unknown";
+		}
+	}
+
+#ifdef __linux__
+
+	static int openCounter(uint32_t type, uint64_t config) {
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = type;
+		attr.config = config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+	}
+
+	PerfCounterGroup::PerfCounterGroup() {
+		openCounters();
+	}
+
+	PerfCounterGroup::~PerfCounterGroup() {
+		closeCounters();
+	}
+
+	void PerfCounterGroup::openCounters() {
+		pid = static_cast<int>(getpid());
+		error.clear();
+		const std::pair<uint32_t, uint64_t> events[PerfCounters::CounterCount] = {
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+			{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+		};
+		int open_error = 0;
+		for (size_t i = 0; i < PerfCounters::CounterCount; i++) {
+			fds[i] = openCounter(events[i].first, events[i].second);
+			if (fds[i] < 0) {
+				open_error = errno;
+				error += (error.empty() ? "" : ", ") + std::string(PerfCounters::getName(static_cast<PerfCounters::Counter>(i)));
+			}
+		}
+		if (!error.empty()) {
+			error += " unavailable (perf_event_open: " + std::string(strerror(open_error)) + ")";
+		}
+	}
+
+	void PerfCounterGroup::closeCounters() {
+		for (int& fd : fds) {
+			if (fd >= 0) {
+				close(fd);
+				fd = -1;
+			}
+		}
+	}
+
+	bool PerfCounterGroup::isAvailable() const {
+		for (int fd : fds) {
+			if (fd >= 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void PerfCounterGroup::start() {
+		for (int fd : fds) {
+			if (fd >= 0) {
+				ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+				ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+			}
+		}
+	}
+
+	void PerfCounterGroup::stop(PerfCounters& counters) {
+		uint64_t values[PerfCounters::CounterCount] = { };
+		for (int fd : fds) {
+			if (fd >= 0) {
+				ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+			}
+		}
+		counters = PerfCounters();
+		for (size_t i = 0; i < PerfCounters::CounterCount; i++) {
+			// value, time enabled, time running
+			uint64_t data[3];
+			if (fds[i] < 0 || read(fds[i], data, sizeof(data)) != sizeof(data)) {
+				continue;
+			}
+			// scale up when the kernel had to multiplex the counter
+			if (data[2] > 0 && data[2] < data[1]) {
+				values[i] = static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] / data[2]);
+			} else {
+				values[i] = data[0];
+			}
+			counters.available |= 1u << i;
+		}
+		counters.cycles = values[PerfCounters::Cycles];
+		counters.instructions = values[PerfCounters::Instructions];
+		counters.cache_misses = values[PerfCounters::CacheMisses];
+		counters.branch_misses = values[PerfCounters::BranchMisses];
+		counters.page_faults = values[PerfCounters::PageFaults];
+	}
+
+#else
+
+	PerfCounterGroup::PerfCounterGroup() {
+		openCounters();
+	}
+
+	PerfCounterGroup::~PerfCounterGroup() { }
+
+	void PerfCounterGroup::openCounters() {
+		for (int& fd : fds) {
+			fd = -1;
+		}
+		error = "hardware counters are only supported on Linux";
+	}
+
+	void PerfCounterGroup::closeCounters() { }
+
+	bool PerfCounterGroup::isAvailable() const {
+		return false;
+	}
+
+	void PerfCounterGroup::start() { }
+
+	void PerfCounterGroup::stop(PerfCounters& counters) {
+		counters = PerfCounters();
+	}
+
+#endif
+
+	const std::string& PerfCounterGroup::getError() const {
+		return error;
+	}
+
+	PerfCounterGroup& PerfCounterGroup::forCurrentThread() {
+		static thread_local PerfCounterGroup group;
+#ifdef __linux__
+		// inherited descriptors still count the thread of the parent process
+		if (group.pid != static_cast<int>(getpid())) {
+			group.closeCounters();
+			group.openCounters();
+		}
+#endif
+		return group;
+	}
+
+}
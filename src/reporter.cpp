@@ -0,0 +1,458 @@
+#include "test_lib/reporter.h"
+#include "test_lib/test.h"
+#include "logger/logger.h"
+#include <fstream>
+#include <map>
+#include <algorithm>
+#include <tuple>
+
+namespace test {
+
+	const char* getStatusString(const TestNode& node) {
+		const Test* test = node.asTest();
+		if (test && test->result && test->regressed) {
+			return "regressed";
+		}
+		if (test && test->result && test->cached) {
+			return "cached";
+		}
+		if (node.result) {
+			return "passed";
+		}
+		if (node.cancelled) {
+			return "cancelled";
+		}
+		if (test && test->timed_out) {
+			return "timeout";
+		}
+		return "failed";
+	}
+
+	static std::string getDisplayPath(const TestNode& node) {
+		return node.isRoot() ? node.name : node.getPath();
+	}
+
+	static std::string escapeXml(std::string_view str) {
+		std::string result;
+		result.reserve(str.size());
+		for (char c : str) {
+			switch (c) {
+				case '&': result += "&amp;"; break;
+				case '<': result += "&lt;"; break;
+				case '>': result += "&gt;"; break;
+				case '"': result += "&quot;"; break;
+				case '\'': result += "&apos;"; break;
+				case '\n': case '\t': case '\r': result += c; break;
+				default:
+					// other control characters are not allowed in XML 1.0, even escaped
+					if (static_cast<unsigned char>(c) < 0x20) {
+						result += Test::char_to_str(c);
+					} else {
+						result += c;
+					}
+			}
+		}
+		return result;
+	}
+
+	static std::string escapeJson(std::string_view str) {
+		std::string result;
+		result.reserve(str.size() + 2);
+		result += '"';
+		for (char c : str) {
+			switch (c) {
+				case '"': result += "\\\""; break;
+				case '\\': result += "\\\\"; break;
+				case '\n': result += "\\n"; break;
+				case '\t': result += "\\t"; break;
+				case '\r': result += "\\r"; break;
+				default:
+					if (static_cast<unsigned char>(c) < 0x20) {
+						char buffer[8];
+						snprintf(buffer, sizeof(buffer), "\\u%04x", static_cast<unsigned char>(c));
+						result += buffer;
+					} else {
+						result += c;
+					}
+			}
+		}
+		result += '"';
+		return result;
+	}
+
+	ReportFile::~ReportFile() {
+		close();
+	}
+
+	bool ReportFile::open(const std::filesystem::path& path) {
+		close();
+		file = fopen(path.string().c_str(), "wb");
+		flushed_size = 0;
+		buffer.reserve(buffer_size);
+		return file != nullptr;
+	}
+
+	bool ReportFile::isOpen() const {
+		return file != nullptr;
+	}
+
+	void ReportFile::write(std::string_view str) {
+		if (!file) {
+			return;
+		}
+		if (buffer.size() + str.size() > buffer_size) {
+			flush();
+		}
+		buffer += str;
+	}
+
+	size_t ReportFile::getSize() const {
+		return flushed_size + buffer.size();
+	}
+
+	void ReportFile::overwrite(size_t offset, std::string_view str) {
+		if (!file) {
+			return;
+		}
+		flush();
+		fseek(file, static_cast<long>(offset), SEEK_SET);
+		fwrite(str.data(), 1, str.size(), file);
+		fseek(file, 0, SEEK_END);
+	}
+
+	void ReportFile::flush() {
+		if (!file) {
+			return;
+		}
+		fwrite(buffer.data(), 1, buffer.size(), file);
+		fflush(file);
+		flushed_size += buffer.size();
+		buffer.clear();
+	}
+
+	void ReportFile::close() {
+		if (!file) {
+			return;
+		}
+		flush();
+		fclose(file);
+		file = nullptr;
+	}
+
+	JUnitReporter::JUnitReporter(const std::filesystem::path& path) {
+		this->path = path;
+	}
+
+	void JUnitReporter::onModuleStart(const TestModule& module) {
+		if (!module.isRoot()) {
+			return;
+		}
+		if (!file.open(path)) {
+			logger << "WARNING: could not open report file " << path.string() << "\n";
+			return;
+		}
+		std::string name = escapeXml(module.name);
+		file.write("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+		file.write("<testsuites name=\"" + name + "\">\n");
+		file.write("\t<testsuite name=\"" + name + "\"");
+		// reserved whitespace inside the tag, the counts are patched into it at the end without rewriting the file
+		counts_offset = file.getSize();
+		file.write(std::string(counts_size, ' ') + ">\n");
+		test_count = 0;
+		failure_count = 0;
+		skipped_count = 0;
+	}
+
+	void JUnitReporter::onModuleEnd(const TestModule& module) {
+		if (!module.isRoot()) {
+			return;
+		}
+		file.write("\t</testsuite>\n");
+		file.write("</testsuites>\n");
+		std::string counts = " tests=\"" + std::to_string(test_count) + "\" failures=\"" + std::to_string(failure_count)
+			+ "\" skipped=\"" + std::to_string(skipped_count) + "\"";
+		if (counts.size() <= counts_size) {
+			file.overwrite(counts_offset, counts);
+		}
+		file.close();
+	}
+
+	void JUnitReporter::onTestStart(const Test&) {
+		failure_text.clear();
+		file.flush();
+	}
+
+	void JUnitReporter::onTestError(const Test&, const TestError& error, size_t depth) {
+		failure_text += std::string(depth * 4, ' ') + std::string(error.str) + "\n";
+	}
+
+	void JUnitReporter::onTestEnd(const Test& test) {
+		char time[32];
+		snprintf(time, sizeof(time), "%.6f", std::chrono::duration<double>(test.wall_time).count());
+		std::string class_name = test.parent ? getDisplayPath(*test.parent) : "";
+		file.write(
+			"\t\t<testcase classname=\"" + escapeXml(class_name) + "\" name=\"" + escapeXml(test.name)
+			+ "\" time=\"" + time + "\""
+		);
+		std::string status = getStatusString(test);
+		test_count++;
+		if (status == "passed" || status == "cached") {
+			file.write("/>\n");
+			return;
+		}
+		file.write(">\n");
+		if (status == "cancelled") {
+			skipped_count++;
+			file.write("\t\t\t<skipped message=\"cancelled\"/>\n");
+			file.write("\t\t</testcase>\n");
+			return;
+		}
+		failure_count++;
+		if (status == "regressed") {
+			file.write("\t\t\t<failure message=\"REGRESSED\" type=\"regression\"/>\n");
+		} else if (status == "timeout") {
+			file.write("\t\t\t<failure message=\"TIMEOUT\" type=\"timeout\">" + escapeXml(failure_text) + "</failure>\n");
+		} else {
+			file.write("\t\t\t<failure message=\"FAILED\">" + escapeXml(failure_text) + "</failure>\n");
+		}
+		file.write("\t\t</testcase>\n");
+	}
+
+	JsonLinesReporter::JsonLinesReporter(const std::filesystem::path& path) {
+		this->path = path;
+	}
+
+	void JsonLinesReporter::onModuleStart(const TestModule& module) {
+		if (module.isRoot() && !file.open(path)) {
+			logger << "WARNING: could not open report file " << path.string() << "\n";
+			return;
+		}
+		file.write("{\"event\":\"module_start\",\"path\":" + escapeJson(getDisplayPath(module)) + "}\n");
+	}
+
+	void JsonLinesReporter::onModuleEnd(const TestModule& module) {
+		file.write(
+			"{\"event\":\"module_end\",\"path\":" + escapeJson(getDisplayPath(module))
+			+ ",\"status\":\"" + getStatusString(module) + "\""
+			+ ",\"passed\":" + std::to_string(module.getResultCount(ResultStore::Passed))
+			+ ",\"failed\":" + std::to_string(module.getResultCount(ResultStore::Failed))
+			+ ",\"cancelled\":" + std::to_string(module.getResultCount(ResultStore::Cancelled))
+			+ ",\"regressed\":" + std::to_string(module.getResultCount(ResultStore::Regressed))
+			+ ",\"wall_ns\":" + std::to_string(module.wall_time.count())
+			+ "}\n"
+		);
+		if (module.isRoot()) {
+			file.close();
+		}
+	}
+
+	void JsonLinesReporter::onTestStart(const Test& test) {
+		file.write("{\"event\":\"test_start\",\"path\":" + escapeJson(getDisplayPath(test)) + "}\n");
+		file.flush();
+	}
+
+	void JsonLinesReporter::onTestError(const Test& test, const TestError& error, size_t depth) {
+		file.write(
+			"{\"event\":\"error\",\"path\":" + escapeJson(getDisplayPath(test))
+			+ ",\"depth\":" + std::to_string(depth) + ",\"message\":" + escapeJson(error.str) + "}\n"
+		);
+	}
+
+	void JsonLinesReporter::onTestEnd(const Test& test) {
+		std::string line = "{\"event\":\"test_end\",\"path\":" + escapeJson(getDisplayPath(test))
+			+ ",\"status\":\"" + getStatusString(test) + "\""
+			+ ",\"wall_ns\":" + std::to_string(test.wall_time.count())
+			+ ",\"cpu_ns\":" + std::to_string(test.cpu_time.count());
+		if (test.allocation_stats.available) {
+			line += ",\"allocations\":" + std::to_string(test.allocation_stats.allocations)
+				+ ",\"allocated_bytes\":" + std::to_string(test.allocation_stats.allocated_bytes)
+				+ ",\"peak_live_bytes\":" + std::to_string(test.allocation_stats.peak_live_bytes);
+		}
+		if (test.getDroppedErrorCount() > 0) {
+			line += ",\"dropped_errors\":" + std::to_string(test.getDroppedErrorCount());
+		}
+		const Benchmark* benchmark = test.asBenchmark();
+		if (benchmark && benchmark->hasStats()) {
+			char buffer[96];
+			snprintf(
+				buffer, sizeof(buffer), ",\"median_ns\":%.3f,\"iterations_per_second\":%.3f",
+				benchmark->median_time.count(), benchmark->getIterationsPerSecond()
+			);
+			line += buffer;
+		}
+		file.write(line + "}\n");
+	}
+
+	// value of a top level string field in a line written by JsonLinesReporter
+	static bool findJsonString(std::string_view line, std::string_view key, std::string& value) {
+		std::string pattern = "\"" + std::string(key) + "\":\"";
+		size_t pos = line.find(pattern);
+		if (pos == std::string_view::npos) {
+			return false;
+		}
+		value.clear();
+		for (pos += pattern.size(); pos < line.size(); pos++) {
+			char c = line[pos];
+			if (c == '"') {
+				return true;
+			}
+			if (c != '\\' || pos + 1 >= line.size()) {
+				value += c;
+				continue;
+			}
+			c = line[++pos];
+			switch (c) {
+				case 'n': value += '\n'; break;
+				case 't': value += '\t'; break;
+				case 'r': value += '\r'; break;
+				case 'u':
+					// only control characters are written as \u escapes
+					if (pos + 4 < line.size()) {
+						value += static_cast<char>(std::strtoul(std::string(line.substr(pos + 1, 4)).c_str(), nullptr, 16));
+						pos += 4;
+					}
+					break;
+				default: value += c;
+			}
+		}
+		return false;
+	}
+
+	static long long findJsonInteger(std::string_view line, std::string_view key) {
+		std::string pattern = "\"" + std::string(key) + "\":";
+		size_t pos = line.find(pattern);
+		if (pos == std::string_view::npos) {
+			return 0;
+		}
+		return std::strtoll(std::string(line.substr(pos + pattern.size(), 24)).c_str(), nullptr, 10);
+	}
+
+	// rank of a status when a test is in several reports, failures win over everything else
+	static int getStatusSeverity(std::string_view status) {
+		if (status == "passed" || status == "cached") {
+			return 0;
+		}
+		if (status == "cancelled") {
+			return 1;
+		}
+		if (status == "regressed") {
+			return 2;
+		}
+		return 3;
+	}
+
+	bool mergeJsonLinesReports(const std::vector<std::filesystem::path>& files, size_t slowest_count) {
+		struct Result {
+			std::string status;
+			std::chrono::nanoseconds wall_time = std::chrono::nanoseconds(0);
+			std::chrono::nanoseconds cpu_time = std::chrono::nanoseconds(0);
+
+			auto getRank() const {
+				return std::make_tuple(getStatusSeverity(status), wall_time, cpu_time, std::string_view(status));
+			}
+		};
+		// by path, so the merged output doesn't depend on the order of the files
+		std::map<std::string, Result> results;
+		std::map<std::string, Result> file_results;
+		bool read_all = true;
+		std::string line;
+		std::string event;
+		std::string path;
+		for (const std::filesystem::path& file_path : files) {
+			std::ifstream file(file_path);
+			if (!file) {
+				logger << "ERROR: could not open report file " << file_path.string() << "\n";
+				read_all = false;
+				continue;
+			}
+			file_results.clear();
+			while (std::getline(file, line)) {
+				if (!findJsonString(line, "event", event) || !findJsonString(line, "path", path)) {
+					continue;
+				}
+				if (event == "test_start") {
+					file_results[path].status = "failed";
+				} else if (event == "test_end") {
+					Result& result = file_results[path];
+					findJsonString(line, "status", result.status);
+					result.wall_time = std::chrono::nanoseconds(findJsonInteger(line, "wall_ns"));
+					result.cpu_time = std::chrono::nanoseconds(findJsonInteger(line, "cpu_ns"));
+				}
+			}
+			// a test in several reports keeps its worst result, ties go to the slower run
+			for (auto& [test_path, result] : file_results) {
+				auto [it, inserted] = results.try_emplace(test_path, result);
+				if (!inserted && result.getRank() > it->second.getRank()) {
+					it->second = result;
+				}
+			}
+		}
+		size_t passed_count = 0;
+		size_t cancelled_count = 0;
+		size_t failed_count = 0;
+		size_t regressed_count = 0;
+		for (auto& [test_path, result] : results) {
+			if (result.status == "passed" || result.status == "cached") {
+				passed_count++;
+			} else if (result.status == "cancelled") {
+				cancelled_count++;
+			} else if (result.status == "regressed") {
+				regressed_count++;
+			} else {
+				failed_count++;
+			}
+		}
+		logger << "Merged " << files.size() << " reports\n";
+		logger << "Passed " << passed_count << " tests, "
+			<< "cancelled " << cancelled_count << " tests, "
+			<< "failed " << failed_count << " tests";
+		if (regressed_count > 0) {
+			logger << ", regressed " << regressed_count << " tests";
+		}
+		if (failed_count > 0 || regressed_count > 0) {
+			logger << ":\n";
+			LoggerIndent failed_list_indent;
+			for (auto& [test_path, result] : results) {
+				if (result.status == "failed" || result.status == "timeout") {
+					logger << test_path << (result.status == "timeout" ? " (TIMEOUT)" : "") << "\n";
+				}
+			}
+			for (auto& [test_path, result] : results) {
+				if (result.status == "regressed") {
+					logger << test_path << " (REGRESSED)\n";
+				}
+			}
+		} else {
+			logger << "\n";
+		}
+		std::vector<std::pair<const std::string*, const Result*>> slowest;
+		for (auto& [test_path, result] : results) {
+			if (result.status != "cached" && result.wall_time.count() > 0) {
+				slowest.push_back({ &test_path, &result });
+			}
+		}
+		size_t count = std::min(slowest_count, slowest.size());
+		if (count > 0) {
+			std::partial_sort(slowest.begin(), slowest.begin() + count, slowest.end(), [](const auto& left, const auto& right) {
+				return left.second->wall_time > right.second->wall_time;
+			});
+			size_t max_path = 0;
+			for (size_t i = 0; i < count; i++) {
+				max_path = std::max(max_path, slowest[i].first->size());
+			}
+			logger << "Slowest tests:\n";
+			LoggerIndent slowest_list_indent;
+			for (size_t i = 0; i < count; i++) {
+				std::string spacing_str(max_path - slowest[i].first->size(), ' ');
+				logger << *slowest[i].first << spacing_str << " "
+					<< formatDuration(slowest[i].second->wall_time) << " (cpu " << formatDuration(slowest[i].second->cpu_time) << ")\n";
+			}
+		}
+		bool all_passed = read_all && passed_count > 0 && cancelled_count == 0 && failed_count == 0 && regressed_count == 0;
+		if (all_passed) {
+			logger << "ALL PASSED\n";
+		}
+		return all_passed;
+	}
+
+}
@@ -0,0 +1,154 @@
+#include "test_lib/result_cache.h"
+#include "test_lib/test.h"
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <functional>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace test {
+
+	bool ResultCache::load(const std::filesystem::path& path) {
+		std::ifstream file(path);
+		if (!file) {
+			return false;
+		}
+		entries.clear();
+		std::string line;
+		while (std::getline(file, line)) {
+			size_t first_tab = line.find('\t');
+			size_t second_tab = line.find('\t', first_tab + 1);
+			if (first_tab == std::string::npos || second_tab == std::string::npos) {
+				continue;
+			}
+			Entry entry;
+			entry.fingerprint = std::strtoull(line.substr(first_tab + 1, second_tab - first_tab - 1).c_str(), nullptr, 16);
+			entry.passed = line.substr(second_tab + 1) == "passed";
+			entries[line.substr(0, first_tab)] = entry;
+		}
+		return true;
+	}
+
+	bool ResultCache::save(const std::filesystem::path& path) const {
+		std::filesystem::path temp_path = path;
+		temp_path += ".tmp";
+		{
+			std::ofstream file(temp_path, std::ios::trunc);
+			if (!file) {
+				return false;
+			}
+			for (auto& [test_path, entry] : entries) {
+				file << test_path << "\t" << std::hex << entry.fingerprint << std::dec << "\t"
+					<< (entry.passed ? "passed" : "failed") << "\n";
+			}
+			if (!file) {
+				return false;
+			}
+		}
+		std::error_code error;
+		std::filesystem::rename(temp_path, path, error);
+		return !error;
+	}
+
+	const ResultCache::Entry* ResultCache::find(const std::string& test_path) const {
+		auto it = entries.find(test_path);
+		if (it == entries.end()) {
+			return nullptr;
+		}
+		return &it->second;
+	}
+
+	void ResultCache::record(const std::string& test_path, uint64_t fingerprint, bool passed) {
+		entries[test_path] = { fingerprint, passed };
+	}
+
+	uint64_t hashBytes(std::string_view data, uint64_t hash) {
+		for (char c : data) {
+			hash ^= static_cast<unsigned char>(c);
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	uint64_t hashFile(const std::filesystem::path& path) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file) {
+			return 0;
+		}
+		uint64_t hash = hashBytes("");
+		char buffer[64 * 1024];
+		while (file) {
+			file.read(buffer, sizeof(buffer));
+			hash = hashBytes(std::string_view(buffer, file.gcount()), hash);
+		}
+		return hash;
+	}
+
+	uint64_t getBinaryFingerprint() {
+		static const uint64_t fingerprint = []() -> uint64_t {
+#if defined(_WIN32)
+			wchar_t path[MAX_PATH];
+			DWORD length = GetModuleFileNameW(nullptr, path, MAX_PATH);
+			if (length == 0 || length == MAX_PATH) {
+				return 0;
+			}
+			return hashFile(std::filesystem::path(path));
+#elif defined(__linux__)
+			return hashFile("/proc/self/exe");
+#else
+			return 0;
+#endif
+		}();
+		return fingerprint;
+	}
+
+	void computeFingerprints(TestModule& root, bool use_binary) {
+		uint64_t seed = hashBytes("");
+		if (use_binary) {
+			uint64_t binary = getBinaryFingerprint();
+			seed = hashBytes(std::string_view(reinterpret_cast<const char*>(&binary), sizeof(binary)), seed);
+		}
+		std::unordered_map<std::string, uint64_t> file_hashes;
+		auto hash_value = [](uint64_t hash, uint64_t value) {
+			return hashBytes(std::string_view(reinterpret_cast<const char*>(&value), sizeof(value)), hash);
+		};
+		// a test in the map with no value yet is being computed, which means a cycle
+		std::unordered_map<Test*, uint64_t> done;
+		std::function<uint64_t(Test*)> compute = [&](Test* test) -> uint64_t {
+			auto [it, inserted] = done.try_emplace(test, 0);
+			if (!inserted) {
+				return it->second;
+			}
+			uint64_t hash = hashBytes(test->getPath(), seed);
+			for (const TestNode* node = test; node; node = node->parent) {
+				hash = hashBytes(node->version, hash);
+				for (const std::filesystem::path& input_file : node->input_files) {
+					auto [file_it, file_inserted] = file_hashes.try_emplace(input_file.string(), 0);
+					if (file_inserted) {
+						file_it->second = hashFile(input_file);
+					}
+					hash = hash_value(hash, file_it->second);
+				}
+				for (TestNode* req_node : node->required_nodes) {
+					if (Test* req_test = req_node->asTest()) {
+						hash = hash_value(hash, compute(req_test));
+					} else if (TestModule* req_module = req_node->asModule()) {
+						for (Test* module_test : req_module->getAllTests()) {
+							hash = hash_value(hash, compute(module_test));
+						}
+					}
+				}
+			}
+			done[test] = hash;
+			test->fingerprint = hash;
+			return hash;
+		};
+		for (Test* test : root.getAllTests()) {
+			compute(test);
+		}
+	}
+
+}
@@ -0,0 +1,158 @@
+#include "test_lib/scheduler.h"
+#include "test_lib/test.h"
+
+namespace test {
+
+	Scheduler::Task::Task(Kind kind, TestNode* node, Task* gate) {
+		this->kind = kind;
+		this->node = node;
+		this->gate = gate;
+	}
+
+	Scheduler::Scheduler(TestModule& root, size_t thread_count) : root(root), pool(thread_count) {
+		addModule(&root, nullptr);
+		addEdges();
+	}
+
+	void Scheduler::run() {
+		runBeforeHooks(&root);
+		{
+			// collected before any task runs, a finishing task would otherwise make
+			// its dependents look ready here too and they'd be submitted twice
+			std::vector<Task*> ready_tasks;
+			for (Task& task : tasks) {
+				if (task.pending_count.load(std::memory_order_relaxed) == 0) {
+					ready_tasks.push_back(&task);
+				}
+			}
+			TaskGroup group(pool);
+			for (Task* ptr : ready_tasks) {
+				group.run([this, ptr, &group]() { execute(ptr, group); });
+			}
+			group.wait();
+		}
+		// nodes left unfinished are part of a dependency cycle
+		for (Task& task : tasks) {
+			if (!task.finished) {
+				if (task.kind == Task::Kind::Test) {
+					task.node->cancelled = true;
+				} else if (task.kind == Task::Kind::ModuleDone) {
+					task.node->result = false;
+				}
+			}
+		}
+		runAfterHooks(&root);
+	}
+
+	void Scheduler::addModule(TestModule* module, Task* parent_gate) {
+		Task* gate = &tasks.emplace_back(Task::Kind::ModuleGate, module, parent_gate);
+		Task* done = &tasks.emplace_back(Task::Kind::ModuleDone, module, gate);
+		gate_tasks[module] = gate;
+		done_tasks[module] = done;
+		for (TestNode* node : module->children) {
+			if (!node->selected) {
+				continue;
+			}
+			if (Test* test = node->asTest()) {
+				done_tasks[test] = &tasks.emplace_back(Task::Kind::Test, test, gate);
+			} else if (TestModule* child_module = node->asModule()) {
+				addModule(child_module, gate);
+			}
+		}
+	}
+
+	void Scheduler::addEdges() {
+		for (Task& task : tasks) {
+			if (task.gate) {
+				addEdge(task.gate, &task);
+			}
+			if (task.kind == Task::Kind::ModuleDone) {
+				TestModule* module = static_cast<TestModule*>(task.node);
+				for (TestNode* child : module->children) {
+					if (child->selected) {
+						addEdge(done_tasks[child], &task);
+					}
+				}
+			} else {
+				for (TestNode* req_node : task.node->required_nodes) {
+					auto it = done_tasks.find(req_node);
+					if (it != done_tasks.end()) {
+						addEdge(it->second, &task);
+					}
+				}
+			}
+		}
+	}
+
+	void Scheduler::addEdge(Task* prerequisite, Task* task) {
+		prerequisite->dependents.push_back(task);
+		task->pending_count.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void Scheduler::execute(Task* task, TaskGroup& group) {
+		switch (task->kind) {
+			case Task::Kind::Test: {
+				Test* test = static_cast<Test*>(task->node);
+				if (task->gate->cancelled) {
+					test->cancel();
+				} else {
+					TestModule* module = test->parent;
+					module->OnBeforeRunTest();
+					test->run();
+					module->OnAfterRunTest();
+				}
+				break;
+			}
+			case Task::Kind::ModuleGate: {
+				task->cancelled = task->gate && task->gate->cancelled;
+				for (TestNode* req_node : task->node->required_nodes) {
+					if (!req_node->result) {
+						task->cancelled = true;
+						break;
+					}
+				}
+				break;
+			}
+			case Task::Kind::ModuleDone: {
+				TestModule* module = static_cast<TestModule*>(task->node);
+				bool result = !task->gate->cancelled;
+				for (TestNode* child : module->children) {
+					if (child->selected && !child->result) {
+						result = false;
+						break;
+					}
+				}
+				module->result = result;
+				break;
+			}
+		}
+		task->finished = true;
+		for (Task* dependent : task->dependents) {
+			if (dependent->pending_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+				group.run([this, dependent, &group]() { execute(dependent, group); });
+			}
+		}
+	}
+
+	void Scheduler::runBeforeHooks(TestModule* module) {
+		module->beforeRunModule();
+		module->OnBeforeRun();
+		for (TestModule* child_module : module->getChildModules()) {
+			if (child_module->selected) {
+				runBeforeHooks(child_module);
+			}
+		}
+	}
+
+	void Scheduler::runAfterHooks(TestModule* module) {
+		for (TestModule* child_module : module->getChildModules()) {
+			if (child_module->selected) {
+				runAfterHooks(child_module);
+			}
+		}
+		module->afterRunModule();
+		module->OnAfterRun();
+		module->tearDownFixtures(false);
+	}
+
+}
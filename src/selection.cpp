@@ -0,0 +1,365 @@
+#include "test_lib/selection.h"
+#include "test_lib/test.h"
+#include "test_lib/baseline.h"
+#include <algorithm>
+#include <map>
+#include <regex>
+
+namespace test {
+
+	// the path itself or one of its modules
+	static bool matchPathOrModule(std::string_view pattern, std::string_view path) {
+		bool matched = matchGlob(pattern, path);
+		for (size_t pos = path.find('/'); !matched && pos != std::string_view::npos; pos = path.find('/', pos + 1)) {
+			matched = matchGlob(pattern, path.substr(0, pos));
+		}
+		return matched;
+	}
+
+	void TestSelection::include(std::string_view glob) {
+		filters.push_back({ Kind::Glob, false, std::string(glob), nullptr });
+	}
+
+	void TestSelection::exclude(std::string_view glob) {
+		filters.push_back({ Kind::Glob, true, std::string(glob), nullptr });
+	}
+
+	void TestSelection::includeRegex(std::string_view regex) {
+		filters.push_back({ Kind::Regex, false, std::string(regex), nullptr });
+	}
+
+	void TestSelection::excludeRegex(std::string_view regex) {
+		filters.push_back({ Kind::Regex, true, std::string(regex), nullptr });
+	}
+
+	void TestSelection::includeTag(std::string_view tag) {
+		filters.push_back({ Kind::Tag, false, std::string(tag), nullptr });
+	}
+
+	void TestSelection::excludeTag(std::string_view tag) {
+		filters.push_back({ Kind::Tag, true, std::string(tag), nullptr });
+	}
+
+	bool TestSelection::isEmpty() const {
+		return filters.empty();
+	}
+
+	void TestSelection::clear() {
+		filters.clear();
+	}
+
+	void TestSelection::invalidateIndex() {
+		index_valid = false;
+	}
+
+	size_t TestSelection::apply(TestModule& root) {
+		if (!index_valid) {
+			buildIndex(root);
+		}
+		bool has_include = std::any_of(filters.begin(), filters.end(), [](const Filter& filter) {
+			return !filter.exclude;
+		});
+		for (IndexEntry& entry : index) {
+			entry.test->selected = !has_include;
+		}
+		std::vector<Test*> matches;
+		for (Filter& filter : filters) {
+			if (!filter.exclude) {
+				collectMatches(filter, matches);
+			}
+		}
+		for (Test* test : matches) {
+			test->selected = true;
+		}
+		matches.clear();
+		for (Filter& filter : filters) {
+			if (filter.exclude) {
+				collectMatches(filter, matches);
+			}
+		}
+		for (Test* test : matches) {
+			test->selected = false;
+		}
+		// pull in prerequisites of selected tests and of their modules
+		std::vector<Test*> stack;
+		for (IndexEntry& entry : index) {
+			if (entry.test->selected) {
+				stack.push_back(entry.test);
+			}
+		}
+		auto select = [&](Test* test) {
+			if (!test->selected) {
+				test->selected = true;
+				stack.push_back(test);
+			}
+		};
+		while (!stack.empty()) {
+			Test* test = stack.back();
+			stack.pop_back();
+			for (TestNode* node = test; node; node = node->parent) {
+				for (TestNode* req_node : node->required_nodes) {
+					if (Test* req_test = req_node->asTest()) {
+						select(req_test);
+					} else if (TestModule* req_module = req_node->asModule()) {
+						for (Test* module_test : req_module->getAllTests()) {
+							select(module_test);
+						}
+					}
+				}
+			}
+		}
+		// without filters empty modules stay selected, so they are still reported
+		return selectModules(filters.empty());
+	}
+
+	bool TestSelection::mayMatch(std::string_view path, bool is_module) {
+		std::string module_prefix = is_module ? std::string(path) + "/" : std::string();
+		bool has_include = false;
+		bool included = false;
+		for (Filter& filter : filters) {
+			if (filter.exclude) {
+				// an excluded module excludes everything inside
+				if (filter.kind == Kind::Glob && matchPathOrModule(filter.pattern, path)) {
+					return false;
+				}
+				if (filter.kind == Kind::Regex && !is_module && std::regex_search(path.begin(), path.end(), getRegex(filter))) {
+					return false;
+				}
+				continue;
+			}
+			has_include = true;
+			switch (filter.kind) {
+				case Kind::Glob: {
+					std::string_view pattern = filter.pattern;
+					std::string_view prefix = pattern.substr(0, pattern.find_first_of("*?"));
+					// paths inside the module start with its path, matches of the glob with its literal prefix
+					included |= matchPathOrModule(pattern, path)
+						|| (is_module && (prefix.starts_with(module_prefix) || module_prefix.starts_with(prefix)));
+					break;
+				}
+				case Kind::Regex:
+					included |= is_module || std::regex_search(path.begin(), path.end(), getRegex(filter));
+					break;
+				case Kind::Tag:
+					included = true;
+					break;
+			}
+		}
+		return !has_include || included;
+	}
+
+	size_t TestSelection::selectModules(bool keep_empty) {
+		for (TestModule* module : modules) {
+			module->selected = keep_empty;
+		}
+		size_t count = 0;
+		for (IndexEntry& entry : index) {
+			if (!entry.test->selected) {
+				continue;
+			}
+			count++;
+			for (TestModule* module = entry.test->parent; module && !module->selected; module = module->parent) {
+				module->selected = true;
+			}
+		}
+		root->selected = true;
+		return count;
+	}
+
+	size_t TestSelection::applyShard(size_t shard_index, size_t shard_count, const Baseline* timings) {
+		// union-find over index positions, joined along required_nodes
+		std::vector<size_t> group_of(index.size());
+		for (size_t i = 0; i < index.size(); i++) {
+			group_of[i] = i;
+		}
+		auto find = [&](size_t i) {
+			while (group_of[i] != i) {
+				group_of[i] = group_of[group_of[i]];
+				i = group_of[i];
+			}
+			return i;
+		};
+		std::unordered_map<const Test*, size_t> positions;
+		for (size_t i = 0; i < index.size(); i++) {
+			positions[index[i].test] = i;
+		}
+		auto join = [&](size_t position, const Test* other) {
+			size_t left = find(position);
+			size_t right = find(positions.at(other));
+			// the smaller position becomes the representative, which keeps the grouping deterministic
+			if (left < right) {
+				group_of[right] = left;
+			} else if (right < left) {
+				group_of[left] = right;
+			}
+		};
+		for (size_t i = 0; i < index.size(); i++) {
+			for (TestNode* node = index[i].test; node; node = node->parent) {
+				for (TestNode* req_node : node->required_nodes) {
+					if (Test* req_test = req_node->asTest()) {
+						join(i, req_test);
+					} else if (TestModule* req_module = req_node->asModule()) {
+						for (Test* module_test : req_module->getAllTests()) {
+							join(i, module_test);
+						}
+					}
+				}
+			}
+		}
+		// negative for tests without a known duration
+		std::vector<double> weights(index.size(), -1.0);
+		double known_sum = 0.0;
+		size_t known_count = 0;
+		for (size_t i = 0; i < index.size(); i++) {
+			const std::vector<double>* samples = timings ? timings->find(index[i].path) : nullptr;
+			if (Benchmark* benchmark = index[i].test->asBenchmark()) {
+				// baseline samples of benchmarks are per iteration, estimate the run time from the settings
+				std::chrono::nanoseconds estimate = benchmark->warmup_time + benchmark->sample_time * benchmark->sample_count;
+				weights[i] = static_cast<double>(std::min(estimate, benchmark->max_time).count());
+			} else if (samples && !samples->empty()) {
+				weights[i] = median(*samples);
+			} else {
+				continue;
+			}
+			known_sum += weights[i];
+			known_count++;
+		}
+		double default_weight = known_count > 0 ? known_sum / known_count : 1.0;
+		struct Group {
+			double weight = 0.0;
+			std::vector<size_t> members;
+		};
+		std::map<size_t, Group> groups;
+		for (size_t i = 0; i < index.size(); i++) {
+			if (!index[i].test->selected) {
+				continue;
+			}
+			Group& group = groups[find(i)];
+			group.weight += weights[i] >= 0.0 ? weights[i] : default_weight;
+			group.members.push_back(i);
+		}
+		// groups are keyed by their first index position, so ties keep path order
+		std::vector<Group*> order;
+		for (auto& [first, group] : groups) {
+			order.push_back(&group);
+		}
+		std::stable_sort(order.begin(), order.end(), [](const Group* left, const Group* right) {
+			return left->weight > right->weight;
+		});
+		std::vector<double> loads(shard_count, 0.0);
+		for (Group* group : order) {
+			size_t shard = std::min_element(loads.begin(), loads.end()) - loads.begin();
+			loads[shard] += group->weight;
+			if (shard != shard_index) {
+				for (size_t member : group->members) {
+					index[member].test->selected = false;
+				}
+			}
+		}
+		return selectModules(false);
+	}
+
+	void TestSelection::buildIndex(TestModule& root) {
+		this->root = &root;
+		index.clear();
+		modules.clear();
+		tag_index.clear();
+		std::vector<std::pair<TestModule*, std::vector<std::string>>> stack = { { &root, root.tags } };
+		while (!stack.empty()) {
+			auto [module, tags] = std::move(stack.back());
+			stack.pop_back();
+			modules.push_back(module);
+			for (TestNode* node : module->children) {
+				std::vector<std::string> node_tags = tags;
+				node_tags.insert(node_tags.end(), node->tags.begin(), node->tags.end());
+				if (Test* test = node->asTest()) {
+					index.push_back({ test->getPath(), test });
+					for (const std::string& tag : node_tags) {
+						std::vector<Test*>& tagged = tag_index[tag];
+						if (tagged.empty() || tagged.back() != test) {
+							tagged.push_back(test);
+						}
+					}
+				} else if (TestModule* child_module = node->asModule()) {
+					stack.push_back({ child_module, std::move(node_tags) });
+				}
+			}
+		}
+		std::sort(index.begin(), index.end(), [](const IndexEntry& left, const IndexEntry& right) {
+			return left.path < right.path;
+		});
+		index_valid = true;
+	}
+
+	void TestSelection::collectMatches(Filter& filter, std::vector<Test*>& result) const {
+		switch (filter.kind) {
+			case Kind::Glob: {
+				std::string_view pattern = filter.pattern;
+				std::string_view prefix = pattern.substr(0, pattern.find_first_of("*?"));
+				auto it = std::lower_bound(index.begin(), index.end(), prefix, [](const IndexEntry& entry, std::string_view prefix) {
+					return entry.path < prefix;
+				});
+				for (; it != index.end() && it->path.starts_with(prefix); it++) {
+					if (matchPathOrModule(pattern, it->path)) {
+						result.push_back(it->test);
+					}
+				}
+				break;
+			}
+			case Kind::Regex: {
+				const std::regex& regex = getRegex(filter);
+				for (const IndexEntry& entry : index) {
+					if (std::regex_search(entry.path, regex)) {
+						result.push_back(entry.test);
+					}
+				}
+				break;
+			}
+			case Kind::Tag: {
+				auto it = tag_index.find(filter.pattern);
+				if (it != tag_index.end()) {
+					result.insert(result.end(), it->second.begin(), it->second.end());
+				}
+				break;
+			}
+		}
+	}
+
+	const std::regex& TestSelection::getRegex(Filter& filter) {
+		if (!filter.regex) {
+			filter.regex = std::make_shared<std::regex>(filter.pattern);
+		}
+		return *filter.regex;
+	}
+
+	bool matchGlob(std::string_view pattern, std::string_view str) {
+		size_t pattern_pos = 0;
+		size_t str_pos = 0;
+		while (pattern_pos < pattern.size()) {
+			char c = pattern[pattern_pos];
+			if (c == '*') {
+				bool any_depth = pattern_pos + 1 < pattern.size() && pattern[pattern_pos + 1] == '*';
+				std::string_view rest = pattern.substr(pattern_pos + (any_depth ? 2 : 1));
+				for (size_t i = str_pos; i <= str.size(); i++) {
+					if (matchGlob(rest, str.substr(i))) {
+						return true;
+					}
+					if (i < str.size() && str[i] == '/' && !any_depth) {
+						return false;
+					}
+				}
+				return false;
+			}
+			if (str_pos >= str.size()) {
+				return false;
+			}
+			if (c == '?' ? str[str_pos] == '/' : c != str[str_pos]) {
+				return false;
+			}
+			pattern_pos++;
+			str_pos++;
+		}
+		return str_pos == str.size();
+	}
+
+}
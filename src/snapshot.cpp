@@ -0,0 +1,228 @@
+#include "test_lib/snapshot.h"
+#include "test_lib/test.h"
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define TEST_LIB_HAS_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+namespace test {
+
+	MappedFile::MappedFile(const std::filesystem::path& path) {
+#if defined(TEST_LIB_HAS_MMAP)
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return;
+		}
+		struct stat info;
+		if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+			length = static_cast<size_t>(info.st_size);
+			// mapping zero bytes fails, an empty file is open with a null pointer
+			if (length == 0) {
+				is_open = true;
+			} else {
+				void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (mapping != MAP_FAILED) {
+					madvise(mapping, length, MADV_SEQUENTIAL);
+					ptr = static_cast<const uint8_t*>(mapping);
+					is_open = true;
+				}
+			}
+		}
+		::close(fd);
+#elif defined(_WIN32)
+		HANDLE file = CreateFileW(
+			path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr
+		);
+		if (file == INVALID_HANDLE_VALUE) {
+			return;
+		}
+		LARGE_INTEGER file_size;
+		if (GetFileSizeEx(file, &file_size)) {
+			length = static_cast<size_t>(file_size.QuadPart);
+			if (length == 0) {
+				is_open = true;
+			} else {
+				// the view keeps the mapping alive, so both handles can be closed right away
+				HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+				if (mapping) {
+					void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+					if (view) {
+						ptr = static_cast<const uint8_t*>(view);
+						is_open = true;
+					}
+					CloseHandle(mapping);
+				}
+			}
+		}
+		CloseHandle(file);
+#else
+		std::ifstream file(path, std::ios::binary);
+		if (!file) {
+			return;
+		}
+		buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		ptr = reinterpret_cast<const uint8_t*>(buffer.data());
+		length = buffer.size();
+		is_open = true;
+#endif
+	}
+
+	MappedFile::~MappedFile() {
+		close();
+	}
+
+	void MappedFile::close() {
+		if (ptr && buffer.empty()) {
+#if defined(TEST_LIB_HAS_MMAP)
+			munmap(const_cast<uint8_t*>(ptr), length);
+#elif defined(_WIN32)
+			UnmapViewOfFile(ptr);
+#endif
+		}
+		buffer.clear();
+		ptr = nullptr;
+		length = 0;
+		is_open = false;
+	}
+
+	bool writeFileAtomically(const std::filesystem::path& path, const void* data, size_t size) {
+		std::error_code error;
+		if (path.has_parent_path()) {
+			std::filesystem::create_directories(path.parent_path(), error);
+		}
+		// parallel cases of one test may update the same file
+		std::filesystem::path temp_path = path;
+		temp_path += ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+		{
+			std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+			if (!file) {
+				return false;
+			}
+			file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+			if (!file) {
+				file.close();
+				std::filesystem::remove(temp_path, error);
+				return false;
+			}
+		}
+		std::filesystem::rename(temp_path, path, error);
+		if (error) {
+			std::filesystem::remove(temp_path, error);
+			return false;
+		}
+		return true;
+	}
+
+	// One file name from a test, module or snapshot name. Separators and '%' are
+	// percent-escaped, as are the dots of "." and "..", so no name leaves its directory.
+	static std::string escapePathComponent(std::string_view name) {
+		bool only_dots = !name.empty() && name.find_first_not_of('.') == std::string_view::npos;
+		std::string result;
+		for (char c : name) {
+			if (c == '/' || c == '\\' || c == ':' || c == '%' || static_cast<unsigned char>(c) < 0x20 || (only_dots && c == '.')) {
+				char escaped[4];
+				snprintf(escaped, sizeof(escaped), "%%%02X", static_cast<unsigned char>(c));
+				result += escaped;
+			} else {
+				result += c;
+			}
+		}
+		return result;
+	}
+
+	std::filesystem::path getSnapshotPath(const Test& test, std::string_view name) {
+		std::filesystem::path path = escapePathComponent(name);
+		path = escapePathComponent(test.name) / path;
+		for (const TestModule* module = test.parent; module && !module->isRoot(); module = module->parent) {
+			path = escapePathComponent(module->name) / path;
+		}
+		std::filesystem::path dir = test.parent ? test.parent->getRoot()->snapshot_dir : std::filesystem::path("snapshots");
+		return dir / path;
+	}
+
+	// Hex dump rows of 16 bytes from begin, like "00000010  48 65 6c 6c 6f  ...  |Hello|"
+	static void addHexRows(TestError* error, const uint8_t* data, size_t size, size_t begin, size_t row_count) {
+		const size_t row_size = 16;
+		for (size_t row = 0; row < row_count && begin < size; row++, begin += row_size) {
+			char line[96];
+			int length = snprintf(line, sizeof(line), "%08llx", static_cast<unsigned long long>(begin));
+			std::string text;
+			for (size_t i = begin; i < begin + row_size; i++) {
+				if (i < size) {
+					length += snprintf(line + length, sizeof(line) - length, i % 8 == 0 ? "  %02x" : " %02x", data[i]);
+					text += data[i] >= 0x20 && data[i] < 0x7f ? static_cast<char>(data[i]) : '.';
+				} else {
+					length += snprintf(line + length, sizeof(line) - length, i % 8 == 0 ? "    " : "   ");
+				}
+			}
+			error->add(std::string(line, length) + "  |" + text + "|")->raw = true;
+		}
+	}
+
+	static void snapshotFail(
+		Test& test, const SourceLocation& location, std::string_view name, const std::filesystem::path& path,
+		const uint8_t* expected, size_t expected_size, const uint8_t* actual, size_t actual_size, size_t offset
+	) {
+		TestError* error = test.getCurrentError()->add("T_SNAPSHOT(" + std::string(name) + ") " + location.toString());
+		error->raw = test.raw_mode;
+		error->add(
+			"Differs from " + path.string() + " at offset " + std::to_string(offset) + ", expected size "
+			+ std::to_string(expected_size) + ", actual size " + std::to_string(actual_size)
+		);
+		// the row with the first difference and one row on each side
+		const size_t row_size = 16;
+		size_t begin = offset / row_size * row_size;
+		begin -= std::min(begin, row_size);
+		addHexRows(error->add("Expected:"), expected, expected_size, begin, 3);
+		addHexRows(error->add("Actual:"), actual, actual_size, begin, 3);
+		error->add("Run with --update-snapshots to accept the actual value");
+		test.result = false;
+	}
+
+	bool testSnapshotBytes(Test& test, const SourceLocation& location, std::string_view name, const void* data, size_t size) {
+		const uint8_t* actual = static_cast<const uint8_t*>(data);
+		std::filesystem::path path = getSnapshotPath(test, name);
+		bool update = test.parent && test.parent->getRoot()->update_snapshots;
+		size_t offset = 0;
+		{
+			MappedFile golden(path);
+			if (golden.isOpen()) {
+				size_t common = std::min(golden.size(), size);
+				offset = findIntegralMismatch(actual, golden.data(), 0, common);
+				if (offset == common && golden.size() == size) {
+					return true;
+				}
+				if (!update) {
+					snapshotFail(test, location, name, path, golden.data(), golden.size(), actual, size, offset);
+					return false;
+				}
+			} else if (!update) {
+				TestError* error = test.getCurrentError()->add("T_SNAPSHOT(" + std::string(name) + ") " + location.toString());
+				error->raw = test.raw_mode;
+				error->add("Snapshot file " + path.string() + " doesn't exist, run with --update-snapshots to create it");
+				test.result = false;
+				return false;
+			}
+			// unmapped before the file is replaced, Windows can't rename over a mapped file
+		}
+		if (!writeFileAtomically(path, data, size)) {
+			TestError* error = test.getCurrentError()->add("T_SNAPSHOT(" + std::string(name) + ") " + location.toString());
+			error->raw = test.raw_mode;
+			error->add("Could not write snapshot file " + path.string());
+			test.result = false;
+			return false;
+		}
+		return true;
+	}
+
+}
@@ -0,0 +1,401 @@
+#include "test_lib/span_compare.h"
+#include "test_lib/test.h"
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define TEST_LIB_SPAN_X86
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define TEST_LIB_TARGET_AVX2
+#else
+#define TEST_LIB_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace test {
+
+	// Maps the bits of a float to an integer that grows with the value, -0 and +0 both become 0
+	static int32_t orderedBits(float value) {
+		int32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits < 0 ? std::numeric_limits<int32_t>::min() - bits : bits;
+	}
+
+	static int64_t orderedBits(double value) {
+		int64_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits < 0 ? std::numeric_limits<int64_t>::min() - bits : bits;
+	}
+
+	uint64_t ulpDistance(float left, float right) {
+		if (std::isnan(left) || std::isnan(right)) {
+			return std::numeric_limits<uint64_t>::max();
+		}
+		int64_t distance = static_cast<int64_t>(orderedBits(left)) - orderedBits(right);
+		return static_cast<uint64_t>(distance < 0 ? -distance : distance);
+	}
+
+	uint64_t ulpDistance(double left, double right) {
+		if (std::isnan(left) || std::isnan(right)) {
+			return std::numeric_limits<uint64_t>::max();
+		}
+		uint64_t left_bits = static_cast<uint64_t>(orderedBits(left));
+		uint64_t right_bits = static_cast<uint64_t>(orderedBits(right));
+		// unsigned arithmetic, the difference may not fit in int64_t
+		return orderedBits(left) >= orderedBits(right) ? left_bits - right_bits : right_bits - left_bits;
+	}
+
+	// Scalar predicates, used on platforms without kernels and for the tails of vector loops
+
+	struct ExactScalar {
+		template<typename T, typename TParam>
+		static bool mismatch(T actual, T expected, TParam) {
+			return !(actual == expected);
+		}
+	};
+
+	struct ApproxScalar {
+		template<typename T, typename TParam>
+		static bool mismatch(T actual, T expected, TParam epsilon) {
+			return !(std::abs(actual - expected) < epsilon);
+		}
+	};
+
+	struct UlpScalar {
+		template<typename T, typename TParam>
+		static bool mismatch(T actual, T expected, TParam max_ulps) {
+			return ulpDistance(actual, expected) > static_cast<uint64_t>(max_ulps);
+		}
+	};
+
+	template<typename TScalar, typename T, typename TParam>
+	static size_t scanScalar(const T* actual, const T* expected, size_t begin, size_t size, TParam param) {
+		for (size_t i = begin; i < size; i++) {
+			if (TScalar::mismatch(actual[i], expected[i], param)) {
+				return i;
+			}
+		}
+		return size;
+	}
+
+#ifdef TEST_LIB_SPAN_X86
+
+	static int countTrailingZeros(uint32_t mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return static_cast<int>(index);
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+
+	static bool hasAvx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+		static const bool result = [] {
+			int info[4];
+			__cpuid(info, 1);
+			bool os_avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+			__cpuidex(info, 7, 0);
+			return os_avx && (info[1] & (1 << 5));
+		}();
+		return result;
+#else
+		static const bool result = __builtin_cpu_supports("avx2");
+		return result;
+#endif
+	}
+
+	// Each kernel returns a bit mask of mismatching lanes in a block of width elements.
+	// SSE2 is part of x86-64, so those kernels need no runtime check.
+
+	struct ExactSse2 {
+		static constexpr size_t width = 4;
+		static uint32_t mask(const float* actual, const float* expected, float) {
+			return _mm_movemask_ps(_mm_cmpneq_ps(_mm_loadu_ps(actual), _mm_loadu_ps(expected)));
+		}
+	};
+
+	struct ExactSse2Double {
+		static constexpr size_t width = 2;
+		static uint32_t mask(const double* actual, const double* expected, double) {
+			return _mm_movemask_pd(_mm_cmpneq_pd(_mm_loadu_pd(actual), _mm_loadu_pd(expected)));
+		}
+	};
+
+	struct ApproxSse2 {
+		static constexpr size_t width = 4;
+		static uint32_t mask(const float* actual, const float* expected, float epsilon) {
+			__m128 diff = _mm_sub_ps(_mm_loadu_ps(actual), _mm_loadu_ps(expected));
+			__m128 abs_diff = _mm_andnot_ps(_mm_set1_ps(-0.0f), diff);
+			// NaN compares false, so it counts as a mismatch
+			return ~_mm_movemask_ps(_mm_cmplt_ps(abs_diff, _mm_set1_ps(epsilon))) & 0xF;
+		}
+	};
+
+	struct ApproxSse2Double {
+		static constexpr size_t width = 2;
+		static uint32_t mask(const double* actual, const double* expected, double epsilon) {
+			__m128d diff = _mm_sub_pd(_mm_loadu_pd(actual), _mm_loadu_pd(expected));
+			__m128d abs_diff = _mm_andnot_pd(_mm_set1_pd(-0.0), diff);
+			return ~_mm_movemask_pd(_mm_cmplt_pd(abs_diff, _mm_set1_pd(epsilon))) & 0x3;
+		}
+	};
+
+	// Differences of ordered bits wrap around for values far apart, but the
+	// wrapped result is still at least 2^24 away from zero, so it is caught
+	// as long as max_ulps is smaller than that.
+	static constexpr uint64_t max_vector_ulps_float = 1u << 24;
+	// same for doubles, where the wrapped difference is at least 2^53
+	static constexpr uint64_t max_vector_ulps_double = 1ull << 53;
+
+	struct UlpSse2 {
+		static constexpr size_t width = 4;
+		static __m128i ordered(__m128 value) {
+			__m128i bits = _mm_castps_si128(value);
+			__m128i sign = _mm_srai_epi32(bits, 31);
+			__m128i negative = _mm_sub_epi32(_mm_set1_epi32(std::numeric_limits<int32_t>::min()), bits);
+			return _mm_or_si128(_mm_and_si128(sign, negative), _mm_andnot_si128(sign, bits));
+		}
+		static uint32_t mask(const float* actual, const float* expected, int32_t max_ulps) {
+			__m128 actual_values = _mm_loadu_ps(actual);
+			__m128 expected_values = _mm_loadu_ps(expected);
+			__m128i diff = _mm_sub_epi32(ordered(actual_values), ordered(expected_values));
+			__m128i too_far = _mm_or_si128(
+				_mm_cmpgt_epi32(diff, _mm_set1_epi32(max_ulps)),
+				_mm_cmplt_epi32(diff, _mm_set1_epi32(-max_ulps))
+			);
+			__m128 nan = _mm_cmpunord_ps(actual_values, expected_values);
+			return _mm_movemask_ps(_mm_or_ps(_mm_castsi128_ps(too_far), nan));
+		}
+	};
+
+	struct ExactAvx2 {
+		static constexpr size_t width = 8;
+		TEST_LIB_TARGET_AVX2 static uint32_t mask(const float* actual, const float* expected, float) {
+			return _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(actual), _mm256_loadu_ps(expected), _CMP_NEQ_UQ));
+		}
+	};
+
+	struct ExactAvx2Double {
+		static constexpr size_t width = 4;
+		TEST_LIB_TARGET_AVX2 static uint32_t mask(const double* actual, const double* expected, double) {
+			return _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(actual), _mm256_loadu_pd(expected), _CMP_NEQ_UQ));
+		}
+	};
+
+	struct ApproxAvx2 {
+		static constexpr size_t width = 8;
+		TEST_LIB_TARGET_AVX2 static uint32_t mask(const float* actual, const float* expected, float epsilon) {
+			__m256 diff = _mm256_sub_ps(_mm256_loadu_ps(actual), _mm256_loadu_ps(expected));
+			__m256 abs_diff = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), diff);
+			return ~_mm256_movemask_ps(_mm256_cmp_ps(abs_diff, _mm256_set1_ps(epsilon), _CMP_LT_OQ)) & 0xFF;
+		}
+	};
+
+	struct ApproxAvx2Double {
+		static constexpr size_t width = 4;
+		TEST_LIB_TARGET_AVX2 static uint32_t mask(const double* actual, const double* expected, double epsilon) {
+			__m256d diff = _mm256_sub_pd(_mm256_loadu_pd(actual), _mm256_loadu_pd(expected));
+			__m256d abs_diff = _mm256_andnot_pd(_mm256_set1_pd(-0.0), diff);
+			return ~_mm256_movemask_pd(_mm256_cmp_pd(abs_diff, _mm256_set1_pd(epsilon), _CMP_LT_OQ)) & 0xF;
+		}
+	};
+
+	struct UlpAvx2 {
+		static constexpr size_t width = 8;
+		TEST_LIB_TARGET_AVX2 static __m256i ordered(__m256 value) {
+			__m256i bits = _mm256_castps_si256(value);
+			__m256i negative = _mm256_sub_epi32(_mm256_set1_epi32(std::numeric_limits<int32_t>::min()), bits);
+			return _mm256_castps_si256(_mm256_blendv_ps(value, _mm256_castsi256_ps(negative), value));
+		}
+		TEST_LIB_TARGET_AVX2 static uint32_t mask(const float* actual, const float* expected, int32_t max_ulps) {
+			__m256 actual_values = _mm256_loadu_ps(actual);
+			__m256 expected_values = _mm256_loadu_ps(expected);
+			__m256i diff = _mm256_sub_epi32(ordered(actual_values), ordered(expected_values));
+			__m256i too_far = _mm256_or_si256(
+				_mm256_cmpgt_epi32(diff, _mm256_set1_epi32(max_ulps)),
+				_mm256_cmpgt_epi32(_mm256_set1_epi32(-max_ulps), diff)
+			);
+			__m256 nan = _mm256_cmp_ps(actual_values, expected_values, _CMP_UNORD_Q);
+			return _mm256_movemask_ps(_mm256_or_ps(_mm256_castsi256_ps(too_far), nan));
+		}
+	};
+
+	struct UlpAvx2Double {
+		static constexpr size_t width = 4;
+		TEST_LIB_TARGET_AVX2 static __m256i ordered(__m256d value) {
+			__m256i bits = _mm256_castpd_si256(value);
+			__m256i negative = _mm256_sub_epi64(_mm256_set1_epi64x(std::numeric_limits<int64_t>::min()), bits);
+			return _mm256_castpd_si256(_mm256_blendv_pd(value, _mm256_castsi256_pd(negative), value));
+		}
+		TEST_LIB_TARGET_AVX2 static uint32_t mask(const double* actual, const double* expected, int64_t max_ulps) {
+			__m256d actual_values = _mm256_loadu_pd(actual);
+			__m256d expected_values = _mm256_loadu_pd(expected);
+			__m256i diff = _mm256_sub_epi64(ordered(actual_values), ordered(expected_values));
+			__m256i too_far = _mm256_or_si256(
+				_mm256_cmpgt_epi64(diff, _mm256_set1_epi64x(max_ulps)),
+				_mm256_cmpgt_epi64(_mm256_set1_epi64x(-max_ulps), diff)
+			);
+			__m256d nan = _mm256_cmp_pd(actual_values, expected_values, _CMP_UNORD_Q);
+			return _mm256_movemask_pd(_mm256_or_pd(_mm256_castsi256_pd(too_far), nan));
+		}
+	};
+
+	// Same loop twice, the AVX2 one has to be compiled for AVX2 to inline the kernel
+
+	template<typename TKernel, typename TScalar, typename T, typename TParam>
+	static size_t scanSse2(const T* actual, const T* expected, size_t begin, size_t size, TParam param) {
+		size_t i = begin;
+		for (; i + TKernel::width <= size; i += TKernel::width) {
+			uint32_t mask = TKernel::mask(actual + i, expected + i, param);
+			if (mask != 0) {
+				return i + countTrailingZeros(mask);
+			}
+		}
+		return scanScalar<TScalar>(actual, expected, i, size, param);
+	}
+
+	template<typename TKernel, typename TScalar, typename T, typename TParam>
+	TEST_LIB_TARGET_AVX2 static size_t scanAvx2(const T* actual, const T* expected, size_t begin, size_t size, TParam param) {
+		size_t i = begin;
+		for (; i + TKernel::width <= size; i += TKernel::width) {
+			uint32_t mask = TKernel::mask(actual + i, expected + i, param);
+			if (mask != 0) {
+				return i + countTrailingZeros(mask);
+			}
+		}
+		return scanScalar<TScalar>(actual, expected, i, size, param);
+	}
+
+	size_t findMismatch(const float* actual, const float* expected, size_t begin, size_t size) {
+		if (hasAvx2()) {
+			return scanAvx2<ExactAvx2, ExactScalar>(actual, expected, begin, size, 0.0f);
+		}
+		return scanSse2<ExactSse2, ExactScalar>(actual, expected, begin, size, 0.0f);
+	}
+
+	size_t findMismatch(const double* actual, const double* expected, size_t begin, size_t size) {
+		if (hasAvx2()) {
+			return scanAvx2<ExactAvx2Double, ExactScalar>(actual, expected, begin, size, 0.0);
+		}
+		return scanSse2<ExactSse2Double, ExactScalar>(actual, expected, begin, size, 0.0);
+	}
+
+	size_t findApproxMismatch(const float* actual, const float* expected, size_t begin, size_t size, float epsilon) {
+		if (hasAvx2()) {
+			return scanAvx2<ApproxAvx2, ApproxScalar>(actual, expected, begin, size, epsilon);
+		}
+		return scanSse2<ApproxSse2, ApproxScalar>(actual, expected, begin, size, epsilon);
+	}
+
+	size_t findApproxMismatch(const double* actual, const double* expected, size_t begin, size_t size, double epsilon) {
+		if (hasAvx2()) {
+			return scanAvx2<ApproxAvx2Double, ApproxScalar>(actual, expected, begin, size, epsilon);
+		}
+		return scanSse2<ApproxSse2Double, ApproxScalar>(actual, expected, begin, size, epsilon);
+	}
+
+	size_t findUlpMismatch(const float* actual, const float* expected, size_t begin, size_t size, uint64_t max_ulps) {
+		if (max_ulps >= max_vector_ulps_float) {
+			return scanScalar<UlpScalar>(actual, expected, begin, size, max_ulps);
+		}
+		int32_t max_ulps_int = static_cast<int32_t>(max_ulps);
+		if (hasAvx2()) {
+			return scanAvx2<UlpAvx2, UlpScalar>(actual, expected, begin, size, max_ulps_int);
+		}
+		return scanSse2<UlpSse2, UlpScalar>(actual, expected, begin, size, max_ulps_int);
+	}
+
+	size_t findUlpMismatch(const double* actual, const double* expected, size_t begin, size_t size, uint64_t max_ulps) {
+		// SSE2 has no 64-bit compares
+		if (max_ulps >= max_vector_ulps_double || !hasAvx2()) {
+			return scanScalar<UlpScalar>(actual, expected, begin, size, max_ulps);
+		}
+		return scanAvx2<UlpAvx2Double, UlpScalar>(actual, expected, begin, size, static_cast<int64_t>(max_ulps));
+	}
+
+#else
+
+	size_t findMismatch(const float* actual, const float* expected, size_t begin, size_t size) {
+		return scanScalar<ExactScalar>(actual, expected, begin, size, 0.0f);
+	}
+
+	size_t findMismatch(const double* actual, const double* expected, size_t begin, size_t size) {
+		return scanScalar<ExactScalar>(actual, expected, begin, size, 0.0);
+	}
+
+	size_t findApproxMismatch(const float* actual, const float* expected, size_t begin, size_t size, float epsilon) {
+		return scanScalar<ApproxScalar>(actual, expected, begin, size, epsilon);
+	}
+
+	size_t findApproxMismatch(const double* actual, const double* expected, size_t begin, size_t size, double epsilon) {
+		return scanScalar<ApproxScalar>(actual, expected, begin, size, epsilon);
+	}
+
+	size_t findUlpMismatch(const float* actual, const float* expected, size_t begin, size_t size, uint64_t max_ulps) {
+		return scanScalar<UlpScalar>(actual, expected, begin, size, max_ulps);
+	}
+
+	size_t findUlpMismatch(const double* actual, const double* expected, size_t begin, size_t size, uint64_t max_ulps) {
+		return scanScalar<UlpScalar>(actual, expected, begin, size, max_ulps);
+	}
+
+#endif
+
+	void SpanCompareReport::addError(size_t index, double error) {
+		mismatch_count++;
+		if (std::isnan(max_error)) {
+			return;
+		}
+		if (mismatch_count == 1 || std::isnan(error) || error > max_error) {
+			max_error = error;
+			max_error_index = index;
+		}
+	}
+
+	std::string formatSpanValue(float value) {
+		char buffer[32];
+		std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+		return std::string(buffer, result.ptr);
+	}
+
+	std::string formatSpanValue(double value) {
+		char buffer[32];
+		std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+		return std::string(buffer, result.ptr);
+	}
+
+	void spanCompareFail(Test& test, const SourceLocation& location, const char* name, const SpanCompareReport& report) {
+		TestError* error = test.getCurrentError()->add(std::string(name) + " " + location.toString());
+		error->raw = test.raw_mode;
+		if (report.actual_size != report.expected_size) {
+			error->add(
+				"Size mismatch: expected " + std::to_string(report.expected_size)
+				+ ", actual " + std::to_string(report.actual_size)
+			);
+		}
+		if (report.mismatch_count > 0) {
+			size_t compared = std::min(report.actual_size, report.expected_size);
+			error->add(
+				"Mismatched " + std::to_string(report.mismatch_count) + " of " + std::to_string(compared)
+				+ " elements, max error " + formatSpanValue(report.max_error) + report.error_unit
+				+ " at [" + std::to_string(report.max_error_index) + "]"
+			);
+		}
+		for (const SpanMismatch& mismatch : report.mismatches) {
+			error->add(
+				"[" + std::to_string(mismatch.index) + "] expected " + mismatch.expected + ", actual " + mismatch.actual
+			);
+		}
+		if (report.mismatch_count > report.mismatches.size()) {
+			error->add("... " + std::to_string(report.mismatch_count - report.mismatches.size()) + " more mismatches");
+		}
+		test.result = false;
+	}
+
+}
@@ -0,0 +1,185 @@
+#include "test_lib/test.h"
+#include "test_lib/isolation.h"
+#include <algorithm>
+#include <barrier>
+#include <system_error>
+#include <thread>
+
+namespace test {
+
+	// State of one thread, only touched by that thread until all of them are joined
+	class StressTest::Worker {
+	public:
+		Test scratch;
+		ErrorArena failures;
+		size_t max_listed_failures = 0;
+		size_t failed_count = 0;
+
+		explicit Worker(StressTest& owner) : scratch(owner.name, TestFuncType()) {
+			scratch.parent = owner.parent;
+			scratch.fixtures = owner.fixtures;
+			scratch.max_error_entries = owner.max_error_entries;
+			scratch.resetErrors();
+			max_listed_failures = owner.max_listed_failures;
+			failures.max_entries = owner.max_error_entries;
+			if (failures.max_entries == 0 && owner.parent) {
+				failures.max_entries = owner.parent->getRoot()->max_error_entries;
+			}
+		}
+
+		void runIteration(const StressFuncType& func, size_t thread_index, size_t iteration) {
+			if (!scratch.root_error->subentries.empty() || scratch.getDroppedErrorCount() > 0) {
+				scratch.resetErrors();
+			}
+			scratch.result = true;
+			scratch.raw_mode = false;
+			try {
+				func(scratch, thread_index);
+			} catch (const std::exception& exc) {
+				scratch.getCurrentError()->add("EXCEPTION: " + std::string(exc.what()));
+				scratch.result = false;
+			}
+			if (scratch.result) {
+				return;
+			}
+			if (failed_count < max_listed_failures) {
+				TestError* error = failures.getRoot()->add(
+					"Thread " + std::to_string(thread_index) + ", iteration " + std::to_string(iteration)
+				);
+				copyErrors(*scratch.root_error, error);
+				failures.dropped_count += scratch.getDroppedErrorCount();
+			}
+			failed_count++;
+		}
+	};
+
+	StressTest::StressTest(std::string name, std::vector<TestNode*> required, StressFuncType func)
+	: Test(std::move(name), std::move(required), [](Test& test) {
+		static_cast<StressTest&>(test).runThreads();
+	}) {
+		this->func = std::move(func);
+		this->kind = NodeKind::Stress;
+	}
+
+	std::string StressTest::getIterationsString() const {
+		std::string result = std::to_string(iteration_count) + (iteration_count == 1 ? " iteration on " : " iterations on ")
+			+ std::to_string(used_thread_count) + " threads";
+		if (failed_count > 0) {
+			result += ", " + std::to_string(failed_count) + (failed_count == 1 ? " failure" : " failures");
+		}
+		return result;
+	}
+
+	void StressTest::runThreads() {
+		used_thread_count = thread_count > 0 ? thread_count : std::max<size_t>(2, std::thread::hardware_concurrency());
+		iteration_count = 0;
+		failed_count = 0;
+		std::vector<std::unique_ptr<Worker>> workers;
+		for (size_t i = 0; i < used_thread_count; i++) {
+			workers.push_back(std::make_unique<Worker>(*this));
+		}
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		bool stop = false;
+		bool start_failed = false;
+		// runs on the last thread to arrive while the others wait, so the counters need no locking
+		auto next_iteration = [&]() noexcept {
+			bool any_failed = stop_on_failure && std::any_of(workers.begin(), workers.end(), [](const std::unique_ptr<Worker>& worker) {
+				return worker->failed_count > 0;
+			});
+			bool out_of_time = max_time > std::chrono::nanoseconds::zero() && std::chrono::steady_clock::now() - start >= max_time;
+			if (start_failed || any_failed || out_of_time || (iterations > 0 && iteration_count >= iterations)) {
+				stop = true;
+			} else {
+				iteration_count++;
+			}
+		};
+		std::barrier<decltype(next_iteration)> barrier(static_cast<ptrdiff_t>(used_thread_count), next_iteration);
+		auto run_thread = [&](size_t thread_index) {
+			Worker& worker = *workers[thread_index];
+			while (true) {
+				barrier.arrive_and_wait();
+				if (stop) {
+					return;
+				}
+				worker.runIteration(func, thread_index, iteration_count - 1);
+			}
+		};
+		// the calling thread is thread 0
+		std::vector<std::thread> threads;
+		size_t started_count = 1;
+		try {
+			for (; started_count < used_thread_count; started_count++) {
+				threads.emplace_back(run_thread, started_count);
+			}
+		} catch (const std::system_error& exc) {
+			// arrivals of the missing threads, so the started ones aren't left waiting
+			start_failed = true;
+			for (size_t i = started_count; i < used_thread_count; i++) {
+				barrier.arrive_and_drop();
+			}
+			root_error->add(
+				"Could only start " + std::to_string(started_count) + " of " + std::to_string(used_thread_count)
+				+ " threads: " + exc.what()
+			);
+			result = false;
+		}
+		run_thread(0);
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+		// merged in thread order, so the listed failures don't depend on scheduling
+		TestError* summary_error = nullptr;
+		size_t listed_count = 0;
+		for (std::unique_ptr<Worker>& worker : workers) {
+			failed_count += worker->failed_count;
+			for (const TestError* failure : worker->failures.getRoot()->subentries) {
+				if (listed_count >= max_listed_failures) {
+					break;
+				}
+				if (!summary_error) {
+					summary_error = root_error->add("");
+				}
+				TestError* copy = summary_error->add(failure->str, failure->type);
+				copy->raw = failure->raw;
+				copyErrors(*failure, copy);
+				listed_count++;
+			}
+			root_error->arena->dropped_count += worker->failures.dropped_count;
+		}
+		if (failed_count == 0) {
+			return;
+		}
+		result = false;
+		if (!summary_error) {
+			summary_error = root_error->add("");
+		}
+		if (listed_count < failed_count) {
+			summary_error->add(std::to_string(failed_count - listed_count) + " more failures not listed");
+		}
+		summary_error->str = summary_error->arena->copyString(getIterationsString());
+	}
+
+	void StressTest::writeResults(BinaryWriter& writer) const {
+		Test::writeResults(writer);
+		writer.writeVarint(iteration_count);
+		writer.writeVarint(failed_count);
+		writer.writeVarint(used_thread_count);
+	}
+
+	bool StressTest::readResults(BinaryReader& reader) {
+		if (!Test::readResults(reader)) {
+			return false;
+		}
+		uint64_t iterations_run;
+		uint64_t failures;
+		uint64_t threads;
+		if (!reader.readVarint(iterations_run) || !reader.readVarint(failures) || !reader.readVarint(threads)) {
+			return false;
+		}
+		iteration_count = iterations_run;
+		failed_count = failures;
+		used_thread_count = threads;
+		return true;
+	}
+
+}
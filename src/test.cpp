@@ -1,7 +1,24 @@
 #include "test_lib/test.h"
+#include "test_lib/scheduler.h"
+#include "test_lib/isolation.h"
+#include "test_lib/baseline.h"
+#include "test_lib/reporter.h"
+#include "test_lib/result_cache.h"
+#include "test_lib/watchdog.h"
 #include "logger/logger.h"
 #include <cassert>
 #include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <charconv>
+#include <regex>
+#include <unordered_set>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
 
 namespace test {
 
@@ -9,39 +26,229 @@ namespace test {
 		return parent == nullptr;
 	}
 
+	std::string TestNode::getPath(const TestNode* ancestor) const {
+		std::string path = name;
+		for (const TestModule* module = parent; module && module != ancestor && !module->isRoot(); module = module->parent) {
+			path = module->name + "/" + path;
+		}
+		return path;
+	}
+
+	std::chrono::nanoseconds TestNode::getTimeout() const {
+		for (const TestNode* node = this; node; node = node->parent) {
+			if (node->timeout > std::chrono::nanoseconds::zero()) {
+				return node->timeout;
+			}
+		}
+		return std::chrono::nanoseconds::zero();
+	}
+
 	Test::Test(std::string name, TestFuncType func) {
-		this->name = name;
-		this->func = func;
+		this->name = std::move(name);
+		this->func = std::move(func);
 		this->raw_mode = false;
-		root_error = std::make_unique<TestError>("root", TestError::Type::Root);
-		error_stack.push(root_error.get());
+		// the error stack is set up by resetErrors() when the test runs
+		root_error = error_arena.getRoot();
 	}
 
 	Test::Test(std::string name, std::vector<TestNode*> required, TestFuncType func)
-	: Test(name, func) {
-		this->required_nodes = required;
+	: Test(std::move(name), std::move(func)) {
+		this->required_nodes = std::move(required);
 	}
 
 	bool Test::run() {
-		if (!std::all_of(required_nodes.begin(), required_nodes.end(), [](TestNode* test) {
+		bool ready = std::all_of(required_nodes.begin(), required_nodes.end(), [](TestNode* test) {
 			return test->result;
-		})) {
+		});
+		IsolationPool* pool = parent ? parent->getRoot()->isolation_pool : nullptr;
+		if (!ready) {
 			cancelled = true;
-			return false;
+		} else if (cached) {
+			result = true;
+		} else if (pool) {
+			pool->run(this);
+		} else {
+			runInProcess();
+		}
+		releaseFixtures();
+		return ready && result;
+	}
+
+	void Test::cancel() {
+		cancelled = true;
+		releaseFixtures();
+	}
+
+	std::vector<FixtureBase*> Test::getFixtures() const {
+		std::vector<FixtureBase*> result;
+		for (const TestNode* node = this; node; node = node->parent) {
+			for (FixtureBase* fixture : node->fixtures) {
+				if (std::find(result.begin(), result.end(), fixture) == result.end()) {
+					result.push_back(fixture);
+				}
+			}
 		}
+		return result;
+	}
+
+	void Test::releaseFixtures() {
+		for (FixtureBase* fixture : getFixtures()) {
+			if (fixture->scope != FixtureScope::Test) {
+				fixture->finishUser();
+			}
+		}
+	}
+
+	void Test::runInProcess() {
+		resetErrors();
 		result = true;
+		PerfCounterGroup* counter_group = nullptr;
+		if (parent && parent->getRoot()->hardware_counters) {
+			counter_group = &PerfCounterGroup::forCurrentThread();
+			counter_group->start();
+		}
+		std::chrono::steady_clock::time_point wall_start = std::chrono::steady_clock::now();
+		std::chrono::nanoseconds cpu_start = threadCpuTime();
+		// workers of the isolation pool are watched from the parent process
+		TestModule* root = parent ? parent->getRoot() : nullptr;
+		Watchdog* watchdog = root && !root->isolation_pool ? root->watchdog : nullptr;
+		size_t watch_id = 0;
+		if (watchdog && getTimeout() > std::chrono::nanoseconds::zero()) {
+			watch_id = watchdog->watch(getTimeout(), true, [this, root, wall_start](const std::vector<std::string>& stack) {
+				// the test thread still uses this test, the timeout goes into a copy
+				Test report(name, TestFuncType());
+				report.parent = parent;
+				report.fingerprint = fingerprint;
+				report.max_error_entries = max_error_entries;
+				report.resetErrors();
+				report.timed_out = true;
+				report.result = false;
+				report.is_run = true;
+				report.wall_time = std::chrono::steady_clock::now() - wall_start;
+				TestError* error = report.root_error->add(
+					"TIMEOUT after " + formatDuration(report.wall_time) + " (limit " + formatDuration(getTimeout()) + ")"
+				);
+				if (!stack.empty()) {
+					TestError* stack_error = error->add("Stack of the test thread:");
+					for (const std::string& frame : stack) {
+						stack_error->add(frame);
+					}
+				}
+				root->exitAfterTimeout(*this, report);
+			});
+		}
 		try {
+			AllocationScope allocation_scope(allocation_stats);
 			func(*this);
-		} catch (std::exception exc) {
+		} catch (const std::exception& exc) {
 			getCurrentError()->add("EXCEPTION: " + std::string(exc.what()));
 			result = false;
 		}
+		if (watch_id != 0) {
+			watchdog->cancel(watch_id);
+		}
+		cpu_time = threadCpuTime() - cpu_start;
+		wall_time = std::chrono::steady_clock::now() - wall_start;
+		if (counter_group) {
+			counter_group->stop(perf_counters);
+		}
 		is_run = true;
-		return result;
+		fixture_instances.clear();
+	}
+
+	void Test::writeResults(BinaryWriter& writer) const {
+		writer.writeVarint(result ? 1 : 0);
+		writer.writeVarint(wall_time.count());
+		writer.writeVarint(cpu_time.count());
+		writer.writeVarint(perf_counters.available);
+		writer.writeVarint(perf_counters.cycles);
+		writer.writeVarint(perf_counters.instructions);
+		writer.writeVarint(perf_counters.cache_misses);
+		writer.writeVarint(perf_counters.branch_misses);
+		writer.writeVarint(perf_counters.page_faults);
+		writer.writeVarint(allocation_stats.available ? 1 : 0);
+		writer.writeVarint(allocation_stats.allocations);
+		writer.writeVarint(allocation_stats.deallocations);
+		writer.writeVarint(allocation_stats.allocated_bytes);
+		writer.writeVarint(static_cast<uint64_t>(allocation_stats.live_bytes));
+		writer.writeVarint(static_cast<uint64_t>(allocation_stats.peak_live_bytes));
+		writer.writeError(*root_error);
+		writer.writeVarint(error_arena.dropped_count);
+	}
+
+	bool Test::readResults(BinaryReader& reader) {
+		uint64_t result_value;
+		uint64_t wall_time_value;
+		uint64_t cpu_time_value;
+		if (!reader.readVarint(result_value) || !reader.readVarint(wall_time_value) || !reader.readVarint(cpu_time_value)) {
+			return false;
+		}
+		result = result_value != 0;
+		wall_time = std::chrono::nanoseconds(wall_time_value);
+		cpu_time = std::chrono::nanoseconds(cpu_time_value);
+		uint64_t counters_available;
+		if (!reader.readVarint(counters_available)
+			|| !reader.readVarint(perf_counters.cycles)
+			|| !reader.readVarint(perf_counters.instructions)
+			|| !reader.readVarint(perf_counters.cache_misses)
+			|| !reader.readVarint(perf_counters.branch_misses)
+			|| !reader.readVarint(perf_counters.page_faults)) {
+			return false;
+		}
+		perf_counters.available = static_cast<uint32_t>(counters_available);
+		uint64_t allocations_available;
+		uint64_t live_bytes;
+		uint64_t peak_live_bytes;
+		if (!reader.readVarint(allocations_available)
+			|| !reader.readVarint(allocation_stats.allocations)
+			|| !reader.readVarint(allocation_stats.deallocations)
+			|| !reader.readVarint(allocation_stats.allocated_bytes)
+			|| !reader.readVarint(live_bytes)
+			|| !reader.readVarint(peak_live_bytes)) {
+			return false;
+		}
+		allocation_stats.available = allocations_available != 0;
+		allocation_stats.live_bytes = static_cast<int64_t>(live_bytes);
+		allocation_stats.peak_live_bytes = static_cast<int64_t>(peak_live_bytes);
+		uint64_t dropped_count;
+		if (!reader.readError(*root_error) || !reader.readVarint(dropped_count)) {
+			return false;
+		}
+		error_arena.dropped_count += dropped_count;
+		return true;
+	}
+
+	TestError* Test::getCurrentError() {
+		if (error_stack.empty()) {
+			error_stack.push_back({ root_error, SourceLocation(), "", std::string() });
+		}
+		size_t index = error_stack.size() - 1;
+		while (!error_stack[index].error) {
+			index--;
+		}
+		for (index++; index < error_stack.size(); index++) {
+			// container labels are only formatted once something is reported inside them
+			ErrorFrame& frame = error_stack[index];
+			std::string label = frame.message_str.empty() ? frame.message : frame.message_str;
+			label += (label.empty() ? "" : " ") + frame.location.toString();
+			frame.error = error_stack[index - 1].error->add(label, TestError::Type::Container);
+		}
+		return error_stack.back().error;
+	}
+
+	size_t Test::getDroppedErrorCount() const {
+		return error_arena.dropped_count;
 	}
 
-	TestError* Test::getCurrentError() const {
-		return error_stack.top();
+	void Test::resetErrors() {
+		error_arena.release();
+		error_arena.max_entries = max_error_entries;
+		if (max_error_entries == 0 && parent) {
+			error_arena.max_entries = parent->getRoot()->max_error_entries;
+		}
+		root_error = error_arena.getRoot();
+		error_stack.clear();
+		error_stack.push_back({ root_error, SourceLocation(), "", std::string() });
 	}
 
 	std::string Test::char_to_str(char c) {
@@ -68,9 +275,13 @@ namespace test {
 
 	std::string Test::char_to_esc(std::string str, bool convert_quotes) {
 		std::string result;
+		result.reserve(str.size());
 		for (size_t i = 0; i < str.size(); i++) {
 			char current_char = str[i];
-			if (!convert_quotes && current_char == '"') {
+			// most characters are printed as they are, without a temporary string
+			bool plain = current_char > 0 && current_char != '\n' && current_char != '\r' && current_char != '\t'
+				&& current_char != '\\' && current_char != '"';
+			if (plain || (!convert_quotes && current_char == '"')) {
 				result += current_char;
 			} else {
 				result += char_to_str(current_char);
@@ -79,43 +290,64 @@ namespace test {
 		return result;
 	}
 
-	TestError::TestError(const std::string& str, Type type) {
+	void TestError::List::clear() {
+		first = nullptr;
+		last = nullptr;
+		count = 0;
+	}
+
+	void TestError::List::push_back(TestError* error) {
+		if (last) {
+			last->next = error;
+		} else {
+			first = error;
+		}
+		last = error;
+		count++;
+	}
+
+	TestError::TestError(ErrorArena* arena, std::string_view str, Type type) {
+		this->arena = arena;
 		this->str = str;
 		this->type = type;
-		this->raw = false;
 	}
 
-	TestError* TestError::add(const std::string& message, Type type) {
-		std::unique_ptr<TestError> uptr = std::make_unique<TestError>(message, type);
-		TestError* ptr = uptr.get();
-        ptr->raw = raw;
-		subentries.push_back(std::move(uptr));
+	TestError* TestError::add(std::string_view message, Type type) {
+		if (arena->isOverflow(this)) {
+			arena->dropped_count++;
+			return this;
+		}
+		TestError* ptr = arena->create(message, type);
+		if (arena->isOverflow(ptr)) {
+			arena->dropped_count++;
+			return ptr;
+		}
+		ptr->raw = raw;
+		subentries.push_back(ptr);
 		return ptr;
 	}
 
-	void TestError::log() const {
-		if (type == Type::Container) {
-			std::function<bool(const TestError& error)> has_non_container_subentries = [&](const TestError& error) {
-				for (auto& subentry : error.subentries) {
-					if (subentry->type != Type::Container) {
-						return true;
-					} else {
-						if (has_non_container_subentries(*subentry)) {
-							return true;
-						}
-					}
-				}
+	bool TestError::isEmptyContainer() const {
+		if (type != Type::Container) {
+			return false;
+		}
+		for (const TestError* subentry : subentries) {
+			if (!subentry->isEmptyContainer()) {
 				return false;
-			};
-			if (!has_non_container_subentries(*this)) {
-				return;
 			}
 		}
+		return true;
+	}
+
+	void TestError::log() const {
+		if (isEmptyContainer()) {
+			return;
+		}
 		if (type != Type::Root) {
 			if (raw) {
-				logger << str << "\n";
+				logger << std::string(str) << "\n";
 			} else {
-				std::string esc_str = Test::char_to_esc(str, false);
+				std::string esc_str = Test::char_to_esc(std::string(str), false);
 				logger << esc_str << "\n";
 			}
 		}
@@ -125,14 +357,68 @@ namespace test {
 				subentry->log();
 			}
 		}
+		if (type == Type::Root && arena->dropped_count > 0) {
+			logger << "... " << arena->dropped_count << " more entries not stored (limit " << arena->max_entries << ")\n";
+		}
+	}
+
+	// error entries outlive the test, so they are not counted as its allocations
+	ErrorArena::ErrorArena()
+	: resource(untrackedResource()), root(this, "root", TestError::Type::Root), overflow(this, "", TestError::Type::Root) { }
+
+	TestError* ErrorArena::create(std::string_view str, TestError::Type type) {
+		if (max_entries > 0 && entry_count >= max_entries) {
+			return &overflow;
+		}
+		if (type != TestError::Type::Root) {
+			entry_count++;
+		}
+		void* memory = resource.allocate(sizeof(TestError), alignof(TestError));
+		return new (memory) TestError(this, copyString(str), type);
+	}
+
+	std::string_view ErrorArena::copyString(std::string_view str) {
+		if (str.empty()) {
+			return std::string_view();
+		}
+		char* memory = static_cast<char*>(resource.allocate(str.size(), 1));
+		std::copy(str.begin(), str.end(), memory);
+		return std::string_view(memory, str.size());
+	}
+
+	bool ErrorArena::isOverflow(const TestError* error) const {
+		return error == &overflow;
+	}
+
+	TestError* ErrorArena::getRoot() {
+		return &root;
+	}
+
+	void ErrorArena::release() {
+		// entries are trivially destructible, so the memory is just dropped
+		resource.release();
+		root.subentries.clear();
+		overflow.subentries.clear();
+		entry_count = 0;
+		dropped_count = 0;
+	}
+
+	void ResultStore::clear() {
+		for (std::vector<Test*>& list : tests) {
+			list.clear();
+		}
+		empty_modules.clear();
+	}
+
+	// growing the error stack is not an allocation of the test
+	ErrorContainer::ErrorContainer(Test& test, const SourceLocation& location, const char* message) : test(test) {
+		AllocationPause allocation_pause;
+		test.error_stack.push_back({ nullptr, location, message, std::string() });
 	}
 
-	ErrorContainer::ErrorContainer(Test& test, const std::string& file, size_t line, const std::string& message) : test(test) {
-		std::string filename = std::filesystem::path(file).filename().string();
-		std::string location_str = "[" + filename + ":" + std::to_string(line) + "]";
-		std::string space_str = message.size() > 0 ? " " : "";
-		TestError* error = test.getCurrentError()->add(message + space_str + location_str, TestError::Type::Container);
-		test.error_stack.push(error);
+	ErrorContainer::ErrorContainer(Test& test, const SourceLocation& location, std::string message) : test(test) {
+		AllocationPause allocation_pause;
+		test.error_stack.push_back({ nullptr, location, "", std::move(message) });
 	}
 
 	ErrorContainer::~ErrorContainer() {
@@ -140,33 +426,244 @@ namespace test {
 	}
 
 	void ErrorContainer::close() {
-		test.error_stack.pop();
+		test.error_stack.pop_back();
 	}
 
 	TestModule::TestModule(const std::string& name, TestModule* parent, const std::vector<TestNode*>& required_nodes) {
 		this->name = name;
 		this->parent = parent;
 		this->required_nodes = required_nodes;
+		this->kind = NodeKind::Module;
 	}
 
 	Test* TestModule::addTest(const std::string& name, TestFuncType func) {
-		return addTest(name, { }, func);
+		return addTest(name, { }, std::move(func));
 	}
 
 	Test* TestModule::addTest(const std::string& name, const std::vector<TestNode*>& required, TestFuncType func) {
-		std::unique_ptr<Test> uptr = std::make_unique<Test>(name, required, func);
-		Test* ptr = uptr.get();
-		children.push_back(std::move(uptr));
+		Test* ptr = test_storage.emplace(name, required, std::move(func));
+		ptr->parent = this;
+		children.push_back(ptr);
+		getRoot()->selection.invalidateIndex();
+		return ptr;
+	}
+
+	Benchmark* TestModule::addBenchmark(const std::string& name, BenchmarkFuncType func) {
+		return addBenchmark(name, { }, std::move(func));
+	}
+
+	Benchmark* TestModule::addBenchmark(const std::string& name, const std::vector<TestNode*>& required, BenchmarkFuncType func) {
+		std::unique_ptr<Benchmark> uptr = std::make_unique<Benchmark>(name, required, std::move(func));
+		Benchmark* ptr = uptr.get();
+		ptr->parent = this;
+		children.push_back(ptr);
+		owned_nodes.push_back(std::move(uptr));
+		getRoot()->selection.invalidateIndex();
+		return ptr;
+	}
+
+	FuzzTest* TestModule::addFuzzTest(const std::string& name, const std::filesystem::path& corpus_dir, FuzzFuncType func) {
+		return addFuzzTest(name, { }, corpus_dir, std::move(func));
+	}
+
+	FuzzTest* TestModule::addFuzzTest(
+		const std::string& name, const std::vector<TestNode*>& required, const std::filesystem::path& corpus_dir, FuzzFuncType func
+	) {
+		std::unique_ptr<FuzzTest> uptr = std::make_unique<FuzzTest>(name, required, corpus_dir, std::move(func));
+		FuzzTest* ptr = uptr.get();
+		ptr->parent = this;
+		children.push_back(ptr);
+		owned_nodes.push_back(std::move(uptr));
+		getRoot()->selection.invalidateIndex();
+		return ptr;
+	}
+
+	StressTest* TestModule::addStressTest(const std::string& name, size_t thread_count, size_t iterations, StressFuncType func) {
+		return addStressTest(name, { }, thread_count, iterations, std::move(func));
+	}
+
+	StressTest* TestModule::addStressTest(
+		const std::string& name, const std::vector<TestNode*>& required, size_t thread_count, size_t iterations, StressFuncType func
+	) {
+		std::unique_ptr<StressTest> uptr = std::make_unique<StressTest>(name, required, std::move(func));
+		StressTest* ptr = uptr.get();
+		ptr->thread_count = thread_count;
+		ptr->iterations = iterations;
+		ptr->parent = this;
+		children.push_back(ptr);
+		owned_nodes.push_back(std::move(uptr));
+		getRoot()->selection.invalidateIndex();
 		return ptr;
 	}
 
 	TestModule* TestModule::addModule(const std::string& name, const std::vector<TestNode*>& required) {
 		std::unique_ptr<TestModule> uptr = std::make_unique<TestModule>(name, this, required);
 		TestModule* ptr = uptr.get();
-		children.push_back(std::move(uptr));
+		children.push_back(ptr);
+		owned_nodes.push_back(std::move(uptr));
+		getRoot()->selection.invalidateIndex();
 		return ptr;
 	}
 
+	FixtureBase::FixtureBase(std::string name, FixtureScope scope) {
+		this->name = std::move(name);
+		this->scope = scope;
+	}
+
+	bool FixtureBase::isBuilt() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return instance != nullptr;
+	}
+
+	size_t FixtureBase::getBuildCount() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return build_count;
+	}
+
+	void* FixtureBase::acquire(Test& test) {
+		if (scope == FixtureScope::Test) {
+			for (auto& [fixture, test_instance] : test.fixture_instances) {
+				if (fixture == this) {
+					return test_instance.get();
+				}
+			}
+			std::shared_ptr<void> test_instance = build();
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				build_count++;
+			}
+			test.fixture_instances.push_back({ this, test_instance });
+			return test_instance.get();
+		}
+		std::vector<FixtureBase*> declared = test.getFixtures();
+		std::lock_guard<std::mutex> lock(mutex);
+		// nothing tells when an undeclared user is done
+		if (std::find(declared.begin(), declared.end(), this) == declared.end()) {
+			pinned = true;
+		}
+		if (!instance) {
+			instance = build();
+			build_count++;
+		}
+		return instance.get();
+	}
+
+	void FixtureBase::finishUser() {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (remaining_users > 0 && --remaining_users == 0 && !pinned) {
+			instance.reset();
+		}
+	}
+
+	void FixtureBase::tearDown() {
+		std::lock_guard<std::mutex> lock(mutex);
+		instance.reset();
+		remaining_users = 0;
+		pinned = false;
+	}
+
+	void TestModule::countFixtureUsers(const std::vector<Test*>& all_tests) {
+		for (Test* test : all_tests) {
+			if (!test->selected) {
+				continue;
+			}
+			for (FixtureBase* fixture : test->getFixtures()) {
+				if (fixture->scope != FixtureScope::Test) {
+					std::lock_guard<std::mutex> lock(fixture->mutex);
+					fixture->remaining_users++;
+				}
+			}
+		}
+	}
+
+	void TestModule::tearDownFixtures(bool run_end) {
+		for (std::unique_ptr<FixtureBase>& fixture : owned_fixtures) {
+			if (run_end || fixture->scope == FixtureScope::Module) {
+				fixture->tearDown();
+			}
+		}
+		if (run_end) {
+			for (TestModule* module : getChildModules()) {
+				module->tearDownFixtures(true);
+			}
+		}
+	}
+
+	// zero-initialized before any registration runs
+	static RegisteredNode* first_registered = nullptr;
+	static RegisteredNode* last_registered = nullptr;
+	static size_t registered_count = 0;
+
+	RegisteredNode::RegisteredNode(const char* path, TestFuncPtr test_func) {
+		this->path = path;
+		this->test_func = test_func;
+		link();
+	}
+
+	RegisteredNode::RegisteredNode(const char* path, AddModuleFuncType add_module) {
+		this->path = path;
+		this->add_module = add_module;
+		link();
+	}
+
+	RegisteredNode* RegisteredNode::getFirst() {
+		return first_registered;
+	}
+
+	size_t RegisteredNode::getCount() {
+		return registered_count;
+	}
+
+	void RegisteredNode::link() {
+		index = registered_count++;
+		if (last_registered) {
+			last_registered->next = this;
+		} else {
+			first_registered = this;
+		}
+		last_registered = this;
+	}
+
+	void TestModule::addRegisteredNodes() {
+		added_registered.resize(RegisteredNode::getCount());
+		// modules first, so tests registered inside them find them
+		for (bool modules : { true, false }) {
+			for (RegisteredNode* entry = RegisteredNode::getFirst(); entry; entry = entry->next) {
+				if (added_registered[entry->index] || (entry->add_module != nullptr) != modules) {
+					continue;
+				}
+				std::string_view path = entry->path;
+				if (!selection.mayMatch(path, modules)) {
+					continue;
+				}
+				size_t separator = path.rfind('/');
+				TestModule* parent = separator == std::string_view::npos ? this : getOrAddModule(path.substr(0, separator));
+				std::string name(separator == std::string_view::npos ? path : path.substr(separator + 1));
+				if (modules) {
+					entry->add_module(*parent, name);
+				} else {
+					parent->addTest(name, entry->test_func);
+				}
+				added_registered[entry->index] = true;
+			}
+		}
+	}
+
+	TestModule* TestModule::getOrAddModule(std::string_view path) {
+		TestModule* module = this;
+		size_t start = 0;
+		while (start <= path.size()) {
+			size_t end = std::min(path.find('/', start), path.size());
+			std::string_view name = path.substr(start, end - start);
+			auto it = std::find_if(module->children.begin(), module->children.end(), [&](TestNode* node) {
+				return node->asModule() && node->name == name;
+			});
+			module = it != module->children.end() ? (*it)->asModule() : module->addModule(std::string(name));
+			start = end + 1;
+		}
+		return module;
+	}
+
 	TestModule* TestModule::getRoot() {
 		TestModule* currentModule = this;
 		while (currentModule) {
@@ -178,18 +675,34 @@ namespace test {
 		return currentModule;
 	}
 
+	const TestModule* TestModule::getRoot() const {
+		return const_cast<TestModule*>(this)->getRoot();
+	}
+
+	size_t TestModule::getResultCount(ResultStore::Status status) const {
+		return result_ranges[status].end - result_ranges[status].begin;
+	}
+
+	std::span<Test* const> TestModule::getResults(ResultStore::Status status) const {
+		const std::vector<Test*>& tests = getRoot()->result_store.tests[status];
+		return std::span<Test* const>(tests.data() + result_ranges[status].begin, getResultCount(status));
+	}
+
+	std::span<TestModule* const> TestModule::getEmptyModules() const {
+		const std::vector<TestModule*>& modules = getRoot()->result_store.empty_modules;
+		return std::span<TestModule* const>(
+			modules.data() + empty_module_range.begin, empty_module_range.end - empty_module_range.begin
+		);
+	}
+
 	std::vector<TestNode*> TestModule::getChildren() const {
-		std::vector<TestNode*> result;
-		for (size_t i = 0; i < children.size(); i++) {
-			result.push_back(children[i].get());
-		}
-		return result;
+		return children;
 	}
 
 	std::vector<Test*> TestModule::getChildTests() const {
 		std::vector<Test*> result;
-		for (size_t i = 0; i < children.size(); i++) {
-			if (Test* test = dynamic_cast<Test*>(children[i].get())) {
+		for (TestNode* node : children) {
+			if (Test* test = node->asTest()) {
 				result.push_back(test);
 			}
 		}
@@ -198,8 +711,8 @@ namespace test {
 
 	std::vector<TestModule*> TestModule::getChildModules() const {
 		std::vector<TestModule*> result;
-		for (size_t i = 0; i < children.size(); i++) {
-			if (TestModule* module = dynamic_cast<TestModule*>(children[i].get())) {
+		for (TestNode* node : children) {
+			if (TestModule* module = node->asModule()) {
 				result.push_back(module);
 			}
 		}
@@ -208,20 +721,25 @@ namespace test {
 
 	std::vector<Test*> TestModule::getAllTests() const {
 		std::vector<Test*> result;
-		for (size_t i = 0; i < children.size(); i++) {
-			TestNode* node = children[i].get();
-			if (Test* test = dynamic_cast<Test*>(node)) {
+		collectTests(result);
+		return result;
+	}
+
+	void TestModule::collectTests(std::vector<Test*>& result) const {
+		for (TestNode* node : children) {
+			if (Test* test = node->asTest()) {
 				result.push_back(test);
-			} else if (TestModule* module = dynamic_cast<TestModule*>(node)) {
-				std::vector<Test*> module_tests = module->getAllTests();
-				result.insert(result.end(), module_tests.begin(), module_tests.end());
+			} else {
+				node->asModule()->collectTests(result);
 			}
 		}
-		return result;
 	}
 
 	bool TestModule::run() {
 		if (isRoot()) {
+			if (add_registered) {
+				addRegisteredNodes();
+			}
 			std::vector<Test*> all_tests = getAllTests();
 			for (Test* test : all_tests) {
 				if (test->name.size() > max_test_name) {
@@ -229,45 +747,212 @@ namespace test {
 				}
 			}
 			logger << name << "\n";
+			if (!fuzz_target.empty()) {
+				return runFuzzTarget(all_tests);
+			}
+			resetResults();
+			result_store.clear();
+			size_t selected_count = selection.apply(*this);
+			if (!selection.isEmpty()) {
+				logger << "Selected " << selected_count << " of " << all_tests.size() << " tests\n";
+			}
+			if (shard_count > 1) {
+				Baseline timings;
+				std::filesystem::path timing_path = shard_timing_file.empty() ? baseline_file : shard_timing_file;
+				bool has_timings = !timing_path.empty() && timings.load(timing_path);
+				selected_count = selection.applyShard(shard_index, shard_count, has_timings ? &timings : nullptr);
+				logger << "Shard " << shard_index << " of " << shard_count << ": " << selected_count << " tests\n";
+			}
+			if (list_only) {
+				for (Test* test : all_tests) {
+					if (test->selected) {
+						logger << test->getPath() << "\n";
+					}
+				}
+				return true;
+			}
+			ResultCache cache_store;
+			if (!cache_file.empty()) {
+				cache_store.load(cache_file);
+				result_cache = &cache_store;
+				applyResultCache(all_tests);
+			}
+			// created before the watchdog thread, the pool forks its zygote while this process is single-threaded
+			std::unique_ptr<IsolationPool> pool;
+			if (isolated) {
+				if (IsolationPool::isSupported()) {
+					pool = std::make_unique<IsolationPool>(*this, parallel ? thread_count : 1);
+					isolation_pool = pool.get();
+				} else {
+					logger << "WARNING: isolated mode is not supported on this platform, running in-process\n";
+				}
+			}
+			std::unique_ptr<Watchdog> watchdog_store;
+			if (std::any_of(all_tests.begin(), all_tests.end(), [](Test* test) {
+				return test->selected && test->getTimeout() > std::chrono::nanoseconds::zero();
+			})) {
+				watchdog_store = std::make_unique<Watchdog>();
+				if (pool) {
+					pool->setWatchdog(watchdog_store.get());
+				}
+			}
+			// set after the pool is created, so forked workers don't use it
+			watchdog = watchdog_store.get();
+			if (hardware_counters && !PerfCounterGroup::forCurrentThread().getError().empty()) {
+				logger << "WARNING: " << PerfCounterGroup::forCurrentThread().getError() << "\n";
+			}
+			Baseline baseline_store;
+			if (!baseline_file.empty()) {
+				baseline_store.load(baseline_file);
+				baseline = &baseline_store;
+			}
+			countFixtureUsers(all_tests);
+			if (parallel) {
+				Logger::disableStdWrite();
+				logger.manualDeactivate();
+				Scheduler scheduler(*this, thread_count);
+				scheduler.run();
+				logger.manualActivate();
+				Logger::enableStdWrite();
+			}
+			bool result = runModule();
+			tearDownFixtures(true);
+			if (baseline) {
+				updateBaseline();
+				baseline = nullptr;
+			}
+			if (result_cache) {
+				updateResultCache(all_tests);
+				result_cache = nullptr;
+			}
+			isolation_pool = nullptr;
+			watchdog = nullptr;
+			return result;
+		}
+		return runModule();
+	}
+
+	bool TestModule::runFuzzTarget(const std::vector<Test*>& all_tests) {
+		auto it = std::find_if(all_tests.begin(), all_tests.end(), [&](Test* test) {
+			return test->asFuzz() && test->getPath() == fuzz_target;
+		});
+		if (it == all_tests.end()) {
+			logger << "ERROR: no fuzz test " << fuzz_target << "\n";
+			return false;
+		}
+		FuzzTest* test = (*it)->asFuzz();
+		logger << "Fuzzing " << fuzz_target << "\n";
+		if (!FuzzTest::hasCoverage()) {
+			logger << "WARNING: no coverage instrumentation, inputs are mutated blindly\n";
+		}
+		// the target and the root module both carry the result, like after a regular run
+		test->result = test->fuzz(fuzz_runs, fuzz_time);
+		result = test->result;
+		is_run = true;
+		LoggerIndent stats_indent;
+		logger << test->getFuzzStatsString() << "\n";
+		if (result) {
+			logger << "passed" << "\n";
+		} else {
+			logger << "FAILED" << "\n";
+			LoggerIndent errors_indent;
+			test->root_error->log();
 		}
+		return result;
+	}
+
+	bool TestModule::runModule() {
+		TestModule* root = getRoot();
+		ResultStore& store = root->result_store;
+		beginResults();
+		wall_time = std::chrono::nanoseconds::zero();
+		cpu_time = std::chrono::nanoseconds::zero();
+		perf_counters = PerfCounters();
+		allocation_stats = AllocationStats();
+		// in parallel mode tests and hooks are already run by the scheduler
+		bool executed = getRoot()->parallel;
 		LoggerIndent test_list_indent(1, isRoot());
-		beforeRunModule();
-		OnBeforeRun();
-		for (auto& node : children) {
-			if (Test* test = dynamic_cast<Test*>(node.get())) {
+		for (auto& reporter : root->reporters) {
+			reporter->onModuleStart(*this);
+		}
+		root->reported_modules.push_back(this);
+		if (!executed) {
+			beforeRunModule();
+			OnBeforeRun();
+		}
+		for (TestNode* node : children) {
+			if (!node->selected) {
+				continue;
+			}
+			if (Test* test = node->asTest()) {
 				std::string spacing_str;
 				size_t spacing_size = getRoot()->max_test_name - test->name.size();
 				for (size_t i = 0; i < spacing_size; i++) {
 					spacing_str += "-";
 				}
 				logger << test->name << spacing_str << "|" << LoggerFlush();
-				Logger::disableStdWrite();
-				logger.manualDeactivate();
-				OnBeforeRunTest();
-				bool result = test->run();
-				OnAfterRunTest();
-				logger.manualActivate();
-				Logger::enableStdWrite();
-				if (result) {
-					logger << "passed" << "\n";
-					passed_list.push_back(test->name);
+				root->reportTestStart(test);
+				if (!executed) {
+					Logger::disableStdWrite();
+					logger.manualDeactivate();
+					OnBeforeRunTest();
+					test->run();
+					OnAfterRunTest();
+					logger.manualActivate();
+					Logger::enableStdWrite();
+				}
+				wall_time += test->wall_time;
+				cpu_time += test->cpu_time;
+				perf_counters += test->perf_counters;
+				allocation_stats += test->allocation_stats;
+				Benchmark* benchmark = test->asBenchmark();
+				if (test->result) {
+					if (test->cached) {
+						logger << "cached" << "\n";
+						store.tests[ResultStore::Passed].push_back(test);
+					} else if (getRoot()->checkBaseline(test)) {
+						store.tests[ResultStore::Regressed].push_back(test);
+					} else {
+						logger << "passed" << "\n";
+						store.tests[ResultStore::Passed].push_back(test);
+					}
+					if (benchmark && benchmark->hasStats()) {
+						LoggerIndent stats_indent;
+						logger << benchmark->getStatsString() << "\n";
+					}
+					ParameterizedTest* parameterized = test->asParameterized();
+					if (parameterized && !test->cached) {
+						LoggerIndent cases_indent;
+						logger << parameterized->getCasesString() << "\n";
+					}
+					StressTest* stress = test->asStress();
+					if (stress && !test->cached) {
+						LoggerIndent iterations_indent;
+						logger << stress->getIterationsString() << "\n";
+					}
 				} else {
 					if (test->cancelled) {
 						logger << "cancelled" << "\n";
-						cancelled_list.push_back(test->name);
+						store.tests[ResultStore::Cancelled].push_back(test);
+					} else if (test->timed_out) {
+						logger << "TIMEOUT" << "\n";
+						LoggerIndent errors_indent;
+						test->root_error->log();
+						store.tests[ResultStore::Failed].push_back(test);
 					} else {
 						logger << "FAILED" << "\n";
 						LoggerIndent errors_indent;
 						test->root_error->log();
-						failed_list.push_back(test->name);
+						store.tests[ResultStore::Failed].push_back(test);
 					}
 				}
-			} else if (TestModule* module = dynamic_cast<TestModule*>(node.get())) {
+				root->reportTestEnd(test);
+			} else if (TestModule* module = node->asModule()) {
 				logger << module->name << "\n";
 				LoggerIndent test_list_indent;
 				bool cancelled = false;
 				if (module->children.empty()) {
-					empty_module_list.push_back(module->name);
+					store.empty_modules.push_back(module);
 				}
 				for (TestNode* req_node : module->required_nodes) {
 					if (!req_node->result) {
@@ -276,91 +961,661 @@ namespace test {
 					}
 				}
 				if (cancelled) {
-					std::vector<Test*> tests = module->getAllTests();
-					for (Test* test : tests) {
-						test->cancelled = true;
-						module->cancelled_list.push_back(test->name);
+					for (auto& reporter : root->reporters) {
+						reporter->onModuleStart(*module);
+					}
+					module->beginResults();
+					size_t cancelled_count = 0;
+					for (Test* test : module->getAllTests()) {
+						if (!test->selected) {
+							continue;
+						}
+						// in parallel mode the scheduler already cancelled it
+						if (!executed) {
+							test->cancel();
+						}
+						store.tests[ResultStore::Cancelled].push_back(test);
+						root->reportTestEnd(test);
+						cancelled_count++;
+					}
+					module->endResults();
+					logger << "Cancelled " << cancelled_count << " tests\n";
+					for (auto& reporter : root->reporters) {
+						reporter->onModuleEnd(*module);
 					}
-					logger << "Cancelled " << tests.size() << " tests\n";
 				} else {
 					module->run();
 				}
-				for (const std::string& name : module->passed_list) {
-					passed_list.push_back(module->name + "/" + name);
+				wall_time += module->wall_time;
+				cpu_time += module->cpu_time;
+				perf_counters += module->perf_counters;
+				allocation_stats += module->allocation_stats;
+			}
+		}
+		if (!executed) {
+			afterRunModule();
+			OnAfterRun();
+			tearDownFixtures(false);
+		}
+		is_run = true;
+		endResults();
+		result = getResultCount(ResultStore::Cancelled) == 0 && getResultCount(ResultStore::Failed) == 0
+			&& getResultCount(ResultStore::Regressed) == 0;
+		root->reported_modules.pop_back();
+		for (auto& reporter : root->reporters) {
+			reporter->onModuleEnd(*this);
+		}
+		return result;
+	}
+
+	bool TestModule::parseArguments(int argc, const char* const argv[]) {
+		for (int i = 1; i < argc; i++) {
+			std::string_view arg = argv[i];
+			std::string_view value;
+			size_t equals_pos = arg.find('=');
+			bool has_value = equals_pos != std::string_view::npos;
+			if (has_value) {
+				value = arg.substr(equals_pos + 1);
+				arg = arg.substr(0, equals_pos);
+			}
+			auto next_value = [&]() {
+				if (!has_value && i + 1 < argc) {
+					value = argv[++i];
+					has_value = true;
+				}
+				if (!has_value) {
+					logger << "ERROR: missing value for " << std::string(arg) << "\n";
+				}
+				return has_value;
+			};
+			if (arg == "--isolate") {
+				isolated = true;
+			} else if (arg == "--list") {
+				list_only = true;
+			} else if (arg == "--shard-index" || arg == "--shard-count") {
+				if (!next_value()) {
+					return false;
+				}
+				size_t number = 0;
+				std::from_chars_result parsed = std::from_chars(value.data(), value.data() + value.size(), number);
+				if (value.empty() || parsed.ec != std::errc() || parsed.ptr != value.data() + value.size()) {
+					logger << "ERROR: invalid value " << std::string(value) << " for " << std::string(arg) << "\n";
+					return false;
+				}
+				if (arg == "--shard-index") {
+					shard_index = number;
+				} else {
+					shard_count = number;
+				}
+			} else if (arg == "--shard-timings") {
+				if (!next_value()) {
+					return false;
+				}
+				shard_timing_file = std::string(value);
+			} else if (arg == "--junit-report") {
+				if (!next_value()) {
+					return false;
+				}
+				addReporter<JUnitReporter>(std::string(value));
+			} else if (arg == "--jsonl-report") {
+				if (!next_value()) {
+					return false;
+				}
+				addReporter<JsonLinesReporter>(std::string(value));
+			} else if (arg == "--timeout") {
+				if (!next_value()) {
+					return false;
+				}
+				double seconds = std::strtod(std::string(value).c_str(), nullptr);
+				timeout = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(seconds));
+			} else if (arg == "--fuzz") {
+				if (!next_value()) {
+					return false;
+				}
+				fuzz_target = std::string(value);
+			} else if (arg == "--fuzz-runs") {
+				if (!next_value()) {
+					return false;
 				}
-				for (const std::string& name : module->cancelled_list) {
-					cancelled_list.push_back(module->name + "/" + name);
+				fuzz_runs = std::strtoull(std::string(value).c_str(), nullptr, 10);
+			} else if (arg == "--fuzz-time") {
+				if (!next_value()) {
+					return false;
 				}
-				for (const std::string& name : module->failed_list) {
-					failed_list.push_back(module->name + "/" + name);
+				double seconds = std::strtod(std::string(value).c_str(), nullptr);
+				fuzz_time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(seconds));
+			} else if (arg == "--seed") {
+				if (!next_value()) {
+					return false;
 				}
-				for (const std::string& name : module->empty_module_list) {
-					empty_module_list.push_back(module->name + "/" + name);
+				seed = std::strtoull(std::string(value).c_str(), nullptr, 10);
+			} else if (arg == "--update-snapshots") {
+				update_snapshots = true;
+			} else if (arg == "--snapshot-dir") {
+				if (!next_value()) {
+					return false;
+				}
+				snapshot_dir = std::string(value);
+			} else if (arg == "--failed-first") {
+				failed_first = true;
+			} else if (arg == "--cache") {
+				if (!next_value()) {
+					return false;
+				}
+				cache_file = std::string(value);
+			} else if (arg == "--jobs") {
+				if (!next_value()) {
+					return false;
+				}
+				parallel = true;
+				thread_count = std::strtoul(std::string(value).c_str(), nullptr, 10);
+			} else if (arg == "--filter" || arg == "--exclude") {
+				if (!next_value()) {
+					return false;
+				}
+				if (arg == "--filter") {
+					selection.include(value);
+				} else {
+					selection.exclude(value);
+				}
+			} else if (arg == "--filter-regex" || arg == "--exclude-regex") {
+				if (!next_value()) {
+					return false;
+				}
+				try {
+					std::regex check(value.begin(), value.end());
+				} catch (const std::regex_error& error) {
+					logger << "ERROR: invalid regex " << std::string(value) << ": " << error.what() << "\n";
+					return false;
+				}
+				if (arg == "--filter-regex") {
+					selection.includeRegex(value);
+				} else {
+					selection.excludeRegex(value);
+				}
+			} else if (arg == "--tag" || arg == "--exclude-tag") {
+				if (!next_value()) {
+					return false;
+				}
+				if (arg == "--tag") {
+					selection.includeTag(value);
+				} else {
+					selection.excludeTag(value);
 				}
+			} else {
+				logger << "ERROR: unknown argument " << std::string(arg) << "\n";
+				return false;
 			}
 		}
-		afterRunModule();
-		OnAfterRun();
-		is_run = true;
-		result = cancelled_list.empty() && failed_list.empty();
-		return result;
+		if (shard_count == 0) {
+			logger << "ERROR: shard count must be at least 1\n";
+			return false;
+		}
+		if (shard_index >= shard_count) {
+			logger << "ERROR: shard index " << shard_index << " is out of range for " << shard_count << " shards\n";
+			return false;
+		}
+		return true;
 	}
 
 	void TestModule::printSummary() {
-		logger << "Passed " << passed_list.size() << " tests, "
-			<< "cancelled " << cancelled_list.size() << " tests, "
-			<< "failed " << failed_list.size() << " tests";
-		if (failed_list.size() > 0) {
+		size_t passed_count = getResultCount(ResultStore::Passed);
+		size_t cancelled_count = getResultCount(ResultStore::Cancelled);
+		size_t failed_count = getResultCount(ResultStore::Failed);
+		size_t regressed_count = getResultCount(ResultStore::Regressed);
+		logger << "Passed " << passed_count << " tests, "
+			<< "cancelled " << cancelled_count << " tests, "
+			<< "failed " << failed_count << " tests";
+		if (regressed_count > 0) {
+			logger << ", regressed " << regressed_count << " tests";
+		}
+		if (failed_count > 0 || regressed_count > 0) {
 			logger << ":\n";
 			LoggerIndent failed_list_indent;
-			for (const std::string& name : failed_list) {
-				logger << name << "\n";
+			for (Test* test : getResults(ResultStore::Failed)) {
+				logger << test->getPath(this) << (test->timed_out ? " (TIMEOUT)" : "") << "\n";
+			}
+			for (Test* test : getResults(ResultStore::Regressed)) {
+				logger << test->getPath(this) << " (REGRESSED)\n";
 			}
 		} else {
 			logger << "\n";
 		}
-		if (empty_module_list.size() > 0) {
-			logger << "WARNING: " << empty_module_list.size() << " empty modules:\n";
+		std::span<TestModule* const> empty_modules = getEmptyModules();
+		if (empty_modules.size() > 0) {
+			logger << "WARNING: " << empty_modules.size() << " empty modules:\n";
 			LoggerIndent empty_modules_list_indent;
-			for (const std::string& module_name : empty_module_list) {
-				logger << module_name << "\n";
+			for (TestModule* module : empty_modules) {
+				logger << module->getPath(this) << "\n";
 			}
 		}
+		printSlowest();
+		printBenchmarks();
+		printCounters();
+		printAllocations();
 		if (isRoot()) {
-			if (passed_list.size() > 0 && cancelled_list.empty() && failed_list.empty()) {
+			if (passed_count > 0 && cancelled_count == 0 && failed_count == 0 && regressed_count == 0) {
 				logger << "ALL PASSED\n";
 			}
 		}
 	}
 
+	void TestModule::printSlowest() {
+		if (slowest_count == 0) {
+			return;
+		}
+		auto by_wall_time = [](const TestNode* left, const TestNode* right) {
+			return left->wall_time > right->wall_time;
+		};
+		auto print_list = [&](const char* title, std::vector<TestNode*>& nodes) {
+			size_t count = std::min(slowest_count, nodes.size());
+			if (count == 0) {
+				return;
+			}
+			std::partial_sort(nodes.begin(), nodes.begin() + count, nodes.end(), by_wall_time);
+			std::vector<std::string> paths;
+			size_t max_path = 0;
+			for (size_t i = 0; i < count; i++) {
+				paths.push_back(nodes[i]->getPath(this));
+				max_path = std::max(max_path, paths.back().size());
+			}
+			logger << title << ":\n";
+			LoggerIndent slowest_list_indent;
+			for (size_t i = 0; i < count; i++) {
+				std::string spacing_str(max_path - paths[i].size(), ' ');
+				logger << paths[i] << spacing_str << " "
+					<< formatDuration(nodes[i]->wall_time) << " (cpu " << formatDuration(nodes[i]->cpu_time) << ")\n";
+			}
+		};
+		std::vector<TestNode*> tests;
+		for (Test* test : getAllTests()) {
+			if (test->is_run && !test->asBenchmark()) {
+				tests.push_back(test);
+			}
+		}
+		print_list("Slowest tests", tests);
+		std::vector<TestNode*> modules;
+		std::vector<TestModule*> module_stack = getChildModules();
+		while (!module_stack.empty()) {
+			TestModule* module = module_stack.back();
+			module_stack.pop_back();
+			if (module->is_run) {
+				modules.push_back(module);
+			}
+			std::vector<TestModule*> child_modules = module->getChildModules();
+			module_stack.insert(module_stack.end(), child_modules.begin(), child_modules.end());
+		}
+		print_list("Slowest modules", modules);
+	}
+
+	void TestModule::printBenchmarks() {
+		std::vector<Benchmark*> benchmarks;
+		size_t max_path = 0;
+		for (Test* test : getAllTests()) {
+			Benchmark* benchmark = test->asBenchmark();
+			if (benchmark && benchmark->is_run && benchmark->hasStats()) {
+				benchmarks.push_back(benchmark);
+				max_path = std::max(max_path, benchmark->getPath(this).size());
+			}
+		}
+		if (benchmarks.empty()) {
+			return;
+		}
+		logger << "Benchmarks:\n";
+		LoggerIndent benchmark_list_indent;
+		for (Benchmark* benchmark : benchmarks) {
+			std::string path = benchmark->getPath(this);
+			std::string spacing_str(max_path - path.size(), ' ');
+			logger << path << spacing_str << " " << benchmark->getStatsString() << "\n";
+		}
+	}
+
+	void TestModule::printCounters() {
+		if (!perf_counters.isValid()) {
+			return;
+		}
+		logger << "Hardware counters: " << perf_counters.toString() << "\n";
+		std::vector<Test*> tests;
+		for (Test* test : getAllTests()) {
+			if (test->is_run && test->perf_counters.isValid()) {
+				tests.push_back(test);
+			}
+		}
+		size_t count = std::min(slowest_count, tests.size());
+		std::partial_sort(tests.begin(), tests.begin() + count, tests.end(), [](const Test* left, const Test* right) {
+			return left->perf_counters.cycles > right->perf_counters.cycles;
+		});
+		LoggerIndent counter_list_indent;
+		for (size_t i = 0; i < count; i++) {
+			logger << tests[i]->getPath(this) << ": " << tests[i]->perf_counters.toString() << "\n";
+		}
+	}
+
+	void TestModule::printAllocations() {
+		if (!allocation_stats.available) {
+			return;
+		}
+		logger << "Allocations: " << allocation_stats.toString() << "\n";
+		std::vector<Test*> tests;
+		for (Test* test : getAllTests()) {
+			if (test->is_run && test->allocation_stats.allocations > 0) {
+				tests.push_back(test);
+			}
+		}
+		size_t count = std::min(slowest_count, tests.size());
+		std::partial_sort(tests.begin(), tests.begin() + count, tests.end(), [](const Test* left, const Test* right) {
+			return left->allocation_stats.allocations > right->allocation_stats.allocations;
+		});
+		LoggerIndent allocation_list_indent;
+		for (size_t i = 0; i < count; i++) {
+			logger << tests[i]->getPath(this) << ": " << tests[i]->allocation_stats.toString() << "\n";
+		}
+	}
+
+	bool TestModule::checkBaseline(Test* test) {
+		test->regressed = false;
+		if (!baseline) {
+			return false;
+		}
+		const std::vector<double>* baseline_samples = baseline->find(test->getPath());
+		if (!baseline_samples) {
+			return false;
+		}
+		RegressionCheck check = checkRegression(
+			getTimingSamples(*test), *baseline_samples, regression_threshold, regression_alpha
+		);
+		if (check.regressed) {
+			test->regressed = true;
+			logger << "REGRESSED" << "\n";
+			LoggerIndent regression_indent;
+			logger << check.toString() << "\n";
+		}
+		return check.regressed;
+	}
+
+	void TestModule::updateBaseline() {
+		// regressed timings are only accepted on request, so a slowdown
+		// can't slip into the baseline by itself
+		if (getResultCount(ResultStore::Regressed) > 0 && !update_baseline) {
+			return;
+		}
+		for (Test* test : getAllTests()) {
+			if (test->is_run && test->result) {
+				baseline->record(test->getPath(), *test, baseline_history);
+			}
+		}
+		if (!baseline->save(baseline_file)) {
+			logger << "WARNING: could not write baseline file " << baseline_file.string() << "\n";
+		}
+	}
+
+	void TestModule::applyResultCache(const std::vector<Test*>& all_tests) {
+		computeFingerprints(*this, cache_binary_fingerprint);
+		size_t cached_count = 0;
+		std::vector<Test*> failed_tests;
+		for (Test* test : all_tests) {
+			const ResultCache::Entry* entry = result_cache->find(test->getPath());
+			if (!entry) {
+				continue;
+			}
+			test->cached = entry->passed && entry->fingerprint == test->fingerprint;
+			if (test->cached && test->selected) {
+				cached_count++;
+			}
+			if (!entry->passed && test->selected) {
+				failed_tests.push_back(test);
+			}
+		}
+		if (cached_count > 0) {
+			logger << "Reusing " << cached_count << " cached results\n";
+		}
+		if (failed_first && !failed_tests.empty()) {
+			logger << "Running " << failed_tests.size() << " previously failed tests first\n";
+			moveFailedFirst(failed_tests);
+		}
+	}
+
+	void TestModule::updateResultCache(const std::vector<Test*>& all_tests) {
+		for (Test* test : all_tests) {
+			if (test->is_run) {
+				result_cache->record(test->getPath(), test->fingerprint, test->result);
+			}
+		}
+		if (!result_cache->save(cache_file)) {
+			logger << "WARNING: could not write cache file " << cache_file.string() << "\n";
+		}
+	}
+
+	void TestModule::moveFailedFirst(const std::vector<Test*>& failed_tests) {
+		// failed tests, their prerequisites and all modules containing them
+		// move in front of their siblings, relative order is kept so
+		// prerequisites still come before their dependents
+		std::unordered_set<TestNode*> priority;
+		std::vector<TestNode*> stack(failed_tests.begin(), failed_tests.end());
+		while (!stack.empty()) {
+			TestNode* node = stack.back();
+			stack.pop_back();
+			if (!priority.insert(node).second) {
+				continue;
+			}
+			if (TestModule* module = node->asModule()) {
+				for (Test* module_test : module->getAllTests()) {
+					stack.push_back(module_test);
+				}
+			}
+			for (TestNode* ancestor = node; ancestor; ancestor = ancestor->parent) {
+				stack.insert(stack.end(), ancestor->required_nodes.begin(), ancestor->required_nodes.end());
+			}
+		}
+		std::vector<TestNode*> priority_nodes(priority.begin(), priority.end());
+		for (TestNode* node : priority_nodes) {
+			for (TestModule* module = node->parent; module; module = module->parent) {
+				priority.insert(module);
+			}
+		}
+		std::function<void(TestModule*)> reorder = [&](TestModule* module) {
+			std::stable_partition(module->children.begin(), module->children.end(), [&](TestNode* child) {
+				return priority.contains(child);
+			});
+			for (TestModule* child_module : module->getChildModules()) {
+				reorder(child_module);
+			}
+		};
+		reorder(this);
+	}
+
+	void TestModule::reportTestStart(Test* test) {
+		reported_test = test;
+		for (auto& reporter : reporters) {
+			reporter->onTestStart(*test);
+		}
+	}
+
+	void TestModule::reportTestEnd(Test* test) {
+		if (reporters.empty()) {
+			return;
+		}
+		std::function<void(const TestError&, size_t)> report_errors = [&](const TestError& error, size_t depth) {
+			for (const TestError* subentry : error.subentries) {
+				if (subentry->isEmptyContainer()) {
+					continue;
+				}
+				for (auto& reporter : reporters) {
+					reporter->onTestError(*test, *subentry, depth);
+				}
+				report_errors(*subentry, depth + 1);
+			}
+		};
+		if (test->root_error && !test->cancelled) {
+			report_errors(*test->root_error, 0);
+		}
+		for (auto& reporter : reporters) {
+			reporter->onTestEnd(*test);
+		}
+		reported_test = nullptr;
+	}
+
+	void TestModule::exitAfterTimeout(const Test& test, Test& report) {
+		logger.manualActivate();
+		Logger::enableStdWrite();
+		logger << "\n" << test.getPath() << " TIMEOUT\n";
+		{
+			LoggerIndent errors_indent;
+			report.root_error->log();
+		}
+		// in parallel mode nothing is reported before the scheduler finishes,
+		// the modules around the test are opened here
+		std::vector<TestModule*> modules;
+		for (TestModule* module = test.parent; module; module = module->parent) {
+			modules.insert(modules.begin(), module);
+		}
+		for (TestModule* module : modules) {
+			if (std::find(reported_modules.begin(), reported_modules.end(), module) == reported_modules.end()) {
+				module->beginResults();
+				for (auto& reporter : reporters) {
+					reporter->onModuleStart(*module);
+				}
+				reported_modules.push_back(module);
+			}
+		}
+		if (reported_test != &test) {
+			reportTestStart(&report);
+		}
+		result_store.tests[ResultStore::Failed].push_back(&report);
+		reportTestEnd(&report);
+		while (!reported_modules.empty()) {
+			TestModule* module = reported_modules.back();
+			reported_modules.pop_back();
+			module->endResults();
+			module->result = false;
+			for (auto& reporter : reporters) {
+				reporter->onModuleEnd(*module);
+			}
+		}
+		// other tests may still run on the scheduler threads, their results can only be read in sequential mode
+		if (!parallel) {
+			if (baseline) {
+				updateBaseline();
+			}
+			if (result_cache) {
+				result_cache->record(test.getPath(), test.fingerprint, false);
+				updateResultCache(getAllTests());
+			}
+		}
+		logger << "Exiting, the test thread can't be stopped in-process\n" << LoggerFlush();
+		fflush(stdout);
+		std::_Exit(EXIT_FAILURE);
+	}
+
+	void TestModule::beginResults() {
+		ResultStore& store = getRoot()->result_store;
+		for (size_t i = 0; i < ResultStore::StatusCount; i++) {
+			result_ranges[i].begin = store.tests[i].size();
+		}
+		empty_module_range.begin = store.empty_modules.size();
+	}
+
+	void TestModule::endResults() {
+		ResultStore& store = getRoot()->result_store;
+		for (size_t i = 0; i < ResultStore::StatusCount; i++) {
+			result_ranges[i].end = store.tests[i].size();
+		}
+		empty_module_range.end = store.empty_modules.size();
+	}
+
+	void TestModule::resetResults() {
+		for (ResultStore::Range& range : result_ranges) {
+			range = ResultStore::Range();
+		}
+		empty_module_range = ResultStore::Range();
+		for (TestNode* node : children) {
+			node->is_run = false;
+			node->result = false;
+			node->cancelled = false;
+			node->wall_time = std::chrono::nanoseconds::zero();
+			node->cpu_time = std::chrono::nanoseconds::zero();
+			node->perf_counters = PerfCounters();
+			node->allocation_stats = AllocationStats();
+			if (Test* test = node->asTest()) {
+				test->cached = false;
+				test->timed_out = false;
+			} else if (TestModule* module = node->asModule()) {
+				module->resetResults();
+			}
+		}
+	}
+
 	void TestModule::beforeRunModule() { }
 
 	void TestModule::afterRunModule() { }
 
-	void testMessage(Test& test, const std::string& file, size_t line, const std::string& message) {
-		std::string filename = std::filesystem::path(file).filename().string();
-		std::string location_str = "[" + filename + ":" + std::to_string(line) + "]";
-		test.getCurrentError()->add(message + " " + location_str);
+	std::string formatDuration(std::chrono::nanoseconds duration) {
+		const char* units[] = { "ns", "us", "ms", "s" };
+		double value = static_cast<double>(duration.count());
+		size_t unit = 0;
+		while (unit < 3 && value >= 1000.0) {
+			value /= 1000.0;
+			unit++;
+		}
+		char buffer[32];
+		snprintf(buffer, sizeof(buffer), unit == 0 ? "%.0f %s" : "%.3f %s", value, units[unit]);
+		return buffer;
+	}
+
+	std::chrono::nanoseconds threadCpuTime() {
+#ifdef _WIN32
+		FILETIME creation_time, exit_time, kernel_time, user_time;
+		GetThreadTimes(GetCurrentThread(), &creation_time, &exit_time, &kernel_time, &user_time);
+		uint64_t kernel = (static_cast<uint64_t>(kernel_time.dwHighDateTime) << 32) | kernel_time.dwLowDateTime;
+		uint64_t user = (static_cast<uint64_t>(user_time.dwHighDateTime) << 32) | user_time.dwLowDateTime;
+		return std::chrono::nanoseconds((kernel + user) * 100);
+#else
+		timespec time;
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+		return std::chrono::seconds(time.tv_sec) + std::chrono::nanoseconds(time.tv_nsec);
+#endif
+	}
+
+	std::string SourceLocation::toString() const {
+		return "[" + std::string(file) + ":" + std::to_string(line) + "]";
+	}
+
+	void testMessage(Test& test, const SourceLocation& location, std::string_view message) {
+		test.getCurrentError()->add(std::string(message) + " " + location.toString());
+	}
+
+	void checkFail(Test& test, const SourceLocation& location, const char* value_message, std::string_view message) {
+		test.getCurrentError()->add(std::string(message) + ": " + value_message + " " + location.toString());
+		test.result = false;
 	}
 
-	bool testCheck(Test& test, const std::string& file, size_t line, bool value, const std::string& value_message) {
-		if (!value) {
-			std::string filename = std::filesystem::path(file).filename().string();
-			std::string location_str = "[" + filename + ":" + std::to_string(line) + "]";
-			test.getCurrentError()->add("Failed condition: " + value_message + " " + location_str);
-			test.result = false;
+	bool testMaxAllocations(Test& test, const SourceLocation& location, uint64_t max_count) {
+		AllocationStats stats = test.allocation_stats;
+		if (!stats.available || stats.allocations <= max_count) {
+			return true;
 		}
-		return value;
+		// the message is not an allocation of the test
+		AllocationPause allocation_pause;
+		TestError* error = test.getCurrentError()->add("Too many allocations " + location.toString());
+		error->add("Expected at most: " + std::to_string(max_count));
+		error->add("Actual:           " + std::to_string(stats.allocations));
+		test.result = false;
+		return false;
 	}
 
-	bool testCheck(Test& test, const std::string& file, size_t line, bool value, const std::string& value_message, const std::string message) {
-		if (!value) {
-			std::string filename = std::filesystem::path(file).filename().string();
-			std::string location_str = "[" + filename + ":" + std::to_string(line) + "]";
-			test.getCurrentError()->add(message + ": " + value_message + " " + location_str);
-			test.result = false;
+	bool testNoLeaks(Test& test, const SourceLocation& location) {
+		AllocationStats stats = test.allocation_stats;
+		if (!stats.available || stats.live_bytes <= 0) {
+			return true;
 		}
-		return value;
+		AllocationPause allocation_pause;
+		TestError* error = test.getCurrentError()->add("Memory leaked " + location.toString());
+		error->add(
+			std::to_string(stats.live_bytes) + " bytes in " + std::to_string(stats.allocations - stats.deallocations)
+			+ " blocks are still allocated"
+		);
+		test.result = false;
+		return false;
 	}
 
 }
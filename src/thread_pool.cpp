@@ -0,0 +1,158 @@
+#include "test_lib/thread_pool.h"
+#include <chrono>
+#include <algorithm>
+#include <iterator>
+
+namespace test {
+
+	static thread_local ThreadPool* current_pool = nullptr;
+	static thread_local size_t current_worker = 0;
+
+	ThreadPool::ThreadPool(size_t thread_count) {
+		if (thread_count == 0) {
+			thread_count = std::max(1u, std::thread::hardware_concurrency());
+		}
+		for (size_t i = 0; i < thread_count; i++) {
+			workers.push_back(std::make_unique<Worker>());
+		}
+		for (size_t i = 0; i < thread_count; i++) {
+			workers[i]->thread = std::thread([this, i]() { workerLoop(i); });
+		}
+	}
+
+	ThreadPool::~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(wake_mutex);
+			stopping = true;
+		}
+		wake_cv.notify_all();
+		for (auto& worker : workers) {
+			worker->thread.join();
+		}
+	}
+
+	size_t ThreadPool::getThreadCount() const {
+		return workers.size();
+	}
+
+	void ThreadPool::submit(TaskFuncType task, TaskGroup* group) {
+		size_t index;
+		if (current_pool == this) {
+			index = current_worker;
+		} else {
+			index = next_worker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+		}
+		{
+			std::lock_guard<std::mutex> lock(workers[index]->mutex);
+			workers[index]->tasks.push_back({ std::move(task), group });
+		}
+		queued_count.fetch_add(1, std::memory_order_release);
+		{
+			std::lock_guard<std::mutex> lock(wake_mutex);
+		}
+		wake_cv.notify_one();
+	}
+
+	ThreadPool* ThreadPool::getCurrent() {
+		return current_pool;
+	}
+
+	void ThreadPool::workerLoop(size_t index) {
+		current_pool = this;
+		current_worker = index;
+		while (true) {
+			if (tryRunOne(index)) {
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(wake_mutex);
+			wake_cv.wait(lock, [&]() {
+				return stopping || queued_count.load(std::memory_order_acquire) > 0;
+			});
+			if (stopping && queued_count.load(std::memory_order_acquire) == 0) {
+				return;
+			}
+		}
+	}
+
+	bool ThreadPool::tryPop(size_t index, Task& task, const TaskGroup* group) {
+		Worker& worker = *workers[index];
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		auto it = std::find_if(worker.tasks.rbegin(), worker.tasks.rend(), [&](const Task& queued) {
+			return !group || queued.group == group;
+		});
+		if (it == worker.tasks.rend()) {
+			return false;
+		}
+		task = std::move(*it);
+		worker.tasks.erase(std::next(it).base());
+		return true;
+	}
+
+	bool ThreadPool::trySteal(size_t index, Task& task, const TaskGroup* group) {
+		for (size_t i = 1; i <= workers.size(); i++) {
+			Worker& victim = *workers[(index + i) % workers.size()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			auto it = std::find_if(victim.tasks.begin(), victim.tasks.end(), [&](const Task& queued) {
+				return !group || queued.group == group;
+			});
+			if (it != victim.tasks.end()) {
+				task = std::move(*it);
+				victim.tasks.erase(it);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool ThreadPool::tryRunOne(size_t index, const TaskGroup* group) {
+		Task task;
+		bool own_worker = current_pool == this;
+		if ((own_worker && tryPop(index, task, group)) || trySteal(index, task, group)) {
+			queued_count.fetch_sub(1, std::memory_order_acq_rel);
+			execute(task);
+			return true;
+		}
+		return false;
+	}
+
+	void ThreadPool::execute(Task& task) {
+		task.func();
+		if (task.group) {
+			task.group->taskFinished();
+		}
+	}
+
+	TaskGroup::TaskGroup(ThreadPool& pool) : pool(pool) { }
+
+	TaskGroup::~TaskGroup() {
+		wait();
+	}
+
+	void TaskGroup::run(TaskFuncType task) {
+		pending_count.fetch_add(1, std::memory_order_relaxed);
+		pool.submit(std::move(task), this);
+	}
+
+	void TaskGroup::wait() {
+		size_t index = ThreadPool::getCurrent() == &pool ? current_worker : 0;
+		while (pending_count.load(std::memory_order_acquire) > 0) {
+			if (pool.tryRunOne(index, this)) {
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(mutex);
+			done_cv.wait_for(lock, std::chrono::milliseconds(1), [&]() {
+				return pending_count.load(std::memory_order_acquire) == 0;
+			});
+		}
+		// finishing task may still be inside taskFinished()
+		std::lock_guard<std::mutex> lock(mutex);
+	}
+
+	void TaskGroup::taskFinished() {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (pending_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			done_cv.notify_all();
+		}
+	}
+
+}
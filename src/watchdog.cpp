@@ -0,0 +1,138 @@
+#include "test_lib/watchdog.h"
+#include <atomic>
+#include <algorithm>
+#include <cstdlib>
+
+#if defined(__GLIBC__) || defined(__APPLE__)
+#define TEST_LIB_HAS_BACKTRACE
+#include <execinfo.h>
+#include <signal.h>
+#endif
+
+namespace test {
+
+#ifdef TEST_LIB_HAS_BACKTRACE
+
+	// filled by the signal handler on the interrupted thread, one capture at a time
+	static constexpr int max_stack_frames = 64;
+	static void* stack_frames[max_stack_frames];
+	static int stack_frame_count = 0;
+	static std::atomic<bool> stack_captured = false;
+	static struct sigaction previous_action;
+
+	static void captureStackHandler(int) {
+		stack_frame_count = backtrace(stack_frames, max_stack_frames);
+		stack_captured.store(true, std::memory_order_release);
+	}
+
+#endif
+
+	Watchdog::Watchdog() {
+#ifdef TEST_LIB_HAS_BACKTRACE
+		// the first call can allocate while loading the unwinder, which isn't safe in a signal handler
+		backtrace(stack_frames, 1);
+		struct sigaction action = { };
+		action.sa_handler = captureStackHandler;
+		action.sa_flags = SA_RESTART;
+		sigemptyset(&action.sa_mask);
+		sigaction(SIGUSR2, &action, &previous_action);
+#endif
+		thread = std::thread(&Watchdog::threadMain, this);
+	}
+
+	Watchdog::~Watchdog() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake_cv.notify_one();
+		thread.join();
+#ifdef TEST_LIB_HAS_BACKTRACE
+		sigaction(SIGUSR2, &previous_action, nullptr);
+#endif
+	}
+
+	size_t Watchdog::watch(std::chrono::nanoseconds timeout, bool capture_stack, TimeoutFuncType on_timeout) {
+		Entry entry;
+		entry.deadline = std::chrono::steady_clock::now() + timeout;
+		entry.capture_stack = capture_stack;
+		entry.on_timeout = std::move(on_timeout);
+#if defined(__unix__) || defined(__APPLE__)
+		entry.thread = pthread_self();
+#endif
+		size_t id;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			id = next_id++;
+			entries.emplace(id, std::move(entry));
+		}
+		wake_cv.notify_one();
+		return id;
+	}
+
+	bool Watchdog::cancel(size_t id) {
+		std::unique_lock<std::mutex> lock(mutex);
+		if (entries.erase(id) > 0) {
+			return true;
+		}
+		fired_cv.wait(lock, [&]() { return firing_id != id; });
+		return false;
+	}
+
+	void Watchdog::threadMain() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (!stopping) {
+			auto earliest = std::min_element(entries.begin(), entries.end(), [](const auto& left, const auto& right) {
+				return left.second.deadline < right.second.deadline;
+			});
+			if (earliest == entries.end()) {
+				wake_cv.wait(lock);
+				continue;
+			}
+			if (std::chrono::steady_clock::now() < earliest->second.deadline) {
+				wake_cv.wait_until(lock, earliest->second.deadline);
+				continue;
+			}
+			firing_id = earliest->first;
+			Entry entry = std::move(earliest->second);
+			entries.erase(earliest);
+			lock.unlock();
+			std::vector<std::string> stack;
+			if (entry.capture_stack) {
+				stack = captureStack(entry);
+			}
+			entry.on_timeout(stack);
+			lock.lock();
+			firing_id = 0;
+			fired_cv.notify_all();
+		}
+	}
+
+	std::vector<std::string> Watchdog::captureStack(Entry& entry) {
+		std::vector<std::string> stack;
+#ifdef TEST_LIB_HAS_BACKTRACE
+		stack_captured.store(false, std::memory_order_relaxed);
+		if (pthread_kill(entry.thread, SIGUSR2) != 0) {
+			return stack;
+		}
+		std::chrono::steady_clock::time_point give_up = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+		while (!stack_captured.load(std::memory_order_acquire)) {
+			if (std::chrono::steady_clock::now() > give_up) {
+				return stack;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		char** symbols = backtrace_symbols(stack_frames, stack_frame_count);
+		if (!symbols) {
+			return stack;
+		}
+		// the first frame is the signal handler
+		for (int i = 1; i < stack_frame_count; i++) {
+			stack.push_back(symbols[i]);
+		}
+		free(symbols);
+#endif
+		return stack;
+	}
+
+}
@@ -0,0 +1,13 @@
+#include "test_lib/reporter.h"
+#include <iostream>
+
+// Combines the JSON Lines reports of sharded runs into one summary,
+// exits with 0 only if every test in every report passed.
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		std::cerr << "Usage: " << argv[0] << " <report.jsonl>..." << std::endl;
+		return 2;
+	}
+	std::vector<std::filesystem::path> files(argv + 1, argv + argc);
+	return test::mergeJsonLinesReports(files) ? 0 : 1;
+}
@@ -1,8 +1,29 @@
 #pragma once
 
 #include "test_lib/test.h"
+#include "test_lib/isolation.h"
+#include "test_lib/watchdog.h"
+#include "test_lib/baseline.h"
 #include <assert.h>
 #include <iostream>
+#include <atomic>
+#include <thread>
+#include <cmath>
+#include <limits>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <map>
+#include <numeric>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+#ifdef TEST_LIB_TRACK_MALLOC
+#include <malloc.h>
+#endif
 
 class TestModule : public test::TestModule {
 public:
@@ -104,6 +125,1406 @@ void test_module_dependency_cancellation() {
     assert(dependent_test->cancelled);
 }
 
+void test_parallel_execution() {
+    TestModule* root_module = new TestModule("ParallelRootModule", nullptr);
+    root_module->parallel = true;
+    root_module->thread_count = 4;
+    TestModule* dependency_module = root_module->addModule<TestModule>("DependencyModule");
+    std::vector<test::Test*> dependency_tests;
+    for (size_t i = 0; i < 16; i++) {
+        dependency_tests.push_back(dependency_module->addTest("Test" + std::to_string(i), [](test::Test& test) { }));
+    }
+    std::atomic<bool> dependency_finished = false;
+    test::Test* chain_test = dependency_module->addTest("ChainTest", { dependency_tests.back() }, [&](test::Test& test) {
+        dependency_finished = true;
+    });
+    TestModule* dependent_module = root_module->addModule<TestModule>("DependentModule", { dependency_module });
+    test::Test* dependent_test = dependent_module->addTest("DependentTest", [&](test::Test& test) {
+        T_CHECK(dependency_finished, "Dependency module is not finished");
+    });
+    std::atomic<size_t> before_count = 0;
+    std::atomic<size_t> after_count = 0;
+    dependency_module->OnBeforeRunTest = [&]() { before_count++; };
+    dependency_module->OnAfterRunTest = [&]() { after_count++; };
+    root_module->run();
+    root_module->printSummary();
+    for (test::Test* test : dependency_tests) {
+        assert(test->is_run);
+        assert(test->result);
+    }
+    assert(chain_test->result);
+    assert(dependent_test->is_run);
+    assert(dependent_test->result);
+    assert(root_module->getResultCount(test::ResultStore::Passed) == 18);
+    assert(before_count == 17 && after_count == 17);
+}
+
+void test_parallel_cancellation() {
+    TestModule* root_module = new TestModule("ParallelCancellationModule", nullptr);
+    root_module->parallel = true;
+    root_module->thread_count = 4;
+    TestModule* failing_module = root_module->addModule<TestModule>("FailingDependencyModule");
+    test::Test* failing_test = failing_module->addTest("FailingDependencyTest", [&](test::Test& test) {
+        failing_module->failingTest(test);
+    });
+    test::Test* dependent_test = failing_module->addTest("DependentTest", { failing_test }, [](test::Test& test) { });
+    TestModule* dependent_module = root_module->addModule<TestModule>("DependentModule", { failing_module });
+    test::Test* module_dependent_test = dependent_module->addTest("DependentTest", [](test::Test& test) { });
+    root_module->run();
+    root_module->printSummary();
+    assert(failing_test->is_run);
+    assert(!failing_test->result);
+    assert(!dependent_test->is_run);
+    assert(dependent_test->cancelled);
+    assert(!module_dependent_test->is_run);
+    assert(module_dependent_test->cancelled);
+    assert(root_module->getResultCount(test::ResultStore::Failed) == 1);
+    assert(root_module->getResultCount(test::ResultStore::Cancelled) == 2);
+}
+
+void test_isolated_execution() {
+    if (!test::IsolationPool::isSupported()) {
+        return;
+    }
+    TestModule* root_module = new TestModule("IsolatedModule", nullptr);
+    root_module->isolated = true;
+    test::Test* passing_test = root_module->addTest("PassingTest", [](test::Test& test) { });
+    test::Test* crashing_test = root_module->addTest("CrashingTest", [](test::Test& test) {
+        std::abort();
+    });
+    test::Test* failing_test = root_module->addTest("FailingTest", [&](test::Test& test) {
+        root_module->failingTest(test);
+    });
+    test::Test* dependent_test = root_module->addTest("DependentTest", { crashing_test }, [](test::Test& test) { });
+    test::Test* last_test = root_module->addTest("LastTest", [](test::Test& test) { });
+    // hooks run in the parent process, once per test
+    size_t before_count = 0;
+    size_t after_count = 0;
+    root_module->OnBeforeRunTest = [&]() { before_count++; };
+    root_module->OnAfterRunTest = [&]() { after_count++; };
+    root_module->run();
+    root_module->printSummary();
+    assert(passing_test->result);
+    assert(crashing_test->is_run);
+    assert(!crashing_test->result);
+    assert(crashing_test->root_error->subentries.size() == 1);
+    assert(crashing_test->root_error->subentries.front()->str.starts_with("CRASHED"));
+    assert(!failing_test->result);
+    assert(failing_test->root_error->subentries.size() == 1);
+    assert(dependent_test->cancelled);
+    assert(last_test->result);
+    assert(before_count == 5 && after_count == 5);
+    // crashed workers are replaced while the scheduler's threads run other tests
+    TestModule* parallel_module = new TestModule("ParallelIsolatedModule", nullptr);
+    parallel_module->isolated = true;
+    parallel_module->parallel = true;
+    parallel_module->thread_count = 4;
+    std::vector<test::Test*> parallel_tests;
+    for (size_t i = 0; i < 24; i++) {
+        parallel_tests.push_back(parallel_module->addTest("Test" + std::to_string(i), [i](test::Test& test) {
+            if (i % 3 == 0) {
+                std::abort();
+            }
+        }));
+    }
+    parallel_module->run();
+    for (size_t i = 0; i < parallel_tests.size(); i++) {
+        assert(parallel_tests[i]->is_run && parallel_tests[i]->result == (i % 3 != 0));
+    }
+}
+
+void test_timing() {
+    TestModule* root_module = new TestModule("TimingModule", nullptr);
+    TestModule* child_module = root_module->addModule<TestModule>("ChildModule");
+    test::Test* sleeping_test = child_module->addTest("SleepingTest", [](test::Test& test) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    });
+    test::Test* busy_test = child_module->addTest("BusyTest", [](test::Test& test) {
+        volatile size_t sum = 0;
+        for (size_t i = 0; i < 1000000; i++) {
+            sum = sum + i;
+        }
+    });
+    root_module->run();
+    root_module->printSummary();
+    assert(sleeping_test->wall_time >= std::chrono::milliseconds(20));
+    assert(sleeping_test->cpu_time < sleeping_test->wall_time);
+    assert(busy_test->cpu_time > std::chrono::nanoseconds::zero());
+    assert(child_module->wall_time == sleeping_test->wall_time + busy_test->wall_time);
+    assert(root_module->wall_time == child_module->wall_time);
+}
+
+void test_benchmark() {
+    TestModule* root_module = new TestModule("BenchmarkModule", nullptr);
+    test::Benchmark* benchmark = root_module->addBenchmark("SumBenchmark", [](test::Benchmark& test) {
+        std::vector<int> values(256, 1);
+        T_BENCHMARK {
+            int sum = 0;
+            for (int value : values) {
+                sum += value;
+            }
+            test::doNotOptimize(sum);
+        }
+        T_CHECK(values.size() == 256, "Values are not preserved");
+    });
+    benchmark->warmup_time = std::chrono::milliseconds(5);
+    benchmark->sample_time = std::chrono::milliseconds(1);
+    benchmark->sample_count = 10;
+    benchmark->bytes_per_iteration = 256 * sizeof(int);
+    root_module->run();
+    root_module->printSummary();
+    assert(benchmark->is_run);
+    assert(benchmark->result);
+    assert(benchmark->hasStats());
+    assert(benchmark->samples.size() == 10);
+    assert(benchmark->iterations_per_sample > 0);
+    assert(benchmark->min_time <= benchmark->median_time);
+    assert(benchmark->median_time <= benchmark->p99_time);
+    assert(benchmark->getBytesPerSecond() > 0.0);
+}
+
+void test_baseline_regression() {
+    std::filesystem::path baseline_file = std::filesystem::temp_directory_path() / "test_lib_baseline.txt";
+    std::filesystem::remove(baseline_file);
+    size_t work_size = 10;
+    auto run_module = [&]() {
+        TestModule* root_module = new TestModule("BaselineModule", nullptr);
+        root_module->baseline_file = baseline_file;
+        test::Benchmark* benchmark = root_module->addBenchmark("WorkBenchmark", [&](test::Benchmark& test) {
+            T_BENCHMARK {
+                for (size_t i = 0; i < work_size; i++) {
+                    test::doNotOptimize(i);
+                }
+            }
+        });
+        benchmark->warmup_time = std::chrono::milliseconds(2);
+        benchmark->sample_time = std::chrono::microseconds(200);
+        benchmark->sample_count = 20;
+        bool result = root_module->run();
+        root_module->printSummary();
+        return std::make_pair(result, root_module);
+    };
+    auto [first_result, first_module] = run_module();
+    assert(first_result);
+    assert(std::filesystem::exists(baseline_file));
+    work_size = 1000;
+    auto [second_result, second_module] = run_module();
+    assert(!second_result);
+    assert(second_module->getResultCount(test::ResultStore::Regressed) == 1);
+    assert(second_module->getAllTests()[0]->regressed);
+    std::filesystem::remove(baseline_file);
+    // a plain test has a single timing sample per run
+    std::chrono::milliseconds sleep_time(1);
+    auto run_plain = [&]() {
+        TestModule* root_module = new TestModule("PlainBaselineModule", nullptr);
+        root_module->baseline_file = baseline_file;
+        root_module->addTest("SleepTest", [&](test::Test& test) {
+            std::this_thread::sleep_for(sleep_time);
+        });
+        root_module->run();
+        root_module->printSummary();
+        return root_module;
+    };
+    assert(run_plain()->result);
+    sleep_time = std::chrono::milliseconds(50);
+    TestModule* slow_module = run_plain();
+    assert(!slow_module->result && slow_module->getAllTests()[0]->regressed);
+    std::vector<double> history(20, 1000.0);
+    assert(test::checkRegression({ 2000.0 }, history, 0.1, 0.05).regressed);
+    assert(!test::checkRegression({ 1000.0 }, history, 0.1, 0.05).regressed);
+    std::filesystem::remove(baseline_file);
+}
+
+void test_hardware_counters() {
+    TestModule* root_module = new TestModule("CounterModule", nullptr);
+    root_module->hardware_counters = true;
+    test::Test* counted_test = root_module->addTest("CountedTest", [](test::Test& test) {
+        std::vector<int> values(1 << 16, 1);
+        test::doNotOptimize(values);
+    });
+    root_module->run();
+    root_module->printSummary();
+    assert(counted_test->result);
+    // counters may be denied by the kernel, the test has to pass either way
+    if (test::PerfCounterGroup::forCurrentThread().isAvailable()) {
+        assert(counted_test->perf_counters.isValid());
+        assert(root_module->perf_counters.isValid());
+    } else {
+        assert(!counted_test->perf_counters.isValid());
+    }
+    // a worker process counts its own thread, not the one it was forked from
+    if (test::IsolationPool::isSupported() && counted_test->perf_counters.has(test::PerfCounters::PageFaults)) {
+        TestModule* isolated_module = new TestModule("IsolatedCounterModule", nullptr);
+        isolated_module->hardware_counters = true;
+        isolated_module->isolated = true;
+        test::Test* isolated_test = isolated_module->addTest("CountedTest", [](test::Test& test) {
+            std::vector<int> values(1 << 20, 1);
+            test::doNotOptimize(values);
+        });
+        isolated_module->run();
+        assert(isolated_test->result);
+        assert(isolated_test->perf_counters.page_faults > 0);
+    }
+}
+
+void test_error_limit() {
+    TestModule* root_module = new TestModule("ErrorLimitModule", nullptr);
+    root_module->max_error_entries = 10;
+    test::Test* failing_test = root_module->addTest("ManyFailuresTest", [](test::Test& test) {
+        for (int i = 0; i < 1000; i++) {
+            T_CONTAINER("Iteration " + std::to_string(i));
+            T_CHECK(i < 0, "Value is not negative");
+        }
+    });
+    test::Test* container_test = root_module->addTest("PassingContainersTest", [](test::Test& test) {
+        for (int i = 0; i < 1000; i++) {
+            T_CONTAINER("Iteration " + std::to_string(i));
+            T_CHECK(i >= 0, "Value is negative");
+        }
+    });
+    root_module->run();
+    root_module->printSummary();
+    assert(!failing_test->result);
+    // every failure is a container with a check entry inside
+    assert(failing_test->root_error->subentries.size() == 5);
+    assert(failing_test->getDroppedErrorCount() == 2 * 1000 - 10);
+    assert(container_test->result);
+    assert(container_test->root_error->subentries.empty());
+    root_module->run();
+    assert(failing_test->root_error->subentries.size() == 5);
+    assert(failing_test->getDroppedErrorCount() == 2 * 1000 - 10);
+}
+
+void test_assertion_messages() {
+    TestModule* root_module = new TestModule("AssertionMessageModule", nullptr);
+    test::Test* failing_test = root_module->addTest("FailingTest", [](test::Test& test) {
+        T_CONTAINER("Outer");
+        T_CHECK(1 + 1 == 3);
+        int actual = 4;
+        T_COMPARE(actual, 5);
+        T_COMPARE(std::string("abc"), "abd");
+    });
+    test::Test* passing_test = root_module->addTest("PassingTest", [](test::Test& test) {
+        T_CONTAINER("Unused");
+        T_CHECK(1 + 1 == 2);
+        T_COMPARE(2 * 2, 4);
+        T_APPROX_COMPARE(0.1 + 0.2, 0.3);
+    });
+    root_module->run();
+    root_module->printSummary();
+    assert(!failing_test->result);
+    const test::TestError* outer = failing_test->root_error->subentries.front();
+    assert(outer->str.starts_with("Outer [main.cpp:"));
+    assert(outer->subentries.size() == 3);
+    assert(outer->subentries.front()->str.starts_with("Failed condition: 1 + 1 == 3 [main.cpp:"));
+    assert(outer->subentries.back()->subentries.front()->str == "Expected value: abd");
+    assert(passing_test->result);
+    assert(passing_test->root_error->subentries.empty());
+}
+
+void test_span_compare() {
+    TestModule* root_module = new TestModule("SpanCompareModule", nullptr);
+    root_module->max_span_mismatches = 3;
+    std::vector<float> expected(1003);
+    for (size_t i = 0; i < expected.size(); i++) {
+        expected[i] = static_cast<float>(i) * 0.5f - 100.0f;
+    }
+    test::Test* passing_test = root_module->addTest("PassingTest", [&](test::Test& test) {
+        std::vector<float> actual = expected;
+        T_SPAN_COMPARE(actual, expected);
+        actual[1002] += 0.00001f;
+        T_SPAN_APPROX_COMPARE(actual, expected);
+        actual[1002] = std::nextafter(std::nextafter(expected[1002], 1000.0f), 1000.0f);
+        T_SPAN_ULP_COMPARE(actual, expected, 2);
+        std::vector<int> ints = { 1, 2, 3 };
+        T_SPAN_COMPARE(ints, std::vector<int>({ 1, 2, 3 }));
+    });
+    test::Test* failing_test = root_module->addTest("FailingTest", [&](test::Test& test) {
+        std::vector<float> actual = expected;
+        for (size_t i = 10; i < 1003; i += 100) {
+            actual[i] += 1.0f;
+        }
+        actual[500] = std::numeric_limits<float>::quiet_NaN();
+        T_SPAN_APPROX_COMPARE(actual, expected);
+        std::vector<int> ints = { 1, 2, 3 };
+        T_SPAN_COMPARE(ints, std::vector<int>({ 1, 2 }));
+    });
+    root_module->run();
+    root_module->printSummary();
+    assert(passing_test->result);
+    assert(!failing_test->result);
+    const test::TestError* approx_error = failing_test->root_error->subentries.front();
+    // summary line, 3 listed mismatches and the remaining count
+    assert(approx_error->subentries.size() == 5);
+    assert(approx_error->subentries.front()->str.starts_with("Mismatched 11 of 1003 elements, max error nan at [500]"));
+    assert(approx_error->subentries.back()->str == "... 8 more mismatches");
+    const test::TestError* size_error = failing_test->root_error->subentries.back();
+    assert(size_error->subentries.front()->str == "Size mismatch: expected 2, actual 3");
+    // vector kernels agree with the scalar definition, including signs, zeros and infinities
+    std::vector<double> values = {
+        0.0, -0.0, 1.0, -1.0, 1.0e-40, -1.0e-40, std::numeric_limits<double>::infinity(),
+        -std::numeric_limits<double>::infinity(), std::numeric_limits<double>::max(), 3.0e38, -3.0e38,
+    };
+    for (double left : values) {
+        for (double right : values) {
+            std::vector<float> left_floats(9, static_cast<float>(left));
+            std::vector<float> right_floats(9, static_cast<float>(right));
+            uint64_t float_distance = test::ulpDistance(static_cast<float>(left), static_cast<float>(right));
+            size_t float_index = test::findUlpMismatch(left_floats.data(), right_floats.data(), 0, 9, 4);
+            assert((float_index == 0) == (float_distance > 4));
+            std::vector<double> left_doubles(5, left);
+            std::vector<double> right_doubles(5, right);
+            uint64_t double_distance = test::ulpDistance(left, right);
+            size_t double_index = test::findUlpMismatch(left_doubles.data(), right_doubles.data(), 0, 5, 4);
+            assert((double_index == 0) == (double_distance > 4));
+        }
+    }
+}
+
+void test_reporters() {
+    TestModule* root_module = new TestModule("ReporterModule", nullptr);
+    std::filesystem::path junit_path = std::filesystem::temp_directory_path() / "test_lib_report.xml";
+    std::filesystem::path jsonl_path = std::filesystem::temp_directory_path() / "test_lib_report.jsonl";
+    root_module->addReporter<test::JUnitReporter>(junit_path);
+    root_module->addReporter<test::JsonLinesReporter>(jsonl_path);
+    test::Test* failing_test = root_module->addTest("FailingTest", [](test::Test& test) {
+        T_CHECK(false, "Quote \" and <tag>");
+    });
+    TestModule* child_module = root_module->addModule<TestModule>("ChildModule", { failing_test });
+    child_module->addTest("CancelledTest", [](test::Test& test) { });
+    root_module->addTest("PassingTest", [](test::Test& test) { });
+    root_module->run();
+    root_module->printSummary();
+    auto read_file = [](const std::filesystem::path& path) {
+        std::ifstream file(path);
+        return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    };
+    std::string junit = read_file(junit_path);
+    assert(junit.find("<testcase classname=\"ReporterModule\" name=\"PassingTest\"") != std::string::npos);
+    assert(junit.find("Quote &quot; and &lt;tag&gt;") != std::string::npos);
+    assert(junit.find("<skipped message=\"cancelled\"/>") != std::string::npos);
+    assert(junit.find("<testsuite name=\"ReporterModule\" tests=\"3\" failures=\"1\" skipped=\"1\"") != std::string::npos);
+    assert(junit.ends_with("</testsuites>\n"));
+    std::string jsonl = read_file(jsonl_path);
+    std::vector<std::string> lines;
+    std::istringstream stream(jsonl);
+    for (std::string line; std::getline(stream, line);) {
+        lines.push_back(line);
+    }
+    assert(lines.front() == "{\"event\":\"module_start\",\"path\":\"ReporterModule\"}");
+    assert(lines[1] == "{\"event\":\"test_start\",\"path\":\"FailingTest\"}");
+    assert(lines[2].starts_with("{\"event\":\"error\",\"path\":\"FailingTest\",\"depth\":0,\"message\":\"Quote \\\" and <tag>"));
+    assert(lines[3].starts_with("{\"event\":\"test_end\",\"path\":\"FailingTest\",\"status\":\"failed\""));
+    assert(jsonl.find("{\"event\":\"test_end\",\"path\":\"ChildModule/CancelledTest\",\"status\":\"cancelled\"") != std::string::npos);
+    assert(lines.back().starts_with("{\"event\":\"module_end\",\"path\":\"ReporterModule\",\"status\":\"failed\",\"passed\":1,\"failed\":1,\"cancelled\":1"));
+    std::filesystem::remove(junit_path);
+    std::filesystem::remove(jsonl_path);
+}
+
+void test_result_queries() {
+    TestModule* root_module = new TestModule("ResultQueryModule", nullptr);
+    root_module->addTest("PassingTest", [](test::Test& test) { });
+    TestModule* child_module = root_module->addModule<TestModule>("ChildModule");
+    test::Test* failing_test = child_module->addTest("FailingTest", [](test::Test& test) {
+        T_CHECK(false, "Failed on purpose");
+    });
+    TestModule* grandchild_module = child_module->addModule<TestModule>("GrandchildModule");
+    grandchild_module->addTest("PassingTest", [](test::Test& test) { });
+    grandchild_module->addModule<TestModule>("EmptyModule");
+    TestModule* cancelled_module = root_module->addModule<TestModule>("CancelledModule", { failing_test });
+    cancelled_module->addTest("CancelledTest", [](test::Test& test) { });
+    root_module->run();
+    root_module->printSummary();
+    assert(root_module->getResultCount(test::ResultStore::Passed) == 2);
+    assert(root_module->getResultCount(test::ResultStore::Failed) == 1);
+    assert(root_module->getResultCount(test::ResultStore::Cancelled) == 1);
+    assert(child_module->getResultCount(test::ResultStore::Passed) == 1);
+    assert(child_module->getResultCount(test::ResultStore::Failed) == 1);
+    assert(child_module->getResultCount(test::ResultStore::Cancelled) == 0);
+    assert(grandchild_module->getResultCount(test::ResultStore::Failed) == 0);
+    assert(cancelled_module->getResultCount(test::ResultStore::Cancelled) == 1);
+    assert(child_module->getResults(test::ResultStore::Failed).front() == failing_test);
+    assert(root_module->getEmptyModules().size() == 1);
+    assert(root_module->getEmptyModules().front()->getPath(root_module) == "ChildModule/GrandchildModule/EmptyModule");
+    root_module->run();
+    assert(root_module->getResultCount(test::ResultStore::Passed) == 2);
+    assert(child_module->getResultCount(test::ResultStore::Failed) == 1);
+}
+
+void test_selection() {
+    TestModule* root_module = new TestModule("SelectionModule", nullptr);
+    std::atomic<int> run_count = 0;
+    auto counting_test = [&](test::Test& test) { run_count++; };
+    test::Test* setup_test = root_module->addTest("SetupTest", counting_test);
+    TestModule* math_module = root_module->addModule<TestModule>("Math");
+    math_module->tags = { "fast" };
+    math_module->addTest("AddTest", counting_test);
+    math_module->addTest("SubTest", counting_test);
+    TestModule* io_module = root_module->addModule<TestModule>("IO");
+    test::Test* read_test = io_module->addTest("ReadTest", { setup_test }, counting_test);
+    test::Test* write_test = io_module->addTest("WriteTest", counting_test);
+    write_test->tags = { "slow" };
+    const char* args[] = { "test_lib_tests", "--filter", "IO/Read*", "--tag=fast", "--exclude=Math/Sub*" };
+    assert(root_module->parseArguments(5, args));
+    root_module->run();
+    root_module->printSummary();
+    // SetupTest is pulled in as a prerequisite of ReadTest
+    assert(run_count == 3);
+    assert(root_module->getResultCount(test::ResultStore::Passed) == 3);
+    assert(read_test->result && setup_test->result && !write_test->is_run);
+    assert(root_module->result);
+    root_module->selection.clear();
+    root_module->selection.includeRegex("Test$");
+    root_module->selection.excludeTag("slow");
+    root_module->parallel = true;
+    run_count = 0;
+    root_module->run();
+    assert(run_count == 4);
+    assert(!write_test->is_run);
+    root_module->selection.clear();
+    root_module->selection.include("**Sub*");
+    run_count = 0;
+    root_module->run();
+    assert(run_count == 1);
+    assert(test::matchGlob("Math/*", "Math/AddTest"));
+    assert(!test::matchGlob("*", "Math/AddTest"));
+    assert(test::matchGlob("**Test", "Math/AddTest"));
+    assert(test::matchGlob("Math/???Test", "Math/AddTest"));
+    const char* bad_args[] = { "test_lib_tests", "--unknown" };
+    assert(!root_module->parseArguments(2, bad_args));
+    // only selected tests of a cancelled module are reported as cancelled
+    TestModule* cancel_root = new TestModule("SelectionCancelModule", nullptr);
+    test::Test* failing_test = cancel_root->addTest("A", [](test::Test& test) {
+        T_CHECK(false);
+    });
+    TestModule* blocked_module = cancel_root->addModule<TestModule>("M", { failing_test });
+    test::Test* selected_test = blocked_module->addTest("x", counting_test);
+    test::Test* unselected_test = blocked_module->addTest("y", counting_test);
+    cancel_root->selection.include("A");
+    cancel_root->selection.include("M/x");
+    for (bool parallel : { false, true }) {
+        cancel_root->parallel = parallel;
+        cancel_root->thread_count = 4;
+        cancel_root->run();
+        assert(cancel_root->getResultCount(test::ResultStore::Cancelled) == 1);
+        assert(cancel_root->getResultCount(test::ResultStore::Failed) == 1);
+        assert(selected_test->cancelled && !unselected_test->cancelled);
+    }
+}
+
+void test_result_cache() {
+    std::filesystem::path cache_path = std::filesystem::temp_directory_path() / "test_lib_cache.txt";
+    std::filesystem::remove(cache_path);
+    TestModule* root_module = new TestModule("ResultCacheModule", nullptr);
+    root_module->cache_file = cache_path;
+    std::vector<std::string> run_order;
+    bool fail = true;
+    test::Test* data_test = root_module->addTest("DataTest", [&](test::Test& test) {
+        run_order.push_back("DataTest");
+    });
+    root_module->addTest("ParserTest", { data_test }, [&](test::Test& test) {
+        run_order.push_back("ParserTest");
+    });
+    root_module->addTest("OtherTest", [&](test::Test& test) {
+        run_order.push_back("OtherTest");
+    });
+    TestModule* flaky_module = root_module->addModule<TestModule>("FlakyModule");
+    test::Test* flaky_test = flaky_module->addTest("FlakyTest", [&](test::Test& test) {
+        run_order.push_back("FlakyTest");
+        T_CHECK(!fail, "Failed on purpose");
+    });
+    root_module->run();
+    assert(run_order.size() == 4);
+    assert(!flaky_test->result);
+    // passed tests are cached, the failed one goes first
+    fail = false;
+    run_order.clear();
+    root_module->failed_first = true;
+    root_module->run();
+    root_module->printSummary();
+    assert(run_order == std::vector<std::string>({ "FlakyTest" }));
+    assert(data_test->cached && data_test->result);
+    assert(root_module->getResultCount(test::ResultStore::Passed) == 4);
+    assert(root_module->getChildren().front()->name == "FlakyModule");
+    // a changed prerequisite invalidates its dependents
+    run_order.clear();
+    data_test->version = "2";
+    root_module->run();
+    assert(run_order == std::vector<std::string>({ "DataTest", "ParserTest" }));
+    run_order.clear();
+    root_module->run();
+    assert(run_order.empty());
+    std::filesystem::remove(cache_path);
+}
+
+void test_sharding() {
+    std::map<std::string, int> run_counts;
+    std::map<std::string, int> total_counts;
+    std::vector<std::filesystem::path> report_paths;
+    const size_t shard_count = 3;
+    for (size_t shard_index = 0; shard_index < shard_count; shard_index++) {
+        TestModule* root_module = new TestModule("ShardModule", nullptr);
+        auto counting_test = [&](test::Test& test) { run_counts[test.getPath()]++; };
+        test::Test* setup_test = root_module->addTest("SetupTest", counting_test);
+        TestModule* math_module = root_module->addModule<TestModule>("Math");
+        for (const char* name : { "AddTest", "SubTest", "MulTest", "DivTest" }) {
+            math_module->addTest(name, counting_test);
+        }
+        TestModule* io_module = root_module->addModule<TestModule>("IO");
+        io_module->addTest("ReadTest", { setup_test }, counting_test);
+        io_module->addTest("WriteTest", counting_test);
+        TestModule* net_module = root_module->addModule<TestModule>("Net", { io_module });
+        net_module->addTest("SendTest", counting_test);
+        report_paths.push_back(std::filesystem::temp_directory_path() / ("test_lib_shard_" + std::to_string(shard_index) + ".jsonl"));
+        std::string index_str = std::to_string(shard_index);
+        std::string report_str = report_paths.back().string();
+        const char* args[] = { "test_lib_tests", "--shard-index", index_str.c_str(), "--shard-count=3", "--jsonl-report", report_str.c_str() };
+        assert(root_module->parseArguments(6, args));
+        run_counts.clear();
+        root_module->run();
+        root_module->printSummary();
+        assert(root_module->result);
+        // dependency chains are never split between shards
+        assert(run_counts.count("IO/ReadTest") == run_counts.count("SetupTest"));
+        assert(run_counts.count("Net/SendTest") == run_counts.count("IO/ReadTest"));
+        assert(run_counts.count("Net/SendTest") == run_counts.count("IO/WriteTest"));
+        for (auto& [path, count] : run_counts) {
+            total_counts[path] += count;
+        }
+        if (shard_index + 1 == shard_count) {
+            // every test ran in exactly one shard
+            assert(total_counts.size() == 8);
+            for (auto& [path, count] : total_counts) {
+                assert(count == 1);
+            }
+        }
+    }
+    assert(test::mergeJsonLinesReports(report_paths));
+    report_paths.push_back(std::filesystem::temp_directory_path() / "test_lib_shard_missing.jsonl");
+    assert(!test::mergeJsonLinesReports(report_paths));
+    report_paths.pop_back();
+    for (const std::filesystem::path& path : report_paths) {
+        std::filesystem::remove(path);
+    }
+    // a test in several reports keeps its failure, whatever the order of the files
+    std::filesystem::path passed_path = std::filesystem::temp_directory_path() / "test_lib_merge_passed.jsonl";
+    std::filesystem::path failed_path = std::filesystem::temp_directory_path() / "test_lib_merge_failed.jsonl";
+    std::ofstream(passed_path) << "{\"event\":\"test_end\",\"path\":\"A/Test\",\"status\":\"passed\",\"wall_ns\":5,\"cpu_ns\":5}\n";
+    std::ofstream(failed_path) << "{\"event\":\"test_end\",\"path\":\"A/Test\",\"status\":\"failed\",\"wall_ns\":1,\"cpu_ns\":1}\n";
+    assert(!test::mergeJsonLinesReports({ passed_path, failed_path }));
+    assert(!test::mergeJsonLinesReports({ failed_path, passed_path }));
+    assert(test::mergeJsonLinesReports({ passed_path, passed_path }));
+    std::filesystem::remove(passed_path);
+    std::filesystem::remove(failed_path);
+    std::vector<std::vector<const char*>> bad_args = {
+        { "test_lib_tests", "--shard-index=3", "--shard-count=3" },
+        { "test_lib_tests", "--shard-count=0" },
+        { "test_lib_tests", "--shard-count=4x" },
+        { "test_lib_tests", "--shard-index=-1", "--shard-count=3" },
+        { "test_lib_tests", "--shard-count=" },
+    };
+    for (const std::vector<const char*>& args : bad_args) {
+        TestModule* root_module = new TestModule("ShardModule", nullptr);
+        assert(!root_module->parseArguments(static_cast<int>(args.size()), args.data()));
+    }
+    TestModule* root_module = new TestModule("ShardModule", nullptr);
+    const char* good_args[] = { "test_lib_tests", "--shard-index", "2", "--shard-count=3" };
+    assert(root_module->parseArguments(4, good_args));
+    assert(root_module->shard_index == 2 && root_module->shard_count == 3);
+}
+
+void test_timeouts() {
+    TestModule* root_module = new TestModule("TimeoutModule", nullptr);
+    const char* args[] = { "test_lib_tests", "--isolate", "--timeout=5" };
+    assert(root_module->parseArguments(3, args));
+    assert(root_module->timeout == std::chrono::seconds(5));
+    TestModule* slow_module = root_module->addModule<TestModule>("SlowModule");
+    slow_module->timeout = std::chrono::milliseconds(200);
+    test::Test* hanging_test = slow_module->addTest("HangingTest", [](test::Test& test) {
+        std::this_thread::sleep_for(std::chrono::seconds(30));
+    });
+    test::Test* quick_test = slow_module->addTest("QuickTest", [](test::Test& test) { });
+    root_module->run();
+    root_module->printSummary();
+    if (test::IsolationPool::isSupported()) {
+        // the worker is killed and the run goes on
+        assert(hanging_test->timed_out && !hanging_test->result);
+        assert(hanging_test->wall_time < std::chrono::seconds(5));
+        assert(std::string(test::getStatusString(*hanging_test)) == "timeout");
+        assert(hanging_test->root_error->subentries.front()->str.starts_with("TIMEOUT after"));
+        assert(quick_test->result && !quick_test->timed_out);
+        assert(root_module->getResultCount(test::ResultStore::Failed) == 1);
+    }
+#if defined(__unix__) || defined(__APPLE__)
+    // in-process the run ends at the timeout, with the reports finished first
+    std::filesystem::path junit_path = std::filesystem::temp_directory_path() / "test_lib_timeout.xml";
+    std::filesystem::path cache_path = std::filesystem::temp_directory_path() / "test_lib_timeout.cache";
+    for (bool parallel : { false, true }) {
+        std::filesystem::remove(junit_path);
+        std::filesystem::remove(cache_path);
+        std::cout << std::flush;
+        pid_t pid = fork();
+        if (pid == 0) {
+            TestModule* in_process_module = new TestModule("InProcessTimeoutModule", nullptr);
+            in_process_module->timeout = std::chrono::milliseconds(200);
+            in_process_module->parallel = parallel;
+            in_process_module->cache_file = cache_path;
+            in_process_module->addReporter<test::JUnitReporter>(junit_path);
+            test::Test* quick_test = in_process_module->addTest("QuickTest", [](test::Test& test) { });
+            in_process_module->addTest("HangingTest", { quick_test }, [](test::Test& test) {
+                std::this_thread::sleep_for(std::chrono::seconds(30));
+            });
+            in_process_module->run();
+            _exit(0);
+        }
+        int status = 0;
+        assert(waitpid(pid, &status, 0) == pid);
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_FAILURE);
+        std::ifstream junit_file(junit_path);
+        std::string junit((std::istreambuf_iterator<char>(junit_file)), std::istreambuf_iterator<char>());
+        assert(junit.find("<failure message=\"TIMEOUT\" type=\"timeout\">TIMEOUT after") != std::string::npos);
+        assert(junit.ends_with("</testsuites>\n"));
+        // the scheduler reports nothing before it finishes, the cache needs all results
+        if (!parallel) {
+            assert(junit.find("tests=\"2\" failures=\"1\"") != std::string::npos);
+            assert(std::filesystem::exists(cache_path));
+        }
+    }
+    std::filesystem::remove(junit_path);
+    std::filesystem::remove(cache_path);
+#endif
+    // stack of a thread that is still running
+    test::Watchdog watchdog;
+    std::vector<std::string> stack;
+    size_t watch_id = watchdog.watch(std::chrono::milliseconds(20), true, [&](const std::vector<std::string>& frames) {
+        stack = frames;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    assert(!watchdog.cancel(watch_id));
+#ifdef __GLIBC__
+    assert(!stack.empty());
+#endif
+    watch_id = watchdog.watch(std::chrono::seconds(10), false, [](const std::vector<std::string>& frames) { });
+    assert(watchdog.cancel(watch_id));
+}
+
+void test_allocation_tracking() {
+    TestModule* root_module = new TestModule("AllocationModule", nullptr);
+    int* leaked = nullptr;
+    test::Test* hot_path_test = root_module->addTest("HotPathTest", [](test::Test& test) {
+        int values[16] = { };
+        for (int& value : values) {
+            value++;
+        }
+        test::doNotOptimize(values);
+        T_MAX_ALLOCATIONS(0);
+        T_NO_LEAKS();
+    });
+    test::Test* balanced_test = root_module->addTest("BalancedTest", [](test::Test& test) {
+        std::vector<std::unique_ptr<int>> values;
+        for (int i = 0; i < 3; i++) {
+            values.push_back(std::make_unique<int>(i));
+        }
+        T_MAX_ALLOCATIONS(2);
+        values.clear();
+        values.shrink_to_fit();
+        T_NO_LEAKS();
+    });
+    test::Test* leaking_test = root_module->addTest("LeakingTest", [&](test::Test& test) {
+        leaked = new int(1);
+        T_NO_LEAKS();
+    });
+    // the failure message of the first check doesn't count for the second
+    test::Test* message_test = root_module->addTest("MessageTest", [](test::Test& test) {
+        delete new int(1);
+        T_MAX_ALLOCATIONS(0);
+        T_MAX_ALLOCATIONS(1);
+    });
+#ifdef TEST_LIB_TRACK_MALLOC
+    test::Test* page_test = root_module->addTest("PageTest", [](test::Test& test) {
+        void* page = valloc(64);
+        page = reallocarray(page, 16, 8);
+        free(page);
+        page = pvalloc(64);
+        free(page);
+        // the block is still allocated after a failed realloc and freed once
+        void* volatile block = malloc(16);
+        volatile size_t huge_size = SIZE_MAX / 4;
+        T_CHECK(realloc(block, huge_size) == nullptr);
+        free(block);
+        T_NO_LEAKS();
+    });
+#endif
+    root_module->run();
+    root_module->printSummary();
+    delete leaked;
+    assert(hot_path_test->result);
+    if (test::AllocationScope::isEnabled()) {
+        assert(hot_path_test->allocation_stats.allocations == 0);
+        assert(!balanced_test->result);
+        assert(balanced_test->allocation_stats.allocations >= 3);
+        assert(balanced_test->allocation_stats.peak_live_bytes > 0);
+        assert(!leaking_test->result);
+        assert(leaking_test->root_error->subentries.front()->str.starts_with("Memory leaked"));
+        assert(message_test->root_error->subentries.size() == 1);
+#ifdef TEST_LIB_TRACK_MALLOC
+        assert(page_test->result);
+        assert(page_test->allocation_stats.allocations == 4 && page_test->allocation_stats.deallocations == 4);
+#endif
+    } else {
+        assert(!hot_path_test->allocation_stats.available);
+        assert(balanced_test->result && leaking_test->result);
+    }
+}
+
+void test_node_kinds() {
+    TestModule* root_module = new TestModule("NodeKindModule", nullptr);
+    TestModule* child_module = root_module->addModule<TestModule>("ChildModule");
+    std::vector<int> run_order;
+    for (int i = 0; i < 100; i++) {
+        child_module->addTest("Test" + std::to_string(i), [&run_order, i](test::Test& test) {
+            run_order.push_back(i);
+        });
+    }
+    test::Benchmark* benchmark = root_module->addBenchmark("Benchmark", [](test::Benchmark& test) { });
+    assert(child_module->getKind() == test::NodeKind::Module && child_module->asModule() == child_module);
+    assert(!child_module->asTest());
+    assert(benchmark->asTest() == benchmark && benchmark->asBenchmark() == benchmark);
+    test::Test* first_test = child_module->getChildTests().front();
+    assert(first_test->getKind() == test::NodeKind::Test && !first_test->asBenchmark());
+    assert(root_module->getAllTests().size() == 101);
+    root_module->selection.include("ChildModule/**");
+    root_module->run();
+    assert(run_order.size() == 100);
+    assert(std::is_sorted(run_order.begin(), run_order.end()));
+    // captures that don't fit inline are moved to the heap, copies are independent
+    std::string long_str(100, 'x');
+    int small_sum = 0;
+    test::Callable<int(int)> small_func = [&small_sum](int value) { return small_sum += value; };
+    test::Callable<int(int)> large_func = [long_str, small_sum](int value) { return static_cast<int>(long_str.size()) + value; };
+    test::Callable<int(int)> copied_func = large_func;
+    test::Callable<int(int)> moved_func = std::move(large_func);
+    assert(!large_func && moved_func && copied_func);
+    assert(small_func(2) == 2 && small_func(3) == 5);
+    assert(copied_func(1) == 101 && moved_func(2) == 102);
+    copied_func = small_func;
+    assert(copied_func(1) == 6);
+}
+
+void test_parameterized() {
+    TestModule* root_module = new TestModule("ParameterizedModule", nullptr);
+    std::vector<int> values(1000);
+    std::iota(values.begin(), values.end(), 0);
+    test::ParameterizedTest* table_test = root_module->addParameterizedTest("TableTest", values, [](test::Test& test, const int& value) {
+        T_CHECK(value % 100 != 7);
+    });
+    table_test->batch_size = 64;
+    table_test->max_listed_failures = 4;
+    auto generator = [n = 0]() mutable -> std::optional<std::pair<int, std::string>> {
+        if (n == 50000) {
+            return std::nullopt;
+        }
+        n++;
+        return std::make_pair(n, std::to_string(n));
+    };
+    test::ParameterizedTest* generator_test = root_module->addParameterizedTest("GeneratorTest", generator, [](test::Test& test, const auto& row) {
+        T_COMPARE(std::stoi(row.second), row.first);
+    });
+    std::filesystem::path lines_path = std::filesystem::temp_directory_path() / "test_lib_parameterized.txt";
+    std::ofstream(lines_path) << "1\r\n2\n3\n";
+    test::ParameterizedTest* file_test = root_module->addParameterizedTest("FileTest", test::FileLines(lines_path), [](test::Test& test, const std::string& line) {
+        T_CHECK(line.size() == 1);
+    });
+    test::ParameterizedTest* missing_file_test = root_module->addParameterizedTest(
+        "MissingFileTest", test::FileLines(lines_path.string() + ".missing"), [](test::Test& test, const std::string& line) { }
+    );
+    for (bool parallel : { true, false }) {
+        root_module->parallel = parallel;
+        root_module->thread_count = 4;
+        root_module->run();
+        root_module->printSummary();
+        assert(!table_test->result);
+        assert(table_test->case_count == 1000 && table_test->passed_count == 990);
+        test::TestError* summary = table_test->root_error->subentries.front();
+        assert(summary->str == "990/1000 cases passed");
+        assert(summary->subentries.size() == 5);
+        assert(summary->subentries.front()->str == "Case #7: 7");
+        assert(summary->subentries.back()->str == "6 more failing cases not listed");
+        assert(generator_test->result && generator_test->case_count == 50000);
+        assert(generator_test->getCasesString() == "50000/50000 cases passed");
+        assert(file_test->result && file_test->case_count == 3);
+        assert(!missing_file_test->result);
+        assert(missing_file_test->root_error->subentries.front()->str.starts_with("EXCEPTION: Could not open"));
+    }
+    assert(table_test->asParameterized() == table_test && table_test->getKind() == test::NodeKind::Parameterized);
+    assert(test::parameterToString(std::make_pair(1, std::string("a"))) == "(1, \"a\")");
+    std::filesystem::remove(lines_path);
+    // waiting for its batches never runs other tests nested on the same thread
+    TestModule* nesting_module = new TestModule("NestingModule", nullptr);
+    static thread_local int running_depth = 0;
+    std::atomic<bool> nested = false;
+    nesting_module->OnBeforeRunTest = [&]() {
+        if (running_depth++ > 0) {
+            nested = true;
+        }
+    };
+    nesting_module->OnAfterRunTest = [&]() {
+        running_depth--;
+    };
+    std::vector<int> slow_values(64);
+    std::iota(slow_values.begin(), slow_values.end(), 0);
+    test::ParameterizedTest* batched_test = nesting_module->addParameterizedTest("BatchedTest", slow_values, [](test::Test& test, const int& value) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    });
+    batched_test->batch_size = 1;
+    for (int i = 0; i < 16; i++) {
+        nesting_module->addTest("SlowTest" + std::to_string(i), [](test::Test& test) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        });
+    }
+    nesting_module->parallel = true;
+    nesting_module->thread_count = 2;
+    nesting_module->run();
+    assert(batched_test->result && batched_test->case_count == 64);
+    assert(nesting_module->getResultCount(test::ResultStore::Passed) == 17);
+    assert(!nested);
+}
+
+struct PropertyVec2 {
+    float x = 0.0f;
+    float y = 0.0f;
+};
+
+// shrinks one step at a time and counts the calls
+struct CountingShrinkGenerator {
+    using value_type = int;
+    static inline std::atomic<size_t> shrink_count = 0;
+
+    int generate(test::Random& random) const {
+        return random.between(1, 100);
+    }
+
+    std::vector<int> shrink(const int& value) const {
+        shrink_count++;
+        return value > 1 ? std::vector<int> { value - 1 } : std::vector<int>();
+    }
+};
+
+void test_property() {
+    TestModule* root_module = new TestModule("PropertyModule", nullptr);
+    const char* args[] = { "test_lib_tests", "--seed=1234" };
+    assert(root_module->parseArguments(2, args));
+    test::PropertyTest* reverse_test = root_module->addPropertyTest(
+        "ReverseTest", test::gen::Vectors(test::gen::Integers<int>()), [](test::Test& test, const std::vector<int>& values) {
+            std::vector<int> reversed(values.rbegin(), values.rend());
+            std::reverse(reversed.begin(), reversed.end());
+            T_CHECK(reversed == values);
+        }
+    );
+    reverse_test->cases_per_run = 20000;
+    test::PropertyTest* int_test = root_module->addPropertyTest(
+        "IntTest", test::gen::Integers<int>(0, 1000000), [](test::Test& test, const int& value) {
+            T_CHECK(value < 1000);
+        }
+    );
+    test::PropertyTest* string_test = root_module->addPropertyTest("StringTest", test::gen::Strings(), [](test::Test& test, const std::string& str) {
+        T_CHECK(str.find('z') == std::string::npos);
+    });
+    test::PropertyTest* vec2_test = root_module->addPropertyTest(
+        "Vec2Test", test::gen::Vec2<PropertyVec2>(test::gen::Floats<float>(-100.0f, 100.0f)), [](test::Test& test, const PropertyVec2& vec) {
+            T_CHECK(vec.x * vec.x + vec.y * vec.y < 100.0f);
+        }
+    );
+    test::PropertyTest* tuple_test = root_module->addPropertyTest(
+        "TupleTest", test::gen::Tuple(test::gen::Integers<int>(-50, 50), test::gen::Strings(4, "ab")), [](test::Test& test, const auto& value) {
+            T_CHECK(std::get<0>(value) < 10 || std::get<1>(value).size() < 2);
+        }
+    );
+    tuple_test->seed = 99;
+    test::PropertyTest* batched_test = root_module->addPropertyTest(
+        "BatchedTest", CountingShrinkGenerator(), [](test::Test& test, const int& value) {
+            T_CHECK(value < 1);
+        }
+    );
+    batched_test->batch_size = 10;
+    batched_test->cases_per_run = 400;
+    std::vector<std::string> labels;
+    for (bool parallel : { true, false }) {
+        root_module->parallel = parallel;
+        root_module->thread_count = 4;
+        CountingShrinkGenerator::shrink_count = 0;
+        root_module->run();
+        root_module->printSummary();
+        assert(reverse_test->result && reverse_test->case_count == 20000);
+        assert(reverse_test->getCasesString() == "20000/20000 cases passed, seed 1234");
+        assert(!int_test->result && int_test->case_count == 1000);
+        test::TestError* summary = int_test->root_error->subentries.front();
+        assert(summary->str.ends_with("cases passed, seed 1234"));
+        std::string_view label = summary->subentries.front()->str;
+        assert(label.find("counterexample 1000, shrunk from") != std::string_view::npos);
+        assert(summary->subentries.front()->subentries.front()->str.starts_with("Failed condition"));
+        std::string_view string_label = string_test->root_error->subentries.front()->subentries.front()->str;
+        assert(string_label.find("counterexample \"z\"") != std::string_view::npos);
+        assert(!vec2_test->result);
+        assert(tuple_test->getSeed() == 99);
+        std::string_view tuple_label = tuple_test->root_error->subentries.front()->subentries.front()->str;
+        assert(tuple_label.find("counterexample (10, \"aa\")") != std::string_view::npos);
+        // only the listed failure of all batches and waves is shrunk
+        assert(!batched_test->result && batched_test->case_count == 400);
+        assert(CountingShrinkGenerator::shrink_count <= 100);
+        test::TestError* batched_summary = batched_test->root_error->subentries.front();
+        assert(batched_summary->subentries.front()->str.find("counterexample 1") != std::string_view::npos);
+        labels.push_back(std::string(label));
+    }
+    // same seed, same cases
+    assert(labels[0] == labels[1]);
+    test::Random random(test::Random::caseSeed(1234, 7));
+    for (int i = 0; i < 1000; i++) {
+        int value = random.between(-3, 3);
+        assert(value >= -3 && value <= 3);
+        double unit = random.unit();
+        assert(unit >= 0.0 && unit < 1.0);
+    }
+}
+
+void test_fuzz() {
+    std::filesystem::path corpus_dir = std::filesystem::temp_directory_path() / "test_lib_fuzz_corpus";
+    std::filesystem::remove_all(corpus_dir);
+    std::filesystem::create_directories(corpus_dir);
+    std::ofstream(corpus_dir / "hello") << "hello";
+    std::ofstream(corpus_dir / "world") << "world";
+    TestModule* root_module = new TestModule("FuzzModule", nullptr);
+    const char* args[] = { "test_lib_tests", "--seed=42", "--fuzz-runs=500000", "--fuzz-time=30" };
+    assert(root_module->parseArguments(4, args));
+    test::FuzzTest* parser_test = root_module->addFuzzTest("ParserTest", corpus_dir, [](test::Test& test, const uint8_t* data, size_t size) {
+        T_CHECK(size == 0 || data[0] != '!');
+    });
+    test::FuzzTest* crash_test = root_module->addFuzzTest("CrashTest", corpus_dir, [](test::Test& test, const uint8_t* data, size_t size) {
+        if (size > 0 && data[0] == 0xFF) {
+            std::abort();
+        }
+    });
+    assert(parser_test->asFuzz() && parser_test->asParameterized() && !parser_test->asBenchmark());
+    root_module->run();
+    assert(parser_test->result && parser_test->case_count == 2);
+    assert(crash_test->result);
+    // the first failing input is minimized and stored next to the corpus
+    assert(!parser_test->fuzz(root_module->fuzz_runs, root_module->fuzz_time));
+    test::TestError* error = parser_test->root_error->subentries.front();
+    assert(error->str.find("minimized from") != std::string::npos);
+    assert(error->str.find("to 1 bytes") != std::string::npos);
+    assert(error->subentries.front()->str == "Input: \"!\"");
+    assert(parser_test->fuzz_runs > 0 && parser_test->corpus_size >= 2);
+    std::vector<std::filesystem::path> crash_files;
+    for (const auto& entry : std::filesystem::directory_iterator(corpus_dir)) {
+        if (entry.path().filename().string().starts_with("crash-")) {
+            crash_files.push_back(entry.path());
+        }
+    }
+    assert(crash_files.size() == 1);
+    // the stored input fails the regression run until it's fixed
+    root_module->run();
+    assert(!parser_test->result && parser_test->case_count == 3 && parser_test->passed_count == 2);
+    std::filesystem::remove(crash_files.front());
+    assert(!crash_test->fuzz(root_module->fuzz_runs, root_module->fuzz_time));
+    assert(crash_test->root_error->subentries.front()->subentries.back()->str.starts_with("CRASHED"));
+    // a target picked on the command line is fuzzed instead of running the tests
+    TestModule* target_module = new TestModule("FuzzTargetModule", nullptr);
+    const char* target_args[] = { "test_lib_tests", "--fuzz", "Inner/TargetTest", "--fuzz-runs=100000", "--seed=7" };
+    assert(target_module->parseArguments(5, target_args));
+    assert(target_module->fuzz_target == "Inner/TargetTest" && target_module->fuzz_runs == 100000);
+    TestModule* inner_module = target_module->addModule<TestModule>("Inner");
+    test::Test* other_test = inner_module->addTest("OtherTest", [](test::Test& test) { });
+    test::FuzzTest* target_test = inner_module->addFuzzTest("TargetTest", corpus_dir, [](test::Test& test, const uint8_t* data, size_t size) {
+        T_CHECK(size == 0 || data[0] != '!');
+    });
+    assert(!target_module->run());
+    assert(!target_test->result && target_test->fuzz_runs > 0 && !target_module->result);
+    assert(!other_test->is_run);
+    std::filesystem::remove_all(corpus_dir);
+}
+
+int lazy_module_count = 0;
+
+class LazyModule : public test::TestModule {
+public:
+    LazyModule(
+        const std::string& name,
+        test::TestModule* parent,
+        const std::vector<test::TestNode*>& required_nodes = { })
+        : test::TestModule(name, parent, required_nodes) {
+        lazy_module_count++;
+        addTest("inside", [](test::Test& test) { });
+    };
+};
+
+T_MODULE(LazyModule, "Registered/Lazy")
+
+T_TEST("Registered/Math/addition") {
+    T_COMPARE(2 + 2, 4);
+}
+
+T_TEST("Registered/Math/subtraction") {
+    T_COMPARE(4 - 2, 2);
+}
+
+T_TEST("Registered/Lazy/extra") { }
+
+T_TEST("top_level") { }
+
+void test_registration() {
+    TestModule* root_module = new TestModule("RegistrationModule", nullptr);
+    root_module->add_registered = true;
+    const char* args[] = { "test_lib_tests", "--filter", "Registered/Math/*" };
+    assert(root_module->parseArguments(3, args));
+    root_module->run();
+    // only the part of the registry the filter can match is built
+    assert(lazy_module_count == 0);
+    std::vector<test::Test*> tests = root_module->getAllTests();
+    assert(tests.size() == 2);
+    assert(tests[0]->getPath() == "Registered/Math/addition" && tests[0]->result);
+    assert(tests[1]->getPath() == "Registered/Math/subtraction" && tests[1]->result);
+    root_module->selection.clear();
+    root_module->list_only = true;
+    root_module->run();
+    assert(lazy_module_count == 1);
+    tests = root_module->getAllTests();
+    assert(tests.size() == 5);
+    assert(tests[2]->getPath() == "Registered/Lazy/inside" && !tests[2]->is_run);
+    assert(tests[3]->getPath() == "Registered/Lazy/extra");
+    assert(tests[4]->getPath() == "top_level");
+    root_module->list_only = false;
+    root_module->run();
+    assert(lazy_module_count == 1 && root_module->getAllTests().size() == 5);
+    assert(root_module->getResultCount(test::ResultStore::Passed) == 5);
+    TestModule* other_module = new TestModule("OtherModule", nullptr);
+    other_module->run();
+    assert(other_module->getAllTests().empty());
+    test::TestSelection selection;
+    selection.include("A/B*/c");
+    assert(selection.mayMatch("A", true) && selection.mayMatch("A/Bx", true) && selection.mayMatch("A/Bx/c", false));
+    assert(!selection.mayMatch("C", true) && !selection.mayMatch("A/Bx/d", false));
+    selection.exclude("A/Bx");
+    assert(!selection.mayMatch("A/Bx", true) && selection.mayMatch("A/By", true));
+}
+
+struct FixtureResource {
+    static inline std::atomic<int> live_count = 0;
+    int value = 42;
+
+    FixtureResource() {
+        live_count++;
+    }
+
+    ~FixtureResource() {
+        live_count--;
+    }
+};
+
+void test_fixtures() {
+    TestModule* root_module = new TestModule("FixtureModule", nullptr);
+    test::Fixture<FixtureResource>* run_fixture = root_module->addFixture<FixtureResource>(
+        "run", test::FixtureScope::Run, []() { return std::make_unique<FixtureResource>(); }
+    );
+    test::TestModule* module_a = root_module->addModule("A");
+    test::Fixture<FixtureResource>* module_fixture = module_a->addFixture<FixtureResource>(
+        "module", test::FixtureScope::Module, []() { return std::make_unique<FixtureResource>(); }
+    );
+    test::Fixture<FixtureResource>* test_fixture = module_a->addFixture<FixtureResource>(
+        "test", test::FixtureScope::Test, []() { return std::make_unique<FixtureResource>(); }
+    );
+    module_a->fixtures = { module_fixture };
+    for (const char* name : { "first", "second" }) {
+        module_a->addTest(name, [=](test::Test& test) {
+            T_COMPARE(module_fixture->get(test).value, 42);
+            FixtureResource& own = test_fixture->get(test);
+            T_CHECK(&own == &test_fixture->get(test));
+            T_COMPARE(run_fixture->get(test).value, 42);
+        })->fixtures = { run_fixture, test_fixture };
+    }
+    test::TestModule* module_b = root_module->addModule("B");
+    module_b->addTest("after", [=](test::Test& test) {
+        // the last user of the module fixture is done
+        T_CHECK(!module_fixture->isBuilt());
+        T_CHECK(run_fixture->isBuilt());
+        T_COMPARE(run_fixture->get(test).value, 42);
+    })->fixtures = { run_fixture };
+    module_b->addTest("undeclared", [=](test::Test& test) {
+        T_COMPARE(module_fixture->get(test).value, 42);
+    });
+    for (bool parallel : { false, true }) {
+        size_t module_builds = module_fixture->getBuildCount();
+        size_t run_builds = run_fixture->getBuildCount();
+        size_t test_builds = test_fixture->getBuildCount();
+        root_module->parallel = parallel;
+        root_module->thread_count = 4;
+        root_module->run();
+        assert(root_module->getResultCount(test::ResultStore::Passed) == (parallel ? 3 : 4));
+        assert(run_fixture->getBuildCount() == run_builds + 1);
+        assert(test_fixture->getBuildCount() == test_builds + 2);
+        // in sequential mode it's rebuilt by the undeclared user, who may also come first in parallel
+        size_t module_build_count = module_fixture->getBuildCount() - module_builds;
+        assert(parallel ? module_build_count >= 1 && module_build_count <= 2 : module_build_count == 2);
+        assert(!module_fixture->isBuilt() && !run_fixture->isBuilt());
+        assert(FixtureResource::live_count == 0);
+        // the order of B/after and the tests of A isn't fixed in parallel
+        root_module->selection.exclude("B/after");
+    }
+    // cancelled users release their fixtures too, so the last user that runs tears it down
+    TestModule* cancel_module = new TestModule("FixtureCancelModule", nullptr);
+    test::Fixture<FixtureResource>* shared_fixture = cancel_module->addFixture<FixtureResource>(
+        "shared", test::FixtureScope::Module, []() { return std::make_unique<FixtureResource>(); }
+    );
+    test::Test* failing_test = cancel_module->addTest("FailingTest", [](test::Test& test) {
+        T_CHECK(false);
+    });
+    test::TestModule* blocked_module = cancel_module->addModule("Blocked", { failing_test });
+    blocked_module->addTest("BlockedUser", [=](test::Test& test) {
+        T_COMPARE(shared_fixture->get(test).value, 42);
+    })->fixtures = { shared_fixture };
+    cancel_module->addTest("User", [=](test::Test& test) {
+        T_COMPARE(shared_fixture->get(test).value, 42);
+    })->fixtures = { shared_fixture };
+    bool built_at_end = true;
+    cancel_module->OnAfterRun = [&]() {
+        built_at_end = shared_fixture->isBuilt();
+    };
+    for (bool parallel : { false, true }) {
+        cancel_module->parallel = parallel;
+        cancel_module->thread_count = 4;
+        built_at_end = true;
+        cancel_module->run();
+        assert(cancel_module->getResultCount(test::ResultStore::Cancelled) == 1);
+        assert(shared_fixture->getBuildCount() == (parallel ? 2 : 1));
+        assert(!built_at_end);
+    }
+    // excluded and already cancelled tests don't release a fixture they never counted as users
+    TestModule* excluded_module = new TestModule("FixtureExcludeModule", nullptr);
+    test::Fixture<FixtureResource>* run_scope_fixture = excluded_module->addFixture<FixtureResource>(
+        "run", test::FixtureScope::Run, []() { return std::make_unique<FixtureResource>(); }
+    );
+    auto use_fixture = [=](test::Test& test) {
+        T_COMPARE(run_scope_fixture->get(test).value, 42);
+    };
+    test::Test* a_test = excluded_module->addTest("A", [=](test::Test& test) {
+        use_fixture(test);
+        T_CHECK(false);
+    });
+    a_test->fixtures = { run_scope_fixture };
+    test::TestModule* m_module = excluded_module->addModule("M", { a_test });
+    m_module->addTest("x", use_fixture)->fixtures = { run_scope_fixture };
+    m_module->addTest("y", use_fixture)->fixtures = { run_scope_fixture };
+    test::Test* z_test = excluded_module->addTest("Z", use_fixture);
+    z_test->fixtures = { run_scope_fixture };
+    excluded_module->selection.exclude("M/y");
+    for (bool parallel : { false, true }) {
+        size_t builds = run_scope_fixture->getBuildCount();
+        excluded_module->parallel = parallel;
+        excluded_module->thread_count = 4;
+        excluded_module->run();
+        assert(z_test->result);
+        assert(excluded_module->getResultCount(test::ResultStore::Cancelled) == 1);
+        assert(run_scope_fixture->getBuildCount() == builds + 1);
+    }
+}
+
+void test_diff() {
+    // the matches of random inputs have the length of a longest common subsequence
+    test::Random random(7);
+    for (int round = 0; round < 200; round++) {
+        std::string left = test::gen::Strings(40, "abc").generate(random);
+        std::string right = test::gen::Strings(40, "abc").generate(random);
+        std::vector<test::DiffMatch> matches = test::diffSequences(left.size(), right.size(), [&](size_t i, size_t j) {
+            return left[i] == right[j];
+        });
+        size_t matched = 0;
+        size_t left_pos = 0;
+        size_t right_pos = 0;
+        for (const test::DiffMatch& match : matches) {
+            assert(match.old_start >= left_pos && match.new_start >= right_pos);
+            assert(left.compare(match.old_start, match.length, right, match.new_start, match.length) == 0);
+            matched += match.length;
+            left_pos = match.old_start + match.length;
+            right_pos = match.new_start + match.length;
+        }
+        assert(matches.back().old_start == left.size() && matches.back().new_start == right.size());
+        std::vector<std::vector<size_t>> lcs(left.size() + 1, std::vector<size_t>(right.size() + 1, 0));
+        for (size_t i = 1; i <= left.size(); i++) {
+            for (size_t j = 1; j <= right.size(); j++) {
+                lcs[i][j] = left[i - 1] == right[j - 1] ? lcs[i - 1][j - 1] + 1 : std::max(lcs[i - 1][j], lcs[i][j - 1]);
+            }
+        }
+        assert(matched == lcs[left.size()][right.size()]);
+    }
+    std::string expected_text;
+    std::string actual_text;
+    for (int i = 0; i < 10; i++) {
+        expected_text += "line" + std::to_string(i) + "\n";
+        actual_text += (i == 5 ? "LINE" : "line") + std::to_string(i) + "\n";
+    }
+    std::string big_expected(2000000, ' ');
+    for (size_t i = 0; i < big_expected.size(); i++) {
+        big_expected[i] = static_cast<char>('a' + i * 7 % 26);
+    }
+    std::string big_actual = big_expected;
+    big_actual[1000] = '#';
+    big_actual.insert(1000000, "XYZ");
+    std::string spread_expected(2000, '.');
+    std::string spread_actual = spread_expected;
+    for (size_t i = 0; i < 20; i++) {
+        spread_actual[i * 100] = '!';
+    }
+    std::vector<int> values(1000000);
+    std::iota(values.begin(), values.end(), 0);
+    std::vector<int> changed_values = values;
+    changed_values.insert(changed_values.begin() + 500000, -1);
+    TestModule* root_module = new TestModule("DiffModule", nullptr);
+    test::Test* diff_test = root_module->addTest("DiffTest", [&](test::Test& test) {
+        T_COMPARE(actual_text, expected_text);
+        T_COMPARE(big_actual, big_expected);
+        T_COMPARE(spread_actual, spread_expected);
+        T_COMPARE(changed_values, values);
+        T_COMPARE(std::vector<int>({ 1, 2 }), std::vector<int>({ 1, 3 }));
+    });
+    root_module->run();
+    assert(!diff_test->result);
+    std::vector<const test::TestError*> errors;
+    for (const test::TestError* error : diff_test->root_error->subentries) {
+        errors.push_back(error);
+    }
+    assert(errors.size() == 5);
+    auto entries = [](const test::TestError* error) {
+        std::vector<std::string> result;
+        for (const test::TestError* entry : error->subentries) {
+            result.push_back(std::string(entry->str));
+        }
+        return result;
+    };
+    std::vector<std::string> text = entries(errors[0]);
+    assert(text.size() == 2 && text[0] == "Differs in 1 place, expected has 11 lines, actual has 11");
+    assert(text[1] == "@@ -3,7 +3,7 @@");
+    std::vector<std::string> hunk = entries(errors[0]->subentries.back());
+    std::vector<std::string> expected_hunk = { " line2", " line3", " line4", "-line5", "+LINE5", " line6", " line7", " line8" };
+    assert(hunk == expected_hunk);
+    std::vector<std::string> big = entries(errors[1]);
+    assert(big.size() == 3 && big[0] == "Differs in 2 places, expected has 2000000 characters, actual has 2000003");
+    assert(big[1] == "At index 1000 of expected, 1000 of actual");
+    std::vector<std::string> big_hunk = entries(errors[1]->subentries.front()->next);
+    assert(big_hunk.size() == 2 && big_hunk[0] == "Expected: ..." + big_expected.substr(980, 41) + "...");
+    assert(big_hunk[1] == "Actual:   ..." + big_actual.substr(980, 41) + "...");
+    std::vector<std::string> spread = entries(errors[2]);
+    assert(spread.back() == "12 more differing hunks not shown");
+    std::vector<std::string> sequence = entries(errors[3]);
+    assert(sequence[0] == "Differs in 1 place, expected has 1000000 elements, actual has 1000001");
+    assert(sequence[1] == "@@ -499997,6 +499997,7 @@");
+    std::vector<std::string> sequence_hunk = entries(errors[3]->subentries.back());
+    assert(sequence_hunk[2] == " [499999] 499999" && sequence_hunk[3] == "+[500000] -1" && sequence_hunk[4] == " [500000/500001] 500000");
+    std::vector<std::string> small = entries(errors[4]);
+    assert(small[0] == "Expected value: [1, 3]" && small[1] == "Actual value:   [1, 2]");
+}
+
+void test_snapshot() {
+    std::filesystem::path snapshot_dir = std::filesystem::temp_directory_path() / "test_lib_snapshots";
+    std::filesystem::remove_all(snapshot_dir);
+    std::vector<uint32_t> pixels(4096);
+    std::iota(pixels.begin(), pixels.end(), 0);
+    std::string text = "Hello, snapshot\n";
+    auto run = [&](bool update) {
+        TestModule* root_module = new TestModule("SnapshotModule", nullptr);
+        root_module->snapshot_dir = snapshot_dir;
+        root_module->update_snapshots = update;
+        test::Test* snapshot_test = root_module->addTest("SnapshotTest", [&](test::Test& test) {
+            T_SNAPSHOT("pixels.bin", pixels);
+            T_SNAPSHOT("text.txt", text);
+        });
+        root_module->run();
+        return snapshot_test;
+    };
+    // missing goldens fail until they are created
+    test::Test* missing_test = run(false);
+    assert(!missing_test->result);
+    assert(std::string(missing_test->root_error->subentries.front()->subentries.front()->str).find("doesn't exist") != std::string::npos);
+    assert(run(true)->result);
+    std::filesystem::path pixels_path = snapshot_dir / "SnapshotTest" / "pixels.bin";
+    assert(std::filesystem::file_size(pixels_path) == pixels.size() * sizeof(uint32_t));
+    assert(run(false)->result);
+    pixels[3000] = 0x41424344;
+    test::Test* changed_test = run(false);
+    assert(!changed_test->result);
+    std::vector<std::string> entries;
+    for (const test::TestError* entry : changed_test->root_error->subentries.front()->subentries) {
+        entries.push_back(std::string(entry->str));
+    }
+    assert(entries.size() == 4 && entries[0] == "Differs from " + pixels_path.string() + " at offset 12000, expected size 16384, actual size 16384");
+    const test::TestError* actual_rows = changed_test->root_error->subentries.front()->subentries.front()->next->next;
+    std::vector<std::string> rows;
+    for (const test::TestError* row : actual_rows->subentries) {
+        rows.push_back(std::string(row->str));
+    }
+    assert(rows.size() == 3 && rows[1].starts_with("00002ee0  "));
+    assert(rows[1].find("44 43 42 41") != std::string::npos && rows[1].ends_with("|DCBA............|"));
+    // updating replaces the golden, no temporary files are left next to it
+    assert(run(true)->result);
+    assert(run(false)->result);
+    std::filesystem::directory_iterator snapshot_files(snapshot_dir / "SnapshotTest");
+    assert(std::distance(snapshot_files, std::filesystem::directory_iterator()) == 2);
+    // names can't reach outside the snapshot directory
+    TestModule* escape_module = new TestModule("EscapeModule", nullptr);
+    escape_module->snapshot_dir = snapshot_dir;
+    TestModule* dots_module = escape_module->addModule<TestModule>("..");
+    test::Test* escape_test = dots_module->addTest("a/b", [](test::Test& test) { });
+    std::filesystem::path escaped_path = test::getSnapshotPath(*escape_test, "../x%.bin");
+    assert(escaped_path == snapshot_dir / "%2E%2E" / "a%2Fb" / "..%2Fx%25.bin");
+    std::filesystem::remove_all(snapshot_dir);
+}
+
+void test_stress() {
+    const size_t thread_count = 4;
+    std::atomic<size_t> arrived = 0;
+    std::atomic<size_t> increments = 0;
+    TestModule* root_module = new TestModule("StressModule", nullptr);
+    test::StressTest* counter_test = root_module->addStressTest("CounterTest", thread_count, 200, [&](test::Test& test, size_t thread_index) {
+        // every thread of an iteration is in the body at the same time
+        size_t target = (arrived.fetch_add(1) / thread_count + 1) * thread_count;
+        while (arrived.load() < target) {
+            std::this_thread::yield();
+        }
+        increments++;
+        T_CHECK(thread_index < thread_count);
+    });
+    test::StressTest* failing_test = root_module->addStressTest("FailingTest", thread_count, 5, [&](test::Test& test, size_t thread_index) {
+        T_CHECK(thread_index % 2 == 0, "Odd thread");
+    });
+    failing_test->stop_on_failure = false;
+    failing_test->max_listed_failures = 4;
+    test::StressTest* stopping_test = root_module->addStressTest("StoppingTest", thread_count, 1000, [&](test::Test& test, size_t thread_index) {
+        T_CHECK(thread_index != 1);
+    });
+    test::StressTest* timed_test = root_module->addStressTest("TimedTest", 2, 0, [&](test::Test& test, size_t thread_index) { });
+    timed_test->max_time = std::chrono::milliseconds(20);
+    root_module->run();
+    assert(counter_test->result);
+    assert(counter_test->iteration_count == 200 && increments == 200 * thread_count);
+    assert(counter_test->getIterationsString() == "200 iterations on 4 threads");
+    assert(!failing_test->result);
+    assert(failing_test->iteration_count == 5 && failing_test->failed_count == 10);
+    const test::TestError* summary = failing_test->root_error->subentries.front();
+    assert(summary->str == "5 iterations on 4 threads, 10 failures");
+    std::vector<std::string> entries;
+    for (const test::TestError* entry : summary->subentries) {
+        entries.push_back(std::string(entry->str));
+    }
+    // listed in thread order, the buffer of a thread keeps its first failures
+    std::vector<std::string> expected_entries = {
+        "Thread 1, iteration 0", "Thread 1, iteration 1", "Thread 1, iteration 2", "Thread 1, iteration 3", "6 more failures not listed"
+    };
+    assert(entries == expected_entries);
+    assert(summary->subentries.front()->subentries.size() == 1);
+    assert(!stopping_test->result);
+    assert(stopping_test->iteration_count == 1 && stopping_test->failed_count == 1);
+    assert(timed_test->result && timed_test->iteration_count > 0);
+}
+
 int main() {
     basic_test();
     add_test();
@@ -119,6 +1540,58 @@ int main() {
     std::cout << std::endl;
     test_module_dependency_cancellation();
     std::cout << std::endl;
+    test_parallel_execution();
+    std::cout << std::endl;
+    test_parallel_cancellation();
+    std::cout << std::endl;
+    test_isolated_execution();
+    std::cout << std::endl;
+    test_timing();
+    std::cout << std::endl;
+    test_benchmark();
+    std::cout << std::endl;
+    test_baseline_regression();
+    std::cout << std::endl;
+    test_hardware_counters();
+    std::cout << std::endl;
+    test_error_limit();
+    std::cout << std::endl;
+    test_assertion_messages();
+    std::cout << std::endl;
+    test_span_compare();
+    std::cout << std::endl;
+    test_reporters();
+    std::cout << std::endl;
+    test_result_queries();
+    std::cout << std::endl;
+    test_selection();
+    std::cout << std::endl;
+    test_result_cache();
+    std::cout << std::endl;
+    test_sharding();
+    std::cout << std::endl;
+    test_timeouts();
+    std::cout << std::endl;
+    test_allocation_tracking();
+    std::cout << std::endl;
+    test_node_kinds();
+    std::cout << std::endl;
+    test_parameterized();
+    std::cout << std::endl;
+    test_property();
+    std::cout << std::endl;
+    test_fuzz();
+    std::cout << std::endl;
+    test_registration();
+    std::cout << std::endl;
+    test_fixtures();
+    std::cout << std::endl;
+    test_diff();
+    std::cout << std::endl;
+    test_snapshot();
+    std::cout << std::endl;
+    test_stress();
+    std::cout << std::endl;
     std::cout << "ALL PASSED" << std::endl;
 
     // TODO: add T_FAIL macro that outputs message and returns